@@ -52,9 +52,10 @@ Buffer::~Buffer()
 
 void Buffer::notifyFree()
 {
+    // mark free first, the listener may hand out the buffer again right away
+    _impl->free = true;
     if( _impl->listener )
         _impl->listener->notifyFree( this );
-    _impl->free = true;
 }
 
 bool Buffer::isFree() const
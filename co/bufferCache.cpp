@@ -26,16 +26,28 @@
 #include "node.h"
 
 #include <lunchbox/atomic.h>
-#include <list>
+#include <lunchbox/lock.h>
+#include <lunchbox/scopedMutex.h>
+#include <lunchbox/spinLock.h>
+#include <unordered_set>
+#include <vector>
 
 //#define PROFILE
-// 31300 hits, 35 misses, 297640 lookups, 126976b allocated in 31 buffers
-// 31300 hits, 35 misses, 49228 lookups, 135168b allocated in 34 buffers
+//
+// Free buffers are kept in one free list per size class. A size class holds
+// buffers with a capacity of at least 4KB << ( 4 * class ), i.e., 4KB, 64KB,
+// 1MB, 16MB and 256MB. alloc() pops a buffer from the smallest class fitting
+// the requested size, and Buffer::notifyFree() pushes it to the largest class
+// its capacity fits, which are both O(1) operations. The free lists are
+// protected by a spin lock held only for a push or pop, so that buffers can be
+// allocated and released from any thread. The set of all buffers, only changed
+// on cache misses and compaction, has its own lock.
 //
 // The buffer cache periodically frees allocated buffers to bound memory usage:
 // * 'minFree' buffers (given in ctor) are always kept free
 // * above 'size >> _maxFreeShift' free buffers compaction occurs
 // * compaction tries to reach '(size >> _maxFreeShift) >> _targetShift' buffers
+//   by freeing buffers of the biggest size classes first
 //
 // In other words, using the values below, if more than half of the buffers are
 // free, the cache is compacted to until one quarter of the buffers is free.
@@ -44,16 +56,45 @@ namespace co
 {
 namespace
 {
-typedef std::list< Buffer* > Data;
+typedef std::unordered_set< Buffer* > Data;
 typedef Data::const_iterator DataCIter;
+typedef std::vector< Buffer* > FreeList;
 
 static const uint32_t _maxFreeShift = 1; // _maxFree = size >> shift
 static const uint32_t _targetShift = 1; // _targetFree = _maxFree >> shift
 
+static const size_t _nClasses = 5;
+static const uint32_t _classShift = 4; // class size factor 16
+
+uint64_t _getClassSize( const size_t sizeClass )
+{
+    return uint64_t( COMMAND_ALLOCSIZE ) << ( sizeClass * _classShift );
+}
+
+/** @return the smallest size class holding the given size. */
+size_t _getAllocClass( const uint64_t size )
+{
+    size_t sizeClass = 0;
+    while( sizeClass < _nClasses - 1 && _getClassSize( sizeClass ) < size )
+        ++sizeClass;
+    return sizeClass;
+}
+
+/** @return the biggest size class the given capacity satisfies. */
+size_t _getFreeClass( const uint64_t capacity )
+{
+    size_t sizeClass = 0;
+    while( sizeClass < _nClasses - 1 &&
+           _getClassSize( sizeClass + 1 ) <= capacity )
+    {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
 #ifdef PROFILE
 static lunchbox::a_int32_t _hits;
 static lunchbox::a_int32_t _misses;
-static lunchbox::a_int32_t _lookups;
 static lunchbox::a_int32_t _allocs;
 static lunchbox::a_int32_t _frees;
 #endif
@@ -64,23 +105,22 @@ class BufferCache : public BufferListener
 {
 public:
     explicit BufferCache( const int32_t minFree )
-        : _minFree( minFree )
+        : _free( 0 )
+        , _minFree( minFree )
+        , _maxFree( minFree )
     {
         LBASSERT( minFree > 1);
-        flush();
     }
 
     ~BufferCache()
     {
-        LBASSERT( _cache.size() == 1 );
-        LBASSERT( _cache.front()->isFree( ));
-
-        delete _cache.front();
-        _cache.clear();
+        flush();
     }
 
     void flush()
     {
+        lunchbox::ScopedFastWrite cacheMutex( _cacheLock );
+        lunchbox::ScopedFastWrite mutex( _lock );
         for( DataCIter i = _cache.begin(); i != _cache.end(); ++i )
         {
             co::Buffer* buffer = *i;
@@ -91,73 +131,54 @@ public:
                       size_t( _free ) << " != " << _cache.size() );
 
         _cache.clear();
-        _cache.push_back( new co::Buffer( this ));
-        _free = 1;
+        for( size_t i = 0; i < _nClasses; ++i )
+            _freeLists[ i ].clear();
+        _free = 0;
         _maxFree = _minFree;
-        _position = _cache.begin();
     }
 
-    BufferPtr newBuffer()
+    BufferPtr newBuffer( const uint64_t size )
     {
-        const uint32_t cacheSize = uint32_t( _cache.size( ));
-        LBASSERTINFO( size_t( _free ) <= cacheSize,
-                      size_t( _free ) << " > " << cacheSize );
-
+        const size_t sizeClass = _getAllocClass( size );
+        co::Buffer* buffer = 0;
         if( _free > 0 )
         {
-            LBASSERT( cacheSize > 0 );
-
-            const DataCIter end = _position;
-            DataCIter& i = _position;
-
-            for( ++i; i != end; ++i )
+            lunchbox::ScopedFastWrite mutex( _lock );
+            for( size_t i = sizeClass; i < _nClasses && !buffer; ++i )
             {
-                if( i == _cache.end( ))
-                    i = _cache.begin();
-#ifdef PROFILE
-                ++_lookups;
-#endif
-                co::Buffer* buffer = *i;
-                if( !buffer->isFree( ))
+                FreeList& freeList = _freeLists[ i ];
+                if( freeList.empty( ))
                     continue;
 
-#ifdef PROFILE
-                const long hits = ++_hits;
-                if( (hits%1000) == 0 )
-                {
-                    size_t size = 0;
-                    for( DataCIter j = _cache.begin(); j != _cache.end(); ++j )
-                            size += (*j)->getMaxSize();
-
-                    LBINFO << _hits << "/" << _hits + _misses << " hits, "
-                           << _lookups << " lookups, " << _free << " of "
-                           << _cache.size() << " buffers free (min " << _minFree
-                           << " max " << _maxFree << "), " << _allocs
-                           << " allocs, " << _frees << " frees, "
-                           << size / 1024 << "KB" << std::endl;
-                }
-#endif
+                buffer = freeList.back();
+                freeList.pop_back();
                 --_free;
-                buffer->setUsed();
-                return buffer;
             }
         }
 
-        const uint32_t add = (cacheSize >> 3) + 1;
-        for( size_t j = 0; j < add; ++j )
-            _cache.push_back( new co::Buffer( this ));
-
-        _free += add - 1;
-        const int32_t num = int32_t( _cache.size() >> _maxFreeShift );
-        _maxFree = LB_MAX( _minFree, num );
-        _position = _cache.begin();
+        if( buffer )
+        {
+#ifdef PROFILE
+            ++_hits;
+#endif
+            buffer->setUsed();
+            return buffer;
+        }
 
 #ifdef PROFILE
         ++_misses;
-        _allocs += add;
+        ++_allocs;
 #endif
-        _cache.back()->setUsed();
-        return _cache.back();
+        buffer = new co::Buffer( this );
+        buffer->reserve( LB_MAX( size, _getClassSize( sizeClass )));
+        buffer->setUsed();
+
+        lunchbox::ScopedFastWrite mutex( _cacheLock );
+        _cache.insert( buffer );
+
+        const int32_t num = int32_t( _cache.size() >> _maxFreeShift );
+        _maxFree = LB_MAX( _minFree, num );
+        return buffer;
     }
 
     void compact()
@@ -165,47 +186,61 @@ public:
         if( _free <= _maxFree )
             return;
 
+        lunchbox::ScopedWrite compactMutex( _compactLock );
+
         const int32_t tgt = _maxFree >> _targetShift;
         const int32_t target = LB_MAX( tgt, _minFree );
         LBASSERT( target > 0 );
 
-        Data::iterator i = _cache.begin();
-        while( i != _cache.end( ))
+        FreeList buffers;
         {
-            const co::Buffer* buffer = *i;
-            if( buffer->isFree( ))
+            lunchbox::ScopedFastWrite mutex( _lock );
+            for( size_t i = _nClasses; i > 0 && _free > target; --i )
             {
-                LBASSERT( _free > 0 );
+                FreeList& freeList = _freeLists[ i - 1 ];
+                while( !freeList.empty() && _free > target )
+                {
+                    buffers.push_back( freeList.back( ));
+                    freeList.pop_back();
+                    --_free;
+                }
+            }
+        }
+
+        lunchbox::ScopedFastWrite mutex( _cacheLock );
+        for( FreeList::const_iterator i = buffers.begin(); i != buffers.end();
+             ++i )
+        {
+            co::Buffer* buffer = *i;
 #  ifdef PROFILE
-                ++_frees;
+            ++_frees;
 #  endif
-                i = _cache.erase( i );
-                delete buffer;
-
-                if( --_free <= target )
-                    break;
-            }
-            else
-                ++i;
+            _cache.erase( buffer );
+            delete buffer;
         }
 
         const int32_t num = int32_t( _cache.size() >> _maxFreeShift );
         _maxFree = LB_MAX( _minFree, num );
-        _position = (i == _cache.end( )) ? _cache.begin() : i;
     }
 
 private:
     friend std::ostream& co::operator << (std::ostream&,const co::BufferCache&);
 
-    Data _cache;
-    DataCIter _position; //!< Last lookup position
+    Data _cache; //!< All buffers
+    lunchbox::SpinLock _cacheLock; //!< Protects the set of all buffers
+    FreeList _freeLists[ _nClasses ]; //!< Free buffers per size class
+    lunchbox::SpinLock _lock; //!< Protects the free lists
+    lunchbox::Lock _compactLock; //!< Serializes compactions
     lunchbox::a_int32_t _free; //!< The current number of free items
 
     const int32_t _minFree;
-    int32_t _maxFree; //!< The maximum number of free items
+    lunchbox::a_int32_t _maxFree; //!< The maximum number of free items
 
-    virtual void notifyFree( co::Buffer* )
+    virtual void notifyFree( co::Buffer* buffer )
     {
+        const size_t sizeClass = _getFreeClass( buffer->getMaxSize( ));
+        lunchbox::ScopedFastWrite mutex( _lock );
+        _freeLists[ sizeClass ].push_back( buffer );
         ++_free;
     }
 };
@@ -217,7 +252,6 @@ BufferCache::BufferCache( const int32_t minFree )
 
 BufferCache::~BufferCache()
 {
-    flush();
     delete _impl;
 }
 
@@ -228,12 +262,11 @@ void BufferCache::flush()
 
 BufferPtr BufferCache::alloc( const uint64_t size )
 {
-    LB_TS_SCOPED( _thread );
     LBASSERTINFO( size >= COMMAND_ALLOCSIZE, size );
     LBASSERTINFO( size < LB_BIT48,
                   "Out-of-sync network stream: buffer size " << size << "?" );
 
-    BufferPtr buffer = _impl->newBuffer();
+    BufferPtr buffer = _impl->newBuffer( size );
     LBASSERT( buffer->getRefCount() == 1 );
 
     buffer->reserve( size );
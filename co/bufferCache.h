@@ -35,7 +35,8 @@ namespace detail { class BufferCache; }
  * The buffer cache handles the reuse of allocated buffers for a node.
  *
  * Buffers are retained and released whenever they are not directly processed,
- * e.g., when pushed to another thread using a CommandQueue.
+ * e.g., when pushed to another thread using a CommandQueue. Buffers may be
+ * allocated and released from any thread.
  */
 class BufferCache : public boost::noncopyable
 {
@@ -60,7 +61,6 @@ public:
 private:
     detail::BufferCache* const _impl;
     friend std::ostream& operator << ( std::ostream&, const BufferCache& );
-    LB_TS_VAR( _thread );
 };
 
 std::ostream& operator << ( std::ostream&, const BufferCache& );
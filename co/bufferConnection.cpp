@@ -19,6 +19,8 @@
 
 #include "bufferConnection.h"
 
+#include "commands.h"
+
 #include <lunchbox/buffer.h>
 #include <string.h>
 
@@ -36,6 +38,8 @@ public:
 BufferConnection::BufferConnection()
         : _impl( new detail::BufferConnection )
 {
+    // Buffer commands compactly, padding is added in sendBuffer() if needed
+    setFraming( FRAMING_EXACT );
     _setState( STATE_CONNECTED );
     LBVERB << "New BufferConnection @" << (void*)this << std::endl;
 }
@@ -80,8 +84,39 @@ void BufferConnection::sendBuffer( ConnectionPtr connection )
         return;
     }
 
-    LBCHECK( connection->send( _impl->buffer.getData(),
-                               _impl->buffer.getSize() ));
+    if( connection->getFraming() != FRAMING_PADDED )
+    {
+        LBCHECK( connection->send( _impl->buffer.getData(),
+                                   _impl->buffer.getSize() ));
+        _impl->buffer.setSize( 0 );
+        return;
+    }
+
+    // Re-frame the buffered commands for a peer expecting padded commands
+    const uint8_t* data = _impl->buffer.getData();
+    const uint64_t size = _impl->buffer.getSize();
+    uint8_t padding[ COMMAND_MINSIZE ];
+
+    connection->lockSend();
+    for( uint64_t offset = 0; offset < size; )
+    {
+        uint64_t cmdSize = 0;
+        ::memcpy( &cmdSize, data + offset, sizeof( cmdSize ));
+        cmdSize = LB_MIN( cmdSize, size - offset );
+        if( cmdSize < sizeof( cmdSize ))
+        {
+            LBERROR << "Invalid command in buffer, dropping " << size - offset
+                    << " bytes" << std::endl;
+            break;
+        }
+
+        LBCHECK( connection->send( data + offset, cmdSize, true ));
+        if( cmdSize < COMMAND_MINSIZE )
+            LBCHECK( connection->send( padding, COMMAND_MINSIZE - cmdSize,
+                                       true ));
+        offset += cmdSize;
+    }
+    connection->unlockSend();
     _impl->buffer.setSize( 0 );
 }
 
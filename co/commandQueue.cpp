@@ -1,4 +1,3 @@
-
 /* Copyright (c) 2005-2013, Stefan Eilemann <eile@equalizergraphics.com>
  *
  * This file is part of Collage <https://github.com/Eyescale/Collage>
@@ -24,19 +23,368 @@
 #include "log.h"
 #include "node.h"
 
-#include <lunchbox/mtQueue.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/lock.h>
+#include <lunchbox/scopedMutex.h>
+
+#include <atomic>
+#include <climits>
+#include <deque>
+#include <new>
+#include <type_traits>
+
+#ifdef __linux__
+#  include <errno.h>
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <time.h>
+#  include <unistd.h>
+#else
+#  include <lunchbox/condition.h>
+#endif
 
 namespace co
 {
 namespace detail
 {
+namespace
+{
+/** Ring size of unbounded queues, excess commands spill into a list. */
+static const size_t _unboundedCapacity = 256;
+
+/** Number of polls of an empty queue before parking the consumer. */
+static const size_t _nSpins = 128;
+}
+
+/**
+ * A wait/wake word, a futex on Linux and a condition elsewhere.
+ *
+ * Wakers change the value before waking, waiters only sleep while the value
+ * equals the one they sampled, which closes the lost wakeup window. Waits may
+ * return spuriously.
+ */
+class Futex
+{
+public:
+    Futex() : value( 0 ) {}
+
+    /** @return false on timeout. */
+    bool wait( const uint32_t expected, const uint32_t timeout )
+    {
+#ifdef __linux__
+        struct timespec time;
+        struct timespec* timePtr = 0;
+        if( timeout != LB_TIMEOUT_INDEFINITE )
+        {
+            time.tv_sec = timeout / 1000;
+            time.tv_nsec = ( timeout % 1000 ) * 1000000;
+            timePtr = &time;
+        }
+        if( ::syscall( SYS_futex, &value, FUTEX_WAIT_PRIVATE, expected,
+                       timePtr, 0, 0 ) == 0 )
+        {
+            return true;
+        }
+        return errno != ETIMEDOUT;
+#else
+        _condition.lock();
+        bool signalled = true;
+        if( value == expected )
+            signalled = _condition.timedWait( timeout );
+        _condition.unlock();
+        return signalled;
+#endif
+    }
+
+    void wake( const int nWaiters )
+    {
+        ++value;
+#ifdef __linux__
+        ::syscall( SYS_futex, &value, FUTEX_WAKE_PRIVATE, nWaiters, 0, 0, 0 );
+#else
+        _condition.lock();
+        if( nWaiters == 1 )
+            _condition.signal();
+        else
+            _condition.broadcast();
+        _condition.unlock();
+#endif
+    }
+
+    std::atomic< uint32_t > value;
+
+private:
+#ifndef __linux__
+    lunchbox::Condition _condition;
+#endif
+};
+
+/**
+ * Lock-free multi-producer, single-consumer command queue.
+ *
+ * Commands are passed through a bounded ring of sequenced slots. In bounded
+ * mode producers park until the consumer frees a slot. In unbounded mode a
+ * full ring spills into a locked list, which is only drained once the ring is
+ * empty. A producer with spilled commands keeps spilling, which preserves the
+ * order of each producer's commands. pushFront() commands are kept in a
+ * separate locked list and served first.
+ */
 class CommandQueue
 {
 public:
-    explicit CommandQueue( const size_t maxSize ) : commands( maxSize ) {}
+    explicit CommandQueue( const size_t maxSize )
+        : _bounded( maxSize < ULONG_MAX )
+        , _capacity( _getCapacity( _bounded ? maxSize : _unboundedCapacity ))
+        , _slots( new Slot[ _capacity ] )
+        , _head( 0 )
+        , _tail( 0 )
+        , _size( 0 )
+        , _nSpilled( 0 )
+        , _nFront( 0 )
+        , _waiting( false )
+        , _nWaitingProducers( 0 )
+    {
+        for( size_t i = 0; i < _capacity; ++i )
+        {
+            _slots[i].sequence.store( i, std::memory_order_relaxed );
+            _slots[i].constructed = false;
+        }
+    }
+
+    ~CommandQueue()
+    {
+        for( size_t i = 0; i < _capacity; ++i )
+            if( _slots[i].constructed )
+                _slots[i].getCommand().~ICommand();
+        delete [] _slots;
+    }
+
+    bool isEmpty() const { return _size == 0; }
+    size_t getSize() const { return _size; }
+
+    void push( const co::ICommand& command )
+    {
+        if( _bounded )
+        {
+            while( !_pushRing( command ))
+                if( _waitNotFull( command ))
+                    break;
+        }
+        else if( _nSpilled > 0 || !_pushRing( command ))
+        {
+            lunchbox::ScopedWrite mutex( _lock );
+            ++_size;
+            _spilled.push_back( command );
+            ++_nSpilled;
+        }
+        _signal();
+    }
+
+    void pushFront( const co::ICommand& command )
+    {
+        {
+            lunchbox::ScopedWrite mutex( _lock );
+            ++_size;
+            _front.push_front( command );
+            ++_nFront;
+        }
+        _signal();
+    }
 
-    /** Thread-safe buffer queue. */
-    lunchbox::MTQueue< co::ICommand > commands;
+    /** @return false on timeout. */
+    bool pop( const uint32_t timeout, co::ICommand& command )
+    {
+        if( !_waitNotEmpty( timeout ))
+            return false;
+
+        while( !tryPop( command ))
+            lunchbox::Thread::yield(); // a producer is filling the next slot
+        return true;
+    }
+
+    /** @return false if no command is available. */
+    bool tryPop( co::ICommand& command )
+    {
+        if( _nFront > 0 )
+        {
+            lunchbox::ScopedWrite mutex( _lock );
+            if( !_front.empty( ))
+            {
+                command = _front.front();
+                _front.pop_front();
+                --_nFront;
+                _popped();
+                return true;
+            }
+        }
+
+        Slot& slot = _slots[ _tail & ( _capacity - 1 )];
+        if( slot.sequence.load( std::memory_order_acquire ) == _tail + 1 )
+        {
+            co::ICommand& slotCommand = slot.getCommand();
+            command = slotCommand;
+            slotCommand.clear();
+            slot.sequence.store( _tail + _capacity, std::memory_order_release );
+            ++_tail;
+            _popped();
+            return true;
+        }
+
+        // spilled commands are younger than any command still in the ring
+        if( _nSpilled > 0 && _head.load() == _tail )
+        {
+            lunchbox::ScopedWrite mutex( _lock );
+            LBASSERT( !_spilled.empty( ));
+            command = _spilled.front();
+            _spilled.pop_front();
+            --_nSpilled;
+            _popped();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    /**
+     * A ring slot. The command is constructed on first use and reused
+     * afterwards, to not allocate all commands of the ring up front.
+     */
+    struct Slot
+    {
+        std::atomic< size_t > sequence;
+        bool constructed; //!< owned by the current owner of the slot
+        std::aligned_storage< sizeof( co::ICommand ),
+                              alignof( co::ICommand ) >::type storage;
+
+        co::ICommand& getCommand()
+            { return *reinterpret_cast< co::ICommand* >( &storage ); }
+
+        void setCommand( const co::ICommand& command )
+        {
+            if( constructed )
+                getCommand() = command;
+            else
+            {
+                new( &storage ) co::ICommand( command );
+                constructed = true;
+            }
+        }
+    };
+
+    const bool _bounded;
+    const size_t _capacity; //!< power of two
+    Slot* const _slots;
+    std::atomic< size_t > _head; //!< next slot to claim by producers
+    size_t _tail; //!< next slot to consume, consumer only
+
+    std::atomic< size_t > _size; //!< queued, including in-flight commands
+    std::atomic< size_t > _nSpilled;
+    std::atomic< size_t > _nFront;
+
+    lunchbox::Lock _lock; //!< protects _spilled and _front
+    std::deque< co::ICommand > _spilled;
+    std::deque< co::ICommand > _front;
+
+    Futex _notEmpty; //!< consumer parking
+    std::atomic< bool > _waiting;
+    Futex _notFull; //!< producer parking in bounded mode
+    std::atomic< size_t > _nWaitingProducers;
+
+    static size_t _getCapacity( const size_t size )
+    {
+        size_t capacity = 2;
+        while( capacity < size )
+            capacity <<= 1;
+        return capacity;
+    }
+
+    /** @return false if the ring is full. */
+    bool _pushRing( const co::ICommand& command )
+    {
+        size_t pos = _head.load( std::memory_order_relaxed );
+        for( ;; )
+        {
+            Slot& slot = _slots[ pos & ( _capacity - 1 )];
+            const size_t sequence = slot.sequence.load(
+                std::memory_order_acquire );
+            const int64_t diff = int64_t( sequence ) - int64_t( pos );
+
+            if( diff == 0 )
+            {
+                if( _head.compare_exchange_weak( pos, pos + 1,
+                                                 std::memory_order_relaxed ))
+                {
+                    // count before publishing, the consumer spins on claimed
+                    // but not yet published slots
+                    ++_size;
+                    slot.setCommand( command );
+                    slot.sequence.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( diff < 0 )
+                return false;
+            else
+                pos = _head.load( std::memory_order_relaxed );
+        }
+    }
+
+    /**
+     * Park a producer until the consumer frees a slot.
+     * @return true if the command was pushed meanwhile.
+     */
+    bool _waitNotFull( const co::ICommand& command )
+    {
+        const uint32_t value = _notFull.value;
+        ++_nWaitingProducers;
+        const bool pushed = _pushRing( command );
+        if( !pushed )
+            _notFull.wait( value, LB_TIMEOUT_INDEFINITE );
+        --_nWaitingProducers;
+        return pushed;
+    }
+
+    /** Wake up the consumer after publishing a command. */
+    void _signal()
+    {
+        if( _waiting && _waiting.exchange( false ))
+            _notEmpty.wake( 1 );
+    }
+
+    void _popped()
+    {
+        --_size; // sequentially consistent, orders against waiting producers
+        if( _nWaitingProducers > 0 ) // one slot was freed
+            _notFull.wake( 1 );
+    }
+
+    /** @return false on timeout. */
+    bool _waitNotEmpty( const uint32_t timeout )
+    {
+        for( size_t i = 0; i < _nSpins; ++i )
+            if( _size > 0 )
+                return true;
+
+        lunchbox::Clock clock;
+        while( _size == 0 )
+        {
+            uint32_t wait = LB_TIMEOUT_INDEFINITE;
+            if( timeout != LB_TIMEOUT_INDEFINITE )
+            {
+                const int64_t elapsed = clock.getTime64();
+                if( elapsed >= int64_t( timeout ))
+                    return false;
+                wait = timeout - uint32_t( elapsed );
+            }
+
+            const uint32_t value = _notEmpty.value;
+            _waiting = true;
+            if( _size == 0 )
+                _notEmpty.wait( value, wait );
+            _waiting = false;
+        }
+        return true;
+    }
 };
 }
 
@@ -56,28 +404,30 @@ void CommandQueue::flush()
     if( !isEmpty( ))
         LBLOG( LOG_BUG ) << "Flushing non-empty command queue" << std::endl;
 
-    _impl->commands.clear();
+    ICommand command;
+    while( !isEmpty( ))
+        _impl->pop( LB_TIMEOUT_INDEFINITE, command );
 }
 
 bool CommandQueue::isEmpty() const
 {
-    return _impl->commands.isEmpty();
+    return _impl->isEmpty();
 }
 
 size_t CommandQueue::getSize() const
 {
-    return _impl->commands.getSize();
+    return _impl->getSize();
 }
 
 void CommandQueue::push( const ICommand& command )
 {
-    _impl->commands.push( command );
+    _impl->push( command );
 }
 
 void CommandQueue::pushFront( const ICommand& command )
 {
     LBASSERT( command.isValid( ));
-    _impl->commands.pushFront( command );
+    _impl->pushFront( command );
 }
 
 ICommand CommandQueue::pop( const uint32_t timeout )
@@ -85,20 +435,28 @@ ICommand CommandQueue::pop( const uint32_t timeout )
     LB_TS_THREAD( _thread );
 
     ICommand command;
-    _impl->commands.timedPop( timeout, command );
+    _impl->pop( timeout, command );
     return command;
 }
 
 ICommands CommandQueue::popAll( const uint32_t timeout )
 {
-    return _impl->commands.timedPopRange( timeout );
+    ICommands commands;
+    ICommand command;
+    if( !_impl->pop( timeout, command ))
+        return commands;
+
+    commands.push_back( command );
+    while( _impl->tryPop( command ))
+        commands.push_back( command );
+    return commands;
 }
 
 ICommand CommandQueue::tryPop()
 {
     LB_TS_THREAD( _thread );
     ICommand command;
-    _impl->commands.tryPop( command );
+    _impl->tryPop( command );
     return command;
 }
 
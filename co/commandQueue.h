@@ -29,14 +29,20 @@ namespace co
 {
 namespace detail { class CommandQueue; }
 
-/** A thread-safe, blocking queue for ICommand buffers. */
+/**
+ * A thread-safe, blocking queue for ICommand buffers.
+ *
+ * Commands may be pushed from any thread, but only one thread may pop them.
+ * Pushing and popping is lock-free, an idle consumer parks on a futex.
+ */
 class CommandQueue : public boost::noncopyable
 {
 public:
     /**
      * Construct a new command queue.
      *
-     * @param maxSize the maximum number of enqueued commands.
+     * @param maxSize the maximum number of enqueued commands, rounded up to a
+     *                power of two. Producers block while the queue is full.
      * @version 1.0
      */
     CO_API explicit CommandQueue( const size_t maxSize = ULONG_MAX );
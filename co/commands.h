@@ -49,6 +49,14 @@ enum Commands
 /** @internal Minimal packet size sent by DataOStream / read by LocalNode */
 static const size_t COMMAND_MINSIZE = 256;
 
+/** @internal Command framing on a connection, negotiated during connect. */
+enum CommandFraming
+{
+    FRAMING_PADDED = 0, //!< Commands are padded to COMMAND_MINSIZE
+    FRAMING_EXACT = 1, //!< Commands are sent with their exact size
+    FRAMING_CURRENT = FRAMING_EXACT //!< The framing supported by this version
+};
+
 /** @internal Minimal allocation size of a packet. */
 static const size_t COMMAND_ALLOCSIZE = 4096; // Bigger than minSize!
 }
@@ -0,0 +1,766 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "compressedConnection.h"
+
+#include "connectionDescription.h"
+#include "exception.h"
+#include "global.h"
+
+#include <lunchbox/buffer.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/log.h>
+#include <lunchbox/os.h>
+#include <pression/compressor.h>
+#include <pression/compressorResult.h>
+#include <pression/decompressor.h>
+#include <pression/plugins/compressor.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace co
+{
+namespace
+{
+static const uint32_t COMPRESSION_MAGIC = 0xC0C0DEC5u;
+static const uint32_t MAX_CHUNKS = 1024;
+static const float MAX_RATIO = .9f; // average compressed to raw size
+static const uint32_t MAX_SKIP = 256; // sends skipped after bad compression
+static const int HELLO_TIMEOUT = 1000; // ms, sent right after connecting
+
+/** Exchanged after connecting, carries the requested or agreed compressor. */
+struct Hello
+{
+    uint32_t magic;
+    uint32_t compressor;
+};
+
+/**
+ * Precedes each send. Uncompressed data follows directly, compressed data as
+ * the size and data of each chunk.
+ */
+struct FrameHeader
+{
+    uint64_t size; //!< uncompressed size
+    uint32_t compressor; //!< EQ_COMPRESSOR_NONE for uncompressed data
+    uint32_t nChunks; //!< number of compressed chunks
+};
+}
+
+namespace detail
+{
+class CompressedConnection
+{
+public:
+    CompressedConnection()
+        : name( EQ_COMPRESSOR_NONE )
+        , ratio( 0.f )
+        , skip( 0 )
+        , backoff( 1 )
+        , rawLeft( 0 )
+        , part( PART_HEADER )
+        , chunk( 0 )
+        , received( 0 )
+        , decodedPos( 0 )
+        , epollFD( ::epoll_create1( EPOLL_CLOEXEC ))
+        , eventFD( ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ))
+        , pending( false )
+    {
+        if( epollFD < 0 || eventFD < 0 || !addNotifier( eventFD ))
+            LBERROR << "Can't create notifier: " << lunchbox::sysError
+                    << std::endl;
+    }
+
+    ~CompressedConnection()
+    {
+        if( epollFD >= 0 )
+            ::close( epollFD );
+        if( eventFD >= 0 )
+            ::close( eventFD );
+    }
+
+    bool addNotifier( const int fd )
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return ::epoll_ctl( epollFD, EPOLL_CTL_ADD, fd, &event ) == 0;
+    }
+
+    void removeNotifier( const int fd )
+    {
+        struct epoll_event event; // non-null for kernels before 2.6.9
+        ::epoll_ctl( epollFD, EPOLL_CTL_DEL, fd, &event );
+    }
+
+    /** Signal decompressed data not visible on the stream's notifier. */
+    void setPending( const bool value )
+    {
+        if( value == pending )
+            return;
+
+        pending = value;
+        uint64_t count = 1;
+        if( value )
+        {
+            if( ::write( eventFD, &count, sizeof( count )) != sizeof( count ))
+                LBWARN << "eventfd write failed: " << lunchbox::sysError
+                       << std::endl;
+        }
+        else if( ::read( eventFD, &count, sizeof( count )) < 0 &&
+                 errno != EAGAIN )
+        {
+            LBWARN << "eventfd read failed: " << lunchbox::sysError
+                   << std::endl;
+        }
+    }
+
+    /** @return true if the stream has data to read without blocking. */
+    bool hasData() const
+    {
+        struct pollfd fds[1];
+        fds[0].fd = stream->getNotifier();
+        fds[0].events = POLLIN;
+        return ::poll( fds, 1, 0 ) > 0;
+    }
+
+    void resetRead()
+    {
+        rawLeft = 0;
+        part = PART_HEADER;
+        chunk = 0;
+        received = 0;
+        decoded.setSize( 0 );
+        decodedPos = 0;
+        setPending( false );
+    }
+
+    ConnectionPtr stream; //!< carries the framed data
+    ConnectionPtr listener;
+    uint32_t name; //!< agreed compressor, EQ_COMPRESSOR_NONE if none
+
+    pression::Compressor compressor;
+    pression::Decompressor decompressor;
+    lunchbox::Bufferb gathered; //!< contiguous copy of multi-chunk sends
+    float ratio; //!< running average of compressed to raw size, 0 if unknown
+    uint32_t skip; //!< number of sends to leave uncompressed
+    uint32_t backoff; //!< next skip count for badly compressed data
+
+    uint64_t rawLeft; //!< unread bytes of the current uncompressed frame
+
+    /** The part of a compressed frame being received. */
+    enum Part
+    {
+        PART_HEADER,
+        PART_CHUNK_SIZE,
+        PART_CHUNK
+    };
+    Part part;
+    FrameHeader header; //!< of the frame being received
+    uint32_t chunk; //!< index of the chunk being received
+    uint64_t chunkSizes[ MAX_CHUNKS ]; //!< of the frame being received
+    uint64_t received; //!< bytes of the current part received so far
+    lunchbox::Bufferb compressed; //!< the current compressed frame
+    lunchbox::Bufferb decoded; //!< the current decompressed frame
+    uint64_t decodedPos; //!< read position in decoded
+
+    int epollFD; //!< the notifier, combining the stream and eventFD
+    int eventFD; //!< set while decompressed data is pending
+    bool pending; //!< eventFD is set
+};
+}
+
+CompressedConnection::CompressedConnection( const ConnectionType type )
+    : _impl( new detail::CompressedConnection )
+{
+    ConnectionDescriptionPtr description = _getDescription();
+    description->type = type;
+    description->bandwidth = 102400;
+}
+
+CompressedConnection::~CompressedConnection()
+{
+    _close();
+    delete _impl;
+}
+
+bool CompressedConnection::isRequested(
+    const ConnectionDescription& description )
+{
+    if( description.compressor <= EQ_COMPRESSOR_NONE )
+        return false;
+
+    switch( description.type )
+    {
+        case CONNECTIONTYPE_TCPIP:
+        case CONNECTIONTYPE_SDP:
+        case CONNECTIONTYPE_UNIX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+ConnectionPtr CompressedConnection::_createStream() const
+{
+    std::string data = getDescription()->toString();
+    ConnectionDescriptionPtr description = new ConnectionDescription( data );
+    description->compressor = EQ_COMPRESSOR_NONE;
+    return Connection::create( description );
+}
+
+bool CompressedConnection::_setStream( ConnectionPtr stream,
+                                       const uint32_t name )
+{
+    detail::CompressedConnection& impl = *_impl;
+    if( name != EQ_COMPRESSOR_NONE )
+    {
+        pression::PluginRegistry& registry = Global::getPluginRegistry();
+        if( !impl.compressor.setup( registry, name ) ||
+            !impl.decompressor.setup( registry, name ))
+        {
+            LBINFO << "Compressor 0x" << std::hex << name << std::dec
+                   << " not available" << std::endl;
+            return false;
+        }
+    }
+
+    if( !impl.addNotifier( stream->getNotifier( )))
+    {
+        LBWARN << "Can't add stream notifier: " << lunchbox::sysError
+               << std::endl;
+        return false;
+    }
+
+    impl.stream = stream;
+    impl.name = name;
+    impl.ratio = 0.f;
+    impl.skip = 0;
+    impl.backoff = 1;
+    impl.resetRead();
+    return true;
+}
+
+bool CompressedConnection::connect()
+{
+    if( !isClosed( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    uint32_t name = getDescription()->compressor;
+    if( name == EQ_COMPRESSOR_AUTO )
+        name = pression::Compressor::choose( Global::getPluginRegistry(),
+                                             EQ_COMPRESSOR_DATATYPE_BYTE, 1.f,
+                                             false );
+
+    ConnectionPtr stream = _createStream();
+    Hello hello = { COMPRESSION_MAGIC, name };
+    if( !stream || !stream->connect() ||
+        !stream->send( &hello, sizeof( hello )) ||
+        !_readAll( stream, &hello, sizeof( hello )) ||
+        hello.magic != COMPRESSION_MAGIC ||
+        ( hello.compressor != name &&
+          hello.compressor != EQ_COMPRESSOR_NONE ) ||
+        !_setStream( stream, hello.compressor ))
+    {
+        LBDEBUG << "Could not connect compressed "
+                << getDescription()->toString() << std::endl;
+        if( stream )
+            stream->close();
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    LBDEBUG << "Connected using compressor 0x" << std::hex << hello.compressor
+            << std::dec << std::endl;
+    _setState( STATE_CONNECTED );
+    return true;
+}
+
+bool CompressedConnection::listen()
+{
+    if( !isClosed( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    ConnectionPtr listener = _createStream();
+    if( !listener || !listener->listen( ))
+    {
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    _getDescription()->port = listener->getDescription()->port;
+    _impl->listener = listener;
+    _setState( STATE_LISTENING );
+    return true;
+}
+
+void CompressedConnection::_close()
+{
+    if( isClosed( ))
+        return;
+
+    _setState( STATE_CLOSING );
+    detail::CompressedConnection& impl = *_impl;
+    if( impl.listener )
+    {
+        impl.listener->close();
+        impl.listener = 0;
+    }
+    if( impl.stream )
+    {
+        impl.removeNotifier( impl.stream->getNotifier( ));
+        impl.stream->close();
+        impl.stream = 0;
+    }
+    impl.resetRead();
+    _setState( STATE_CLOSED );
+}
+
+void CompressedConnection::acceptNB()
+{
+    if( _impl->listener )
+        _impl->listener->acceptNB();
+}
+
+ConnectionPtr CompressedConnection::acceptSync()
+{
+    if( !isListening( ))
+        return 0;
+
+    ConnectionPtr stream = _impl->listener->acceptSync();
+    if( !stream )
+        return 0;
+
+    Hello hello;
+    if( !_readHandshake( stream, &hello, sizeof( hello )) ||
+        hello.magic != COMPRESSION_MAGIC )
+    {
+        LBWARN << "Invalid handshake on compressed connection from "
+               << stream->getDescription()->toString() << std::endl;
+        stream->close();
+        return 0;
+    }
+
+    CompressedConnection* connection =
+        new CompressedConnection( getDescription()->type );
+    ConnectionPtr result( connection ); // to keep ref-counting correct
+
+    // agree on the requested compressor, or send uncompressed without it
+    if( !connection->_setStream( stream, hello.compressor ) &&
+        !connection->_setStream( stream, EQ_COMPRESSOR_NONE ))
+    {
+        stream->close();
+        return 0;
+    }
+
+    hello.compressor = connection->_impl->name;
+    if( !stream->send( &hello, sizeof( hello )))
+    {
+        stream->close();
+        return 0;
+    }
+
+    std::string data = stream->getDescription()->toString();
+    ConnectionDescriptionPtr description = new ConnectionDescription( data );
+    description->compressor = getDescription()->compressor;
+    connection->_setDescription( description );
+    connection->_setState( STATE_CONNECTED );
+
+    LBDEBUG << "Accepted " << description->toString() << " using compressor 0x"
+            << std::hex << hello.compressor << std::dec << std::endl;
+    return result;
+}
+
+Connection::Notifier CompressedConnection::getNotifier() const
+{
+    if( _impl->listener )
+        return _impl->listener->getNotifier();
+    if( !_impl->stream )
+        return Notifier( -1 );
+    return _impl->epollFD;
+}
+
+bool CompressedConnection::handleError()
+{
+    return _impl->stream && _impl->stream->handleError();
+}
+
+void CompressedConnection::abortSends()
+{
+    if( _impl->stream )
+        _impl->stream->abortSends();
+}
+
+//----------------------------------------------------------------------
+// read
+//----------------------------------------------------------------------
+bool CompressedConnection::_readAll( ConnectionPtr stream, void* data,
+                                     const uint64_t bytes )
+{
+    uint8_t* ptr = static_cast< uint8_t* >( data );
+    uint64_t left = bytes;
+    try
+    {
+        while( left > 0 )
+        {
+            const int64_t read = stream->readSync( ptr, left, true );
+            if( read < 0 )
+                return false;
+            ptr += read;
+            left -= read;
+        }
+    }
+    catch( const co::Exception& e )
+    {
+        LBWARN << e.what() << " reading " << bytes << " bytes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CompressedConnection::_readHandshake( ConnectionPtr stream, void* data,
+                                           const uint64_t bytes )
+{
+    // a client not sending its hello may not block the accepting thread
+    uint8_t* ptr = static_cast< uint8_t* >( data );
+    uint64_t left = bytes;
+    lunchbox::Clock clock;
+    try
+    {
+        while( left > 0 )
+        {
+            const int64_t wait = HELLO_TIMEOUT - clock.getTime64();
+            struct pollfd fds[1];
+            fds[0].fd = stream->getNotifier();
+            fds[0].events = POLLIN;
+            if( wait <= 0 || ::poll( fds, 1, int( wait )) <= 0 )
+                return false;
+
+            const int64_t read = stream->readSync( ptr, left, false );
+            if( read < 0 )
+                return false;
+            ptr += read;
+            left -= read;
+        }
+    }
+    catch( const co::Exception& e )
+    {
+        LBWARN << e.what() << " reading the compression handshake"
+               << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int CompressedConnection::_receive( void* data, const uint64_t bytes,
+                                   const bool block )
+{
+    detail::CompressedConnection& impl = *_impl;
+    uint8_t* ptr = static_cast< uint8_t* >( data );
+    try
+    {
+        while( impl.received < bytes )
+        {
+            if( !block && !impl.hasData( ))
+                return 0;
+
+            const int64_t read = impl.stream->readSync( ptr + impl.received,
+                                                        bytes - impl.received,
+                                                        true );
+            if( read == READ_TIMEOUT )
+                return 0;
+            if( read < 0 )
+                return -1;
+            impl.received += read;
+        }
+    }
+    catch( const co::Exception& e )
+    {
+        LBWARN << e.what() << " reading " << bytes << " bytes" << std::endl;
+        return -1;
+    }
+    impl.received = 0;
+    return 1;
+}
+
+int CompressedConnection::_nextFrame( const bool block )
+{
+    detail::CompressedConnection& impl = *_impl;
+    FrameHeader& header = impl.header;
+    while( true )
+    {
+        switch( impl.part )
+        {
+        case detail::CompressedConnection::PART_HEADER:
+        {
+            const int result = _receive( &header, sizeof( header ), block );
+            if( result <= 0 )
+                return result;
+
+            if( header.size == 0 || header.size >= LB_BIT48 ||
+                header.nChunks > MAX_CHUNKS )
+            {
+                LBERROR << "Got invalid frame of " << header.size
+                        << " bytes in " << header.nChunks << " chunks"
+                        << std::endl;
+                return -1;
+            }
+
+            if( header.compressor == EQ_COMPRESSOR_NONE )
+            {
+                impl.rawLeft = header.size;
+                return 1;
+            }
+
+            if( header.compressor != impl.name || header.nChunks == 0 )
+            {
+                LBERROR << "Got frame using compressor 0x" << std::hex
+                        << header.compressor << ", expected 0x" << impl.name
+                        << std::dec << std::endl;
+                return -1;
+            }
+
+            impl.compressed.setSize( 0 );
+            impl.chunk = 0;
+            impl.part = detail::CompressedConnection::PART_CHUNK_SIZE;
+            break;
+        }
+
+        case detail::CompressedConnection::PART_CHUNK_SIZE:
+        {
+            uint64_t& size = impl.chunkSizes[ impl.chunk ];
+            const int result = _receive( &size, sizeof( size ), block );
+            if( result <= 0 )
+                return result;
+
+            if( size >= LB_BIT48 )
+            {
+                LBERROR << "Got invalid chunk of " << size << " bytes"
+                        << std::endl;
+                return -1;
+            }
+            impl.compressed.resize( impl.compressed.getSize() + size );
+            impl.part = detail::CompressedConnection::PART_CHUNK;
+            break;
+        }
+
+        case detail::CompressedConnection::PART_CHUNK:
+        {
+            const uint64_t size = impl.chunkSizes[ impl.chunk ];
+            const uint64_t offset = impl.compressed.getSize() - size;
+            const int result = _receive( impl.compressed.getData() + offset,
+                                         size, block );
+            if( result <= 0 )
+                return result;
+
+            if( ++impl.chunk < header.nChunks )
+            {
+                impl.part = detail::CompressedConnection::PART_CHUNK_SIZE;
+                break;
+            }
+
+            void** chunks = static_cast< void ** >(
+                                alloca( header.nChunks * sizeof( void* )));
+            uint8_t* data = impl.compressed.getData();
+            for( uint32_t i = 0; i < header.nChunks; ++i )
+            {
+                chunks[ i ] = data;
+                data += impl.chunkSizes[ i ];
+            }
+
+            uint64_t outDims[2] = { 0, header.size };
+            impl.decoded.reset( header.size );
+            impl.decompressor.decompress( chunks, impl.chunkSizes,
+                                          header.nChunks,
+                                          impl.decoded.getData(), outDims );
+            impl.decodedPos = 0;
+            impl.part = detail::CompressedConnection::PART_HEADER;
+            return 1;
+        }
+        }
+    }
+}
+
+int64_t CompressedConnection::readSync( void* buffer, const uint64_t bytes,
+                                        const bool block )
+{
+    detail::CompressedConnection& impl = *_impl;
+    if( !impl.stream )
+        return -1;
+
+    // frames are received incrementally, without blocking unless requested
+    if( impl.rawLeft == 0 && impl.decodedPos == impl.decoded.getSize( ))
+    {
+        const int result = _nextFrame( block );
+        if( result == 0 )
+            return READ_TIMEOUT;
+        if( result < 0 )
+        {
+            close();
+            return -1;
+        }
+    }
+
+    if( impl.rawLeft == 0 ) // decompressed frame
+    {
+        const uint64_t left = impl.decoded.getSize() - impl.decodedPos;
+        const uint64_t size = LB_MIN( bytes, left );
+        ::memcpy( buffer, impl.decoded.getData() + impl.decodedPos, size );
+        impl.decodedPos += size;
+        impl.setPending( impl.decodedPos < impl.decoded.getSize( ));
+        return size;
+    }
+
+    if( !block && !impl.hasData( ))
+        return READ_TIMEOUT;
+
+    const int64_t read = impl.stream->readSync( buffer,
+                                                LB_MIN( bytes, impl.rawLeft ),
+                                                block );
+    if( read == READ_TIMEOUT )
+        return read;
+    if( read < 0 )
+    {
+        close();
+        return -1;
+    }
+
+    impl.rawLeft -= read;
+    return read;
+}
+
+//----------------------------------------------------------------------
+// write
+//----------------------------------------------------------------------
+bool CompressedConnection::_compress( const Chunk* chunks, const size_t nChunks,
+                                      const uint64_t bytes )
+{
+    detail::CompressedConnection& impl = *_impl;
+    const uint64_t threshold = uint64_t(
+        Global::getIAttribute( Global::IATTR_CONNECTION_COMPRESSION ));
+    if( impl.name == EQ_COMPRESSOR_NONE || bytes <= threshold )
+        return false;
+
+    if( impl.skip > 0 )
+    {
+        --impl.skip;
+        return false;
+    }
+
+    // The plugin API uses non-const source buffers for in-place operations
+    void* data = const_cast< void* >( chunks[0].data );
+    if( nChunks > 1 )
+    {
+        impl.gathered.setSize( 0 );
+        for( size_t i = 0; i < nChunks; ++i )
+            impl.gathered.append( static_cast< const uint8_t* >(
+                                      chunks[i].data ), chunks[i].size );
+        data = impl.gathered.getData();
+    }
+
+    const uint64_t inDims[2] = { 0, bytes };
+    LB_TS_RESET( impl.compressor._thread ); // sends come from any thread
+    impl.compressor.compress( data, inDims );
+
+    const pression::CompressorResult& result = impl.compressor.getResult();
+    const uint64_t size = result.getSize() +
+                          result.chunks.size() * sizeof( uint64_t );
+    const float ratio = float( size ) / float( bytes );
+    impl.ratio = impl.ratio == 0.f ? ratio : .75f * impl.ratio + .25f * ratio;
+    if( impl.ratio <= MAX_RATIO )
+    {
+        impl.backoff = 1;
+        return size < bytes;
+    }
+
+    // incompressible data, leave exponentially more sends uncompressed
+    LBVERB << "Compression ratio " << impl.ratio << ", skipping "
+           << impl.backoff << " sends" << std::endl;
+    impl.skip = impl.backoff;
+    impl.backoff = LB_MIN( impl.backoff * 2, MAX_SKIP );
+    impl.ratio = 0.f; // reassess after skipping
+    return size < bytes;
+}
+
+int64_t CompressedConnection::write( const void* buffer, const uint64_t bytes )
+{
+    const Chunk chunk = { buffer, bytes };
+    return writev( &chunk, 1 );
+}
+
+int64_t CompressedConnection::writev( const Chunk* chunks,
+                                      const size_t nChunks )
+{
+    detail::CompressedConnection& impl = *_impl;
+    if( !isConnected() || !impl.stream )
+        return -1;
+
+    uint64_t bytes = 0;
+    for( size_t i = 0; i < nChunks; ++i )
+        bytes += chunks[i].size;
+    if( bytes == 0 )
+        return 0;
+
+    // the stream is only written under our send lock
+    if( _compress( chunks, nChunks, bytes ))
+    {
+        const pression::CompressorResult& result =
+            impl.compressor.getResult();
+        const size_t nResults = result.chunks.size();
+        const FrameHeader header = { bytes, impl.name, uint32_t( nResults )};
+
+        const size_t nFrame = 2 * nResults + 1;
+        Chunk* frame = static_cast< Chunk* >(
+            alloca( nFrame * sizeof( Chunk )));
+        uint64_t* sizes = static_cast< uint64_t* >(
+            alloca( nResults * sizeof( uint64_t )));
+        frame[0].data = &header;
+        frame[0].size = sizeof( header );
+        for( size_t i = 0; i < nResults; ++i )
+        {
+            sizes[i] = result.chunks[i].getNumBytes();
+            frame[ 2*i + 1 ].data = &sizes[i];
+            frame[ 2*i + 1 ].size = sizeof( uint64_t );
+            frame[ 2*i + 2 ].data = result.chunks[i].data;
+            frame[ 2*i + 2 ].size = sizes[i];
+        }
+        if( !impl.stream->send( frame, nFrame, true ))
+            return -1;
+        return bytes;
+    }
+
+    const FrameHeader header = { bytes, EQ_COMPRESSOR_NONE, 0 };
+    Chunk* frame = static_cast< Chunk* >(
+        alloca(( nChunks + 1 ) * sizeof( Chunk )));
+    frame[0].data = &header;
+    frame[0].size = sizeof( header );
+    ::memcpy( frame + 1, chunks, nChunks * sizeof( Chunk ));
+    if( !impl.stream->send( frame, nChunks + 1, true ))
+        return -1;
+    return bytes;
+}
+
+}
@@ -0,0 +1,86 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CO_COMPRESSEDCONNECTION_H
+#define CO_COMPRESSEDCONNECTION_H
+
+#include <co/connection.h> // base class
+
+namespace co
+{
+namespace detail { class CompressedConnection; }
+
+/**
+ * A connection compressing its byte stream with a pression compressor.
+ *
+ * Created for stream connection descriptions with a compressor. The data is
+ * sent over a connection of the same type. After connecting, both sides agree
+ * on the compressor, or on sending uncompressed when the accepting side does
+ * not have the requested compressor.
+ *
+ * Each send is framed by a header with its compressor and size. Sends smaller
+ * than IATTR_CONNECTION_COMPRESSION, and all sends for a while after sends
+ * compressed badly, are sent uncompressed and without a copy.
+ */
+class CompressedConnection : public Connection
+{
+public:
+    /** Construct a new compressed connection of the given type. */
+    explicit CompressedConnection( const ConnectionType type );
+
+    /** @return true if the description asks for a compressed connection. */
+    static bool isRequested( const ConnectionDescription& description );
+
+    bool connect() override;
+    bool listen() override;
+    void close() override { _close(); }
+
+    void acceptNB() override;
+    ConnectionPtr acceptSync() override;
+
+    Notifier getNotifier() const override;
+    bool handleError() override;
+    void abortSends() override;
+
+protected:
+    virtual ~CompressedConnection();
+
+    void readNB( void*, const uint64_t ) override { /* nop */ }
+    int64_t readSync( void* buffer, const uint64_t bytes,
+                      const bool block ) override;
+    int64_t write( const void* buffer, const uint64_t bytes ) override;
+    int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
+
+private:
+    detail::CompressedConnection* const _impl;
+
+    void _close();
+    ConnectionPtr _createStream() const;
+    bool _setStream( ConnectionPtr stream, const uint32_t compressor );
+    int _receive( void* data, const uint64_t bytes, const bool block );
+    int _nextFrame( const bool block );
+    bool _compress( const Chunk* chunks, const size_t nChunks,
+                    const uint64_t bytes );
+    static bool _readAll( ConnectionPtr stream, void* data,
+                          const uint64_t bytes );
+    static bool _readHandshake( ConnectionPtr stream, void* data,
+                                const uint64_t bytes );
+};
+}
+
+#endif //CO_COMPRESSEDCONNECTION_H
@@ -21,8 +21,11 @@
 #include "connection.h"
 
 #include "buffer.h"
+#include "bufferCache.h"
+#include "commands.h"
 #include "connectionDescription.h"
 #include "connectionListener.h"
+#include "global.h"
 #include "log.h"
 #include "pipeConnection.h"
 #include "socketConnection.h"
@@ -30,6 +33,8 @@
 
 #ifdef _WIN32
 #  include "namedPipeConnection.h"
+#else
+#  include "unixConnection.h"
 #endif
 
 #include <co/exception.h>
@@ -40,9 +45,25 @@
 #ifdef COLLAGE_USE_UDT
 #  include "udtConnection.h"
 #endif
+#ifdef __linux__
+#  include "compressedConnection.h"
+#  include "shmConnection.h"
+#  include "stripedConnection.h"
+#endif
 
+#include <lunchbox/atomic.h>
+#include <lunchbox/buffer.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/monitor.h>
+#include <lunchbox/mtQueue.h>
 #include <lunchbox/scopedMutex.h>
+#include <lunchbox/spinLock.h>
 #include <lunchbox/stdExt.h>
+#include <lunchbox/thread.h>
+
+#ifndef _WIN32
+#  include <signal.h>
+#endif
 
 //#define STATISTICS
 #ifdef STATISTICS
@@ -72,6 +93,75 @@ namespace co
 {
 namespace detail
 {
+class SendThread : public lunchbox::Thread
+{
+public:
+    explicit SendThread( co::Connection* connection )
+        : _connection( connection ) {}
+
+    bool init() override
+    {
+        setName( "Send" );
+#ifndef _WIN32
+        // writes after abortSends() fail with EPIPE instead of a signal
+        sigset_t signals;
+        sigemptyset( &signals );
+        sigaddset( &signals, SIGPIPE );
+        pthread_sigmask( SIG_BLOCK, &signals, 0 );
+#endif
+        return true;
+    }
+
+    void run() override { _connection->_runSendQueue(); }
+
+private:
+    co::Connection* const _connection;
+};
+
+/** The asynchronous sends of a connection, written by its I/O thread. */
+class SendQueue
+{
+public:
+    SendQueue( co::Connection* connection, const uint64_t budget_ )
+        : buffers( 8 )
+        , bytes( 0 )
+        , budget( budget_ )
+        , thread( connection )
+    {}
+
+    ~SendQueue() { stop(); }
+
+    BufferCache buffers; //!< Copies of the queued sends
+    lunchbox::MTQueue< BufferPtr > queue; //!< Queued sends, 0 to stop
+    lunchbox::Monitor< uint64_t > bytes; //!< Queued bytes not yet written
+    const uint64_t budget; //!< The maximum number of queued bytes
+    SendThread thread;
+
+    bool start()
+    {
+        if( !thread.isStopped( ))
+            thread.join();
+        queue.clear();
+        bytes = 0;
+        if( thread.start( ))
+            return true;
+        LBWARN << "Could not start send thread" << std::endl;
+        return false;
+    }
+
+    /**
+     * Stop the thread after the sends queued so far, which are only written
+     * while the connection is connected.
+     */
+    void stop()
+    {
+        if( thread.isRunning( ))
+            queue.push( BufferPtr( ));
+        if( !thread.isCurrent( ))
+            thread.join();
+    }
+};
+
 class Connection
 {
 public:
@@ -83,6 +173,18 @@ public:
 
     BufferPtr buffer; //!< Current async read buffer
     uint64_t bytes; //!< Current read request size
+    uint64_t minBytes; //!< Current minimum read size
+    /** CommandFraming used on this connection, set by the receiver thread */
+    lunchbox::a_int32_t framing;
+
+    lunchbox::Bufferb coalesced; //!< Buffered small sends, under sendLock
+    uint64_t coalesceSize; //!< Maximum size of coalesced, 0 if disabled
+    uint32_t coalesceTimeout; //!< Maximum age of coalesced data in ms
+    lunchbox::Clock coalesceClock; //!< Age of the coalesced data
+
+    SendQueue* sendQueue; //!< Asynchronous sends, 0 if disabled
+    lunchbox::SpinLock queueLock; //!< replacing sendQueue, vs. readers
+    ConstBufferPtr sendOwner; //!< of the big chunks of the current write
 
     /** The listeners on state changes */
     ConnectionListeners listeners;
@@ -91,6 +193,11 @@ public:
             : state( co::Connection::STATE_CLOSED )
             , description( new ConnectionDescription )
             , bytes( 0 )
+            , minBytes( 0 )
+            , framing( FRAMING_PADDED )
+            , coalesceSize( 0 )
+            , coalesceTimeout( 0 )
+            , sendQueue( 0 )
     {
         description->type = CONNECTIONTYPE_NONE;
     }
@@ -100,6 +207,7 @@ public:
         LBASSERT( state == co::Connection::STATE_CLOSED );
         state = co::Connection::STATE_CLOSED;
         description = 0;
+        delete sendQueue;
 
         LBASSERTINFO( !buffer,
                       "Pending read operation during connection destruction" );
@@ -113,6 +221,15 @@ public:
             (*i)->notifyStateChanged( connection );
         }
     }
+
+    void fireCoalesced( co::Connection* connection )
+    {
+        for( ConnectionListeners::const_iterator i= listeners.begin();
+             i != listeners.end(); ++i )
+        {
+            (*i)->notifyCoalesced( connection );
+        }
+    }
 };
 }
 
@@ -142,10 +259,23 @@ bool Connection::operator == ( const Connection& rhs ) const
 ConnectionPtr Connection::create( ConnectionDescriptionPtr description )
 {
     ConnectionPtr connection;
+#ifdef __linux__
+    if( CompressedConnection::isRequested( *description ))
+        connection = new CompressedConnection( description->type );
+    else
+#endif
     switch( description->type )
     {
         case CONNECTIONTYPE_TCPIP:
         case CONNECTIONTYPE_SDP:
+#ifdef __linux__ // needs epoll to notify data on any stream
+            if( description->type == CONNECTIONTYPE_TCPIP &&
+                description->streams > 1 )
+            {
+                connection = new StripedConnection;
+                break;
+            }
+#endif
             connection = new SocketConnection( description->type );
             break;
 
@@ -157,6 +287,10 @@ ConnectionPtr Connection::create( ConnectionDescriptionPtr description )
         case CONNECTIONTYPE_NAMEDPIPE:
             connection = new NamedPipeConnection;
             break;
+#else
+        case CONNECTIONTYPE_UNIX:
+            connection = new UnixConnection;
+            break;
 #endif
 
         case CONNECTIONTYPE_RSP:
@@ -173,6 +307,11 @@ ConnectionPtr Connection::create( ConnectionDescriptionPtr description )
             connection = new UDTConnection;
             break;
 #endif
+#ifdef __linux__
+        case CONNECTIONTYPE_SHM:
+            connection = new ShmConnection;
+            break;
+#endif
 
         default:
             LBWARN << "Connection type " << description->type
@@ -206,6 +345,15 @@ void Connection::_setState( const State state )
     if( _impl->state == state )
         return;
     _impl->state = state;
+
+    // Stop the send thread before the subclass closes the file descriptor it
+    // might write to. Its current write would block until the timeout.
+    if( _impl->sendQueue &&
+        ( state == STATE_CLOSING || state == STATE_CLOSED ))
+    {
+        abortSends();
+        _impl->sendQueue->stop();
+    }
     _impl->fireStateChanged( this );
 }
 
@@ -219,6 +367,89 @@ void Connection::unlockSend() const
     _impl->sendLock.unset();
 }
 
+void Connection::setSendCoalescing( const uint64_t size,
+                                    const uint32_t timeout )
+{
+    lunchbox::ScopedMutex<> mutex( _impl->sendLock );
+    _flushCoalesced();
+    _impl->coalesceSize = size;
+    _impl->coalesceTimeout = timeout;
+    _impl->coalesced.clear();
+    if( size > 0 )
+        _impl->coalesced.reserve( size );
+}
+
+bool Connection::flush()
+{
+    lunchbox::ScopedMutex<> mutex( _impl->sendLock );
+    if( !_flushCoalesced( ))
+        return false;
+
+    detail::SendQueue* sendQueue = _impl->sendQueue;
+    if( sendQueue && !sendQueue->bytes.timedWaitEQ( 0, Global::getTimeout( )))
+    {
+        LBWARN << "Timeout while flushing send queue of " << *this
+               << std::endl;
+        return false;
+    }
+    finish();
+    return isConnected();
+}
+
+bool Connection::flushCoalesced()
+{
+    lunchbox::ScopedMutex<> mutex( _impl->sendLock );
+    if( _impl->coalesced.isEmpty( ))
+        return true;
+    if( !_flushCoalesced( ))
+        return false;
+    if( !_impl->sendQueue )
+        finish(); // the send queue thread finishes once drained
+    return true;
+}
+
+void Connection::setSendQueue( const uint64_t budget )
+{
+    lunchbox::ScopedMutex<> mutex( _impl->sendLock );
+    detail::SendQueue* sendQueue = _impl->sendQueue;
+    if( sendQueue )
+    {
+        sendQueue->stop(); // writes all queued data
+        {
+            lunchbox::ScopedFastWrite queueMutex( _impl->queueLock );
+            _impl->sendQueue = 0;
+        }
+        delete sendQueue;
+    }
+
+    if( budget == 0 )
+        return;
+
+    sendQueue = new detail::SendQueue( this, budget );
+    lunchbox::ScopedFastWrite queueMutex( _impl->queueLock );
+    _impl->sendQueue = sendQueue;
+}
+
+uint64_t Connection::getSendQueueSize() const
+{
+    // not the send lock, which is held by senders blocked on a full queue
+    lunchbox::ScopedFastRead mutex( _impl->queueLock );
+    const detail::SendQueue* sendQueue = _impl->sendQueue;
+    return sendQueue ? sendQueue->bytes.get() : 0;
+}
+
+bool Connection::_flushCoalesced()
+{
+    lunchbox::Bufferb& coalesced = _impl->coalesced;
+    if( coalesced.isEmpty( ))
+        return true;
+
+    const Chunk chunk = { coalesced.getData(), coalesced.getSize() };
+    const bool result = _write( &chunk, 1, chunk.size, ConstBufferPtr( ));
+    coalesced.setSize( 0 );
+    return result;
+}
+
 void Connection::addListener( ConnectionListener* listener )
 {
     _impl->listeners.push_back( listener );
@@ -236,18 +467,26 @@ void Connection::removeListener( ConnectionListener* listener )
 // read
 //----------------------------------------------------------------------
 void Connection::recvNB( BufferPtr buffer, const uint64_t bytes )
+{
+    recvNB( buffer, bytes, bytes );
+}
+
+void Connection::recvNB( BufferPtr buffer, const uint64_t minBytes,
+                         const uint64_t maxBytes )
 {
     LBASSERT( !_impl->buffer );
     LBASSERT( _impl->bytes == 0 );
     LBASSERT( buffer );
-    LBASSERT( bytes > 0 );
-    LBASSERTINFO( bytes < LB_BIT48,
-                  "Out-of-sync network stream: read size " << bytes << "?" );
+    LBASSERT( minBytes > 0 );
+    LBASSERT( minBytes <= maxBytes );
+    LBASSERTINFO( maxBytes < LB_BIT48,
+                  "Out-of-sync network stream: read size " << maxBytes << "?" );
 
     _impl->buffer = buffer;
-    _impl->bytes = bytes;
-    buffer->reserve( buffer->getSize() + bytes );
-    readNB( buffer->getData() + buffer->getSize(), bytes );
+    _impl->bytes = maxBytes;
+    _impl->minBytes = minBytes;
+    buffer->reserve( buffer->getSize() + maxBytes );
+    readNB( buffer->getData() + buffer->getSize(), maxBytes );
 }
 
 bool Connection::recvSync( BufferPtr& outBuffer, const bool block )
@@ -258,14 +497,26 @@ bool Connection::recvSync( BufferPtr& outBuffer, const bool block )
     // reset async IO data
     outBuffer = _impl->buffer;
     const uint64_t bytes = _impl->bytes;
+    const uint64_t minBytes = _impl->minBytes;
     _impl->buffer = 0;
     _impl->bytes = 0;
+    _impl->minBytes = 0;
 
     if( _impl->state != STATE_CONNECTED || !outBuffer || bytes == 0 )
         return false;
     LBASSERTINFO( bytes < LB_BIT48,
                   "Out-of-sync network stream: read size " << bytes << "?" );
 
+    if( outBuffer->isEmpty( ))
+    {
+        BufferPtr buffer = readBuffer( minBytes, bytes );
+        if( buffer )
+        {
+            outBuffer = buffer;
+            return true;
+        }
+    }
+
     // 'Iterators' for receive loop
     uint8_t* ptr = outBuffer->getData() + outBuffer->getSize();
     uint64_t bytesLeft = bytes;
@@ -280,6 +531,7 @@ bool Connection::recvSync( BufferPtr& outBuffer, const bool block )
     {
         _impl->buffer = outBuffer;
         _impl->bytes = bytes;
+        _impl->minBytes = minBytes;
         outBuffer = 0;
         return true;
     }
@@ -306,26 +558,26 @@ bool Connection::recvSync( BufferPtr& outBuffer, const bool block )
                 return false;
             LBVERB << "Zero bytes read" << std::endl;
         }
-        if( bytesLeft > static_cast< uint64_t >( got )) // partial read
-        {
-            ptr += got;
-            bytesLeft -= got;
+        LBASSERTINFO( static_cast< uint64_t >( got ) <= bytesLeft,
+                      got << " > " << bytesLeft );
+        ptr += got;
+        bytesLeft -= got;
 
+        const uint64_t read = bytes - bytesLeft;
+        if( read < minBytes ) // partial read
+        {
             readNB( ptr, bytesLeft );
             got = readSync( ptr, bytesLeft, true );
             continue;
         }
 
         // read done
-        LBASSERTINFO( static_cast< uint64_t >( got ) == bytesLeft,
-                      got << " != " << bytesLeft );
-
-        outBuffer->resize( outBuffer->getSize() + bytes );
+        outBuffer->resize( outBuffer->getSize() + read );
 #ifndef NDEBUG
-        if( bytes <= 1024 && ( lunchbox::Log::topics & LOG_PACKETS ))
+        if( read <= 1024 && ( lunchbox::Log::topics & LOG_PACKETS ))
         {
-            ptr -= (bytes - bytesLeft); // rewind
-            LBINFO << "recv:" << lunchbox::format( ptr, bytes ) << std::endl;
+            ptr -= read; // rewind
+            LBINFO << "recv:" << lunchbox::format( ptr, read ) << std::endl;
         }
 #endif
         return true;
@@ -335,11 +587,17 @@ bool Connection::recvSync( BufferPtr& outBuffer, const bool block )
     return true;
 }
 
+BufferPtr Connection::readBuffer( const uint64_t, const uint64_t )
+{
+    return BufferPtr();
+}
+
 BufferPtr Connection::resetRecvData()
 {
     BufferPtr buffer = _impl->buffer;
     _impl->buffer = 0;
     _impl->bytes = 0;
+    _impl->minBytes = 0;
     return buffer;
 }
 
@@ -349,31 +607,221 @@ BufferPtr Connection::resetRecvData()
 bool Connection::send( const void* buffer, const uint64_t bytes,
                        const bool isLocked )
 {
-    ADD_STATISTIC( bytes );
     LBASSERT( bytes > 0 );
+    const Chunk chunk = { buffer, bytes };
+    return send( &chunk, 1, isLocked );
+}
+
+bool Connection::send( const Chunk* chunks, const size_t nChunks,
+                       const bool isLocked )
+{
+    return send( chunks, nChunks, ConstBufferPtr(), isLocked );
+}
+
+bool Connection::send( const Chunk* chunks, const size_t nChunks,
+                       const ConstBufferPtr& owner, const bool isLocked )
+{
+    uint64_t bytes = 0;
+    for( size_t i = 0; i < nChunks; ++i )
+        bytes += chunks[i].size;
+
+    ADD_STATISTIC( bytes );
     if( bytes == 0 )
         return true;
 
-    const uint8_t* ptr = static_cast< const uint8_t* >( buffer );
-
     // possible OPT: We need to lock here to guarantee an atomic transmission of
     // the buffer. Possible improvements are:
     // 1) Disassemble buffer into 'small enough' pieces and use a header to
     //    reassemble correctly on the other side (aka reliable UDP)
-    // 2) Introduce a send thread with a thread-safe task queue
+    // 2) Enqueue the data for a send thread, see setSendQueue()
     lunchbox::ScopedMutex<> mutex( isLocked ? 0 : &_impl->sendLock );
 
 #ifndef NDEBUG
-    if( bytes <= 1024 && ( lunchbox::Log::topics & LOG_PACKETS ))
-        LBINFO << "send:" << lunchbox::format( ptr, bytes ) << std::endl;
+    if( lunchbox::Log::topics & LOG_PACKETS )
+        for( size_t i = 0; i < nChunks; ++i )
+            if( chunks[i].size <= 1024 )
+                LBINFO << "send:" << lunchbox::format(
+                    static_cast< const uint8_t* >( chunks[i].data ),
+                    chunks[i].size ) << std::endl;
 #endif
 
+    lunchbox::Bufferb& coalesced = _impl->coalesced;
+    if( _impl->coalesceSize > 0 )
+    {
+        if( !isLocked && bytes < _impl->coalesceSize )
+        {
+            if( coalesced.getSize() + bytes > _impl->coalesceSize &&
+                !_flushCoalesced( ))
+            {
+                return false;
+            }
+
+            const bool wasEmpty = coalesced.isEmpty();
+            if( wasEmpty )
+                _impl->coalesceClock.reset();
+            for( size_t i = 0; i < nChunks; ++i )
+                coalesced.append( static_cast< const uint8_t* >(
+                                      chunks[i].data ), chunks[i].size );
+
+            if( coalesced.getSize() == _impl->coalesceSize ||
+                ( _impl->coalesceTimeout > 0 &&
+                  _impl->coalesceClock.getTime64() >=
+                      int64_t( _impl->coalesceTimeout )))
+            {
+                return _flushCoalesced();
+            }
+            if( wasEmpty )
+                _impl->fireCoalesced( this );
+            return true;
+        }
+
+        if( !coalesced.isEmpty( ) && owner )
+        {
+            // the coalesced data has to be copied, unlike the owned chunks
+            if( !_flushCoalesced( ))
+                return false;
+        }
+        else if( !coalesced.isEmpty( ))
+        {
+            // write the buffered sends first, along with this send
+            Chunk* all = static_cast< Chunk* >(
+                alloca(( nChunks + 1 ) * sizeof( Chunk )));
+            all[0].data = coalesced.getData();
+            all[0].size = coalesced.getSize();
+            ::memcpy( all + 1, chunks, nChunks * sizeof( Chunk ));
+
+            const bool result = _write( all, nChunks + 1, bytes + all[0].size,
+                                        ConstBufferPtr( ));
+            coalesced.setSize( 0 );
+            return result;
+        }
+    }
+    return _write( chunks, nChunks, bytes, owner );
+}
+
+bool Connection::_write( const Chunk* chunks, const size_t nChunks,
+                         const uint64_t bytes, const ConstBufferPtr& owner )
+{
+    if( !_impl->sendQueue )
+        return _writeSync( chunks, nChunks, bytes, owner );
+
+    // queued sends are copied, big sends are written directly by the caller
+    if( bytes <= _impl->sendQueue->budget )
+        return _enqueue( chunks, nChunks, bytes );
+    if( !isConnected( ))
+        return false;
+
+    detail::SendQueue& sendQueue = *_impl->sendQueue;
+    if( !sendQueue.bytes.timedWaitEQ( 0, Global::getTimeout( )))
+    {
+        LBWARN << "Timeout while draining send queue of " << *this
+               << std::endl;
+        return false;
+    }
+    return _writeSync( chunks, nChunks, bytes, owner );
+}
+
+bool Connection::_enqueue( const Chunk* chunks, const size_t nChunks,
+                           const uint64_t bytes )
+{
+    if( !isConnected( ))
+        return false;
+
+    detail::SendQueue& sendQueue = *_impl->sendQueue;
+    if( !sendQueue.thread.isRunning() && !sendQueue.start( ))
+        return _writeSync( chunks, nChunks, bytes, ConstBufferPtr( ));
+
+    const uint32_t timeout = Global::getTimeout();
+    const uint64_t maxQueued = sendQueue.budget - bytes;
+    if( sendQueue.bytes.get() > maxQueued )
+    {
+        LBDEBUG << "Send queue full, " << sendQueue.bytes.get()
+                << " bytes queued on " << *this << std::endl;
+        if( !sendQueue.bytes.timedWaitLE( maxQueued, timeout ))
+        {
+            LBWARN << "Timeout while waiting for send queue of " << *this
+                   << std::endl;
+            return false;
+        }
+        if( !isConnected( )) // released by the send thread stopping
+            return false;
+    }
+
+    sendQueue.buffers.compact();
+    BufferPtr buffer = sendQueue.buffers.alloc( LB_MAX( bytes,
+                                                uint64_t( COMMAND_ALLOCSIZE )));
+    for( size_t i = 0; i < nChunks; ++i )
+        buffer->append( static_cast< const uint8_t* >( chunks[i].data ),
+                        chunks[i].size );
+    sendQueue.bytes += bytes;
+    sendQueue.queue.push( buffer );
+    return true;
+}
+
+void Connection::_runSendQueue()
+{
+    detail::SendQueue& sendQueue = *_impl->sendQueue;
+    while( true )
+    {
+        BufferPtr buffer = sendQueue.queue.pop();
+        if( !buffer )
+            break;
+
+        const uint64_t bytes = buffer->getSize();
+        if( isConnected( )) // write errors close the connection
+        {
+            const Chunk chunk = { buffer->getData(), bytes };
+            _writeChunks( &chunk, 1, bytes );
+            if( sendQueue.queue.isEmpty( ))
+                finish(); // push out the data of the last send
+        }
+        buffer = 0;
+        sendQueue.bytes -= bytes;
+    }
+
+    // release senders waiting on sends queued after close
+    sendQueue.queue.clear();
+    sendQueue.bytes = 0;
+}
+
+bool Connection::_writeSync( const Chunk* chunks, const size_t nChunks,
+                             const uint64_t bytes, const ConstBufferPtr& owner )
+{
+    // serialized with the send thread, which only writes queued data
+    _impl->sendOwner = owner;
+    const bool result = _writeChunks( chunks, nChunks, bytes );
+    _impl->sendOwner = 0;
+    return result;
+}
+
+bool Connection::_writeChunks( const Chunk* chunks, const size_t nChunks,
+                               const uint64_t bytes )
+{
+    size_t current = 0; // first chunk with unsent data
+    uint64_t offset = 0; // sent bytes of the current chunk
     uint64_t bytesLeft = bytes;
     while( bytesLeft )
     {
+        while( offset == chunks[ current ].size )
+        {
+            ++current;
+            offset = 0;
+        }
+
         try
         {
-            const int64_t wrote = this->write( ptr, bytesLeft );
+            int64_t wrote;
+            if( offset == 0 )
+                wrote = writev( chunks + current, nChunks - current );
+            else // partial write, finish the current chunk
+            {
+                const Chunk rest = {
+                    static_cast< const uint8_t* >( chunks[ current ].data ) +
+                        offset,
+                    chunks[ current ].size - offset };
+                wrote = writev( &rest, 1 );
+            }
+
             if( wrote == -1 ) // error
             {
                 LBERROR << "Error during write after " << bytes - bytesLeft
@@ -385,7 +833,18 @@ bool Connection::send( const void* buffer, const uint64_t bytes,
                 LBINFO << "Zero bytes write" << std::endl;
 
             bytesLeft -= wrote;
-            ptr += wrote;
+            for( uint64_t left = wrote; left > 0; )
+            {
+                const uint64_t size = LB_MIN( left,
+                                              chunks[ current ].size - offset );
+                offset += size;
+                left -= size;
+                if( offset == chunks[ current ].size && left > 0 )
+                {
+                    ++current;
+                    offset = 0;
+                }
+            }
         }
         catch( const co::Exception& e )
         {
@@ -399,11 +858,34 @@ bool Connection::send( const void* buffer, const uint64_t bytes,
     return true;
 }
 
+int64_t Connection::writev( const Chunk* chunks, const size_t nChunks )
+{
+    for( size_t i = 0; i < nChunks; ++i )
+        if( chunks[i].size > 0 )
+            return write( chunks[i].data, chunks[i].size );
+    return 0;
+}
+
+ConstBufferPtr Connection::getSendOwner() const
+{
+    return _impl->sendOwner;
+}
+
 bool Connection::isMulticast() const
 {
     return getDescription()->type >= CONNECTIONTYPE_MULTICAST;
 }
 
+uint32_t Connection::getFraming() const
+{
+    return uint32_t( int32_t( _impl->framing ));
+}
+
+void Connection::setFraming( const uint32_t framing )
+{
+    _impl->framing = int32_t( framing );
+}
+
 ConstConnectionDescriptionPtr Connection::getDescription() const
 {
     return _impl->description;
@@ -429,6 +911,10 @@ std::ostream& operator << ( std::ostream& os, const Connection& connection )
     if( desc.isValid( ))
         os << " description " << desc->toString();
 
+    const uint64_t queued = connection.getSendQueueSize();
+    if( queued > 0 )
+        os << " queued " << queued << " bytes";
+
     return os;
 }
 }
@@ -34,7 +34,7 @@
 
 namespace co
 {
-namespace detail { class Connection; }
+namespace detail { class Connection; class SendThread; }
 
 /**
  * An interface definition for communication between hosts.
@@ -100,6 +100,12 @@ public:
     /** @return the description for this connection. @version 1.0 */
     CO_API ConstConnectionDescriptionPtr getDescription() const;
 
+    /** @internal @return the CommandFraming used on this connection. */
+    CO_API uint32_t getFraming() const;
+
+    /** @internal Set the CommandFraming negotiated with the peer. */
+    CO_API void setFraming( const uint32_t framing );
+
     /** @internal */
     bool operator == ( const Connection& rhs ) const;
     //@}
@@ -185,6 +191,21 @@ public:
      */
     CO_API void recvNB( BufferPtr buffer, const uint64_t bytes );
 
+    /**
+     * Start a read operation of a variable amount of data.
+     *
+     * The following recvSync() finishes as soon as at least minBytes have
+     * been received, and appends all data received so far, at most maxBytes.
+     *
+     * @param buffer the buffer receiving the data.
+     * @param minBytes the minimum number of bytes to read.
+     * @param maxBytes the maximum number of bytes to read.
+     * @sa recvSync()
+     * @version 1.4
+     */
+    CO_API void recvNB( BufferPtr buffer, const uint64_t minBytes,
+                        const uint64_t maxBytes );
+
     /**
      * Finish reading data from the connection.
      *
@@ -197,7 +218,8 @@ public:
      * @param buffer return value, the buffer passed to recvNB().
      * @param block internal workaround parameter, do not use unless you
      *              know exactly why.
-     * @return true if all requested data has been read, false otherwise.
+     * @return true if all requested data, or at least the minimum amount of
+     *         data, has been read, false otherwise.
      * @version 1.0
      */
     CO_API bool recvSync( BufferPtr& buffer, const bool block = true );
@@ -225,6 +247,108 @@ public:
     CO_API bool send( const void* buffer, const uint64_t bytes,
                       const bool isLocked = false );
 
+    /** A contiguous piece of data for a vectored send. @version 1.4 */
+    struct Chunk
+    {
+        const void* data;
+        uint64_t size;
+    };
+
+    /**
+     * Send a sequence of buffers as one contiguous message.
+     *
+     * The chunks are written using writev(), which sends them with a single
+     * system call on connections supporting vectored writes.
+     *
+     * @param chunks the buffers to send, in order.
+     * @param nChunks the number of chunks.
+     * @param isLocked true if the connection is locked externally.
+     * @return true if all data has been sent, false if not.
+     * @sa send( const void*, const uint64_t, const bool )
+     * @version 1.4
+     */
+    CO_API bool send( const Chunk* chunks, const size_t nChunks,
+                      const bool isLocked = false );
+
+    /**
+     * Send a sequence of buffers whose big chunks may be read after return.
+     *
+     * The owner is referenced until the data of all chunks of at least
+     * IATTR_TCP_ZEROCOPY_SIZE bytes has been transmitted, which allows TCP
+     * connections to send them using MSG_ZEROCOPY. The caller may not modify
+     * or free this data while the owner is referenced. Smaller chunks are
+     * copied as usual.
+     *
+     * @param chunks the buffers to send, in order.
+     * @param nChunks the number of chunks.
+     * @param owner the owner of the big chunks, may be 0.
+     * @param isLocked true if the connection is locked externally.
+     * @return true if all data has been sent, false if not.
+     * @version 1.4
+     */
+    CO_API bool send( const Chunk* chunks, const size_t nChunks,
+                      const ConstBufferPtr& owner,
+                      const bool isLocked = false );
+
+    /**
+     * Gather small sends on this connection into bigger writes.
+     *
+     * Unlocked sends smaller than the given size are buffered. The buffered
+     * data is written when the buffer is full, when the next send finds the
+     * oldest buffered data older than the given timeout, on flush(), or
+     * together with the next locked or bigger send, which keeps the order of
+     * all sent data.
+     *
+     * @param size the size of the send buffer, 0 disables coalescing.
+     * @param timeout the maximum time in milliseconds a send may be buffered
+     *                until the next send, 0 for no limit.
+     * @sa flush()
+     * @version 1.4
+     */
+    CO_API void setSendCoalescing( const uint64_t size,
+                                   const uint32_t timeout );
+
+    /**
+     * Write all data buffered by send coalescing, wait for the send queue and
+     * finish() all pending sends.
+     *
+     * @return true if all data has been sent, false if not.
+     * @sa setSendCoalescing(), setSendQueue()
+     * @version 1.4
+     */
+    CO_API bool flush();
+
+    /**
+     * @internal Write the data buffered by send coalescing without waiting for
+     * the send queue.
+     *
+     * @return true if the data has been written or queued, false if not.
+     */
+    CO_API bool flushCoalesced();
+
+    /**
+     * Send data asynchronously from a per-connection I/O thread.
+     *
+     * Sends are copied into a bounded queue and written in order by the I/O
+     * thread. The caller only blocks when the queued data would exceed the
+     * given budget. Sends bigger than the budget wait for the queue to drain
+     * and are written directly by the caller. Write errors are reported by
+     * closing the connection.
+     *
+     * The I/O thread is started by the first queued send. Closing the
+     * connection aborts the data queued but not yet written, flush() first to
+     * send it.
+     *
+     * @param budget the maximum number of queued bytes, 0 to send
+     *               synchronously.
+     * @sa getSendQueueSize(), flush()
+     * @version 1.4
+     */
+    CO_API void setSendQueue( const uint64_t budget );
+
+    /** @return the number of bytes queued for sending. @version 1.4 */
+    CO_API uint64_t getSendQueueSize() const;
+
     /** Lock the connection, no other thread can send data. @version 1.0 */
     CO_API void lockSend() const;
 
@@ -233,6 +357,24 @@ public:
 
     /** @internal Finish all pending send operations. */
     virtual void finish() {}
+
+    /**
+     * @internal Make writes blocked by a slow receiver fail.
+     *
+     * Called before the send queue thread is stopped on close, to not wait
+     * for the timeout of its current write.
+     */
+    virtual void abortSends() {}
+
+    /**
+     * @internal Handle an error condition signalled by the notifier.
+     *
+     * Called by the ConnectionSet before reporting an error event.
+     *
+     * @return true if the condition was a benign notification which has been
+     *         consumed, false if the connection has an error.
+     */
+    virtual bool handleError() { return false; }
     //@}
 
     /**
@@ -294,6 +436,19 @@ protected:
     virtual int64_t readSync( void* buffer, const uint64_t bytes,
                               const bool block ) = 0;
 
+    /**
+     * Hand over a buffer with received data instead of copying it.
+     *
+     * Used by recvSync() to complete a receive into an empty buffer. The
+     * default implementation returns 0, upon which readSync() is used.
+     *
+     * @param minBytes the minimum number of bytes to hand over.
+     * @param maxBytes the maximum number of bytes to hand over.
+     * @return a buffer with the received data, or 0.
+     */
+    CO_API virtual BufferPtr readBuffer( const uint64_t minBytes,
+                                         const uint64_t maxBytes );
+
     /**
      * Write data to the connection.
      *
@@ -305,6 +460,27 @@ protected:
      * @return the number of bytes written, or -1 upon error.
      */
     virtual int64_t write( const void* buffer, const uint64_t bytes ) = 0;
+
+    /**
+     * Write a sequence of buffers to the connection.
+     *
+     * Like write(), this may return with a partial write. The default
+     * implementation writes the first non-empty chunk using write().
+     *
+     * @param chunks the buffers to write.
+     * @param nChunks the number of chunks, at least one.
+     * @return the number of bytes written, or -1 upon error.
+     */
+    CO_API virtual int64_t writev( const Chunk* chunks, const size_t nChunks );
+
+    /**
+     * @internal @return the owner of the big chunks written by the current
+     *           send(), or 0 if all data has to be copied.
+     *
+     * Implementations may keep a reference to the owner after a write
+     * returns, until the data has been transmitted without a copy.
+     */
+    CO_API ConstBufferPtr getSendOwner() const;
     //@}
 
     /** @internal @name State Changes */
@@ -320,6 +496,19 @@ protected:
 
 private:
     detail::Connection* const _impl;
+    friend class StripedConnection; // uses the I/O methods of its streams
+    friend class detail::SendThread;
+
+    bool _write( const Chunk* chunks, const size_t nChunks,
+                 const uint64_t bytes, const ConstBufferPtr& owner );
+    bool _writeSync( const Chunk* chunks, const size_t nChunks,
+                     const uint64_t bytes, const ConstBufferPtr& owner );
+    bool _writeChunks( const Chunk* chunks, const size_t nChunks,
+                       const uint64_t bytes );
+    bool _enqueue( const Chunk* chunks, const size_t nChunks,
+                   const uint64_t bytes );
+    void _runSendQueue();
+    bool _flushCoalesced();
 };
 
 CO_API std::ostream& operator << ( std::ostream&, const Connection& );
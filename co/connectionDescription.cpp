@@ -19,6 +19,7 @@
 
 #include "connectionDescription.h"
 
+#include <pression/plugins/compressorTypes.h>
 #include <sstream>
 
 namespace co
@@ -46,10 +47,26 @@ static ConnectionType _getConnectionType( const std::string& string )
         return CONNECTIONTYPE_RDMA;
     if( string == "UDT" )
         return CONNECTIONTYPE_UDT;
+    if( string == "SHM" )
+        return CONNECTIONTYPE_SHM;
+    if( string == "UNIX" )
+        return CONNECTIONTYPE_UNIX;
 
     LBWARN << "Unknown connection type: " << string << std::endl;
     return CONNECTIONTYPE_NONE;
 }
+
+/** Consume the next SEPARATOR-terminated integer from data. */
+static bool _getInt( std::string& data, int32_t& value )
+{
+    const size_t nextPos = data.find( SEPARATOR );
+    if( nextPos == std::string::npos )
+        return false;
+
+    value = atoi( data.substr( 0, nextPos ).c_str( ));
+    data = data.substr( nextPos + 1 );
+    return true;
+}
 }
 
 ConnectionDescription::ConnectionDescription( std::string& data )
@@ -57,6 +74,15 @@ ConnectionDescription::ConnectionDescription( std::string& data )
         , bandwidth( 0 )
         , port( 0 )
         , filename( "default" )
+        , sendBufferSize( 0 )
+        , receiveBufferSize( 0 )
+        , noDelay( true )
+        , cork( false )
+        , busyPoll( 0 )
+        , quickAck( false )
+        , tos( -1 )
+        , streams( 1 )
+        , compressor( EQ_COMPRESSOR_NONE )
 {
     fromString( data );
     LBASSERTINFO( data.empty(), data );
@@ -73,7 +99,10 @@ void ConnectionDescription::serialize( std::ostream& os ) const
 {
     os << type << SEPARATOR << bandwidth << SEPARATOR << hostname  << SEPARATOR
        << interfacename << SEPARATOR << port << SEPARATOR << filename
-       << SEPARATOR;
+       << SEPARATOR << sendBufferSize << SEPARATOR << receiveBufferSize
+       << SEPARATOR << noDelay << SEPARATOR << cork << SEPARATOR << busyPoll
+       << SEPARATOR << quickAck << SEPARATOR << tos << SEPARATOR << streams
+       << SEPARATOR << compressor << SEPARATOR;
 }
 
 bool ConnectionDescription::fromString( std::string& data )
@@ -106,7 +135,9 @@ bool ConnectionDescription::fromString( std::string& data )
                 else
                 {
                     type = _getConnectionType( token );
-                    if( type == CONNECTIONTYPE_NAMEDPIPE )
+                    if( type == CONNECTIONTYPE_NAMEDPIPE ||
+                        type == CONNECTIONTYPE_SHM ||
+                        type == CONNECTIONTYPE_UNIX )
                     {
                         filename = hostname;
                         hostname.clear();
@@ -162,6 +193,29 @@ bool ConnectionDescription::fromString( std::string& data )
 
         filename = data.substr( 0, nextPos );
         data = data.substr( nextPos + 1 );
+
+        // optional, not sent by older peers: the next description starts with
+        // the type name
+        if( data.empty() || ( !isdigit( data[0] ) && data[0] != '-' ))
+            return true;
+
+        int32_t noDelayInt = 0;
+        int32_t corkInt = 0;
+        int32_t quickAckInt = 0;
+        int32_t compressorInt = 0;
+        if( !_getInt( data, sendBufferSize ) ||
+            !_getInt( data, receiveBufferSize ) ||
+            !_getInt( data, noDelayInt ) || !_getInt( data, corkInt ) ||
+            !_getInt( data, busyPoll ) || !_getInt( data, quickAckInt ) ||
+            !_getInt( data, tos ) || !_getInt( data, streams ) ||
+            !_getInt( data, compressorInt ))
+        {
+            goto error;
+        }
+        noDelay = noDelayInt != 0;
+        cork = corkInt != 0;
+        quickAck = quickAckInt != 0;
+        compressor = uint32_t( compressorInt );
     }
     return true;
 
@@ -212,7 +266,13 @@ bool ConnectionDescription::operator == ( const ConnectionDescription& rhs )
 {
     return type == rhs.type && bandwidth == rhs.bandwidth &&
            port == rhs.port && hostname == rhs.hostname &&
-           interfacename == rhs.interfacename && filename == rhs.filename;
+           interfacename == rhs.interfacename && filename == rhs.filename &&
+           sendBufferSize == rhs.sendBufferSize &&
+           receiveBufferSize == rhs.receiveBufferSize &&
+           noDelay == rhs.noDelay && cork == rhs.cork &&
+           busyPoll == rhs.busyPoll && quickAck == rhs.quickAck &&
+           tos == rhs.tos && streams == rhs.streams &&
+           compressor == rhs.compressor;
 }
 
 std::string serialize( const ConnectionDescriptions& descriptions )
@@ -293,6 +353,26 @@ std::ostream& operator << ( std::ostream& os,
     if( desc.bandwidth != 0 )
         os << "bandwidth     " << desc.bandwidth << std::endl;
 
+    if( desc.sendBufferSize != 0 )
+        os << "send_buffer   " << desc.sendBufferSize << std::endl;
+    if( desc.receiveBufferSize != 0 )
+        os << "recv_buffer   " << desc.receiveBufferSize << std::endl;
+    if( !desc.noDelay )
+        os << "nodelay       off" << std::endl;
+    if( desc.cork )
+        os << "cork          on" << std::endl;
+    if( desc.busyPoll != 0 )
+        os << "busy_poll     " << desc.busyPoll << std::endl;
+    if( desc.quickAck )
+        os << "quickack      on" << std::endl;
+    if( desc.tos >= 0 )
+        os << "tos           " << desc.tos << std::endl;
+    if( desc.streams > 1 )
+        os << "streams       " << desc.streams << std::endl;
+    if( desc.compressor != EQ_COMPRESSOR_NONE )
+        os << "compressor    0x" << std::hex << desc.compressor << std::dec
+           << std::endl;
+
     return os << lunchbox::exdent << "}" << lunchbox::enableHeader
               << lunchbox::enableFlush << std::endl;
 }
@@ -50,15 +50,69 @@ public:
     /** The host name of the interface (multicast). @version 1.0 */
     std::string interfacename;
 
-    /** The filename used for named pipes. @version 1.0 */
+    /** The filename of pipes, shared memory and unix sockets. @version 1.0 */
     std::string filename;
 
+    /** @name Socket Options (TCPIP, SDP) */
+    //@{
+    /** The SO_SNDBUF size in bytes, 0 for the default. @version 1.4 */
+    int32_t sendBufferSize;
+
+    /** The SO_RCVBUF size in bytes, 0 for the default. @version 1.4 */
+    int32_t receiveBufferSize;
+
+    /** Disable Nagle's algorithm using TCP_NODELAY. @version 1.4 */
+    bool noDelay;
+
+    /**
+     * Send only full frames using TCP_CORK. The last partial frame is sent on
+     * Connection::finish(), Connection::flush(), when the send queue drained,
+     * or after 200 ms by the kernel.
+     * @version 1.4
+     */
+    bool cork;
+
+    /** The SO_BUSY_POLL time in microseconds, 0 to disable. @version 1.4 */
+    int32_t busyPoll;
+
+    /** Acknowledge received data immediately (TCP_QUICKACK). @version 1.4 */
+    bool quickAck;
+
+    /** The IP_TOS of sent packets, -1 for the default. @version 1.4 */
+    int32_t tos;
+
+    /**
+     * The number of TCP streams striping a TCPIP connection, Linux only.
+     * @version 1.4
+     */
+    int32_t streams;
+    //@}
+
+    /**
+     * The pression compressor for the data of TCPIP, SDP and UNIX
+     * connections.
+     *
+     * EQ_COMPRESSOR_AUTO chooses a byte compressor. Both sides agree on the
+     * compressor when connecting. Only supported on Linux.
+     * @version 1.4
+     */
+    uint32_t compressor;
+
     /** Construct a new, default description. @version 1.0 */
     ConnectionDescription()
         : type( CONNECTIONTYPE_TCPIP )
         , bandwidth( 0 )
         , port( 0 )
         , filename( "default" )
+        , sendBufferSize( 0 )
+        , receiveBufferSize( 0 )
+        , noDelay( true )
+        , cork( false )
+        , busyPoll( 0 )
+        , quickAck( false )
+        , tos( -1 )
+        , streams( 1 )
+        , compressor( 0 ) // EQ_COMPRESSOR_NONE
     {}
 
     /**
@@ -85,8 +139,8 @@ public:
      * formats are recognized, a human-readable and a machine-readable. The
      * human-readable version has the format
      * <code>hostname[:port][:type]</code> or
-     * <code>filename:PIPE</code>. The <code>type</code> parameter can be
-     * TCPIP, SDP, IB, MCIP, UDT or RSP. The machine-readable format
+     * <code>filename:PIPE|SHM|UNIX</code>. The
+     * <code>type</code> parameter can be TCPIP, SDP, IB, MCIP, UDT or RSP. The machine-readable format
      * contains all connection description parameters, is not documented and
      * subject to change.
      *
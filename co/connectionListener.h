@@ -29,6 +29,12 @@ namespace co
         virtual ~ConnectionListener() {}
 
         virtual void notifyStateChanged( Connection* ){}
+
+        /**
+         * Called by the sending thread when send coalescing started to buffer
+         * data on the connection, with the send lock held.
+         */
+        virtual void notifyCoalesced( Connection* ){}
     };
 }
 
@@ -23,6 +23,7 @@
 #include "connection.h"
 #include "connectionListener.h"
 #include "eventConnection.h"
+#include "global.h"
 
 #include <lunchbox/algorithm.h>
 #include <lunchbox/buffer.h>
@@ -32,6 +33,7 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <map>
 
 #ifdef _WIN32
 #  include <lunchbox/monitor.h>
@@ -45,6 +47,13 @@
 #  define MAX_CONNECTIONS LB_100KB  // Arbitrary
 #endif
 
+#ifdef __linux__
+#  include <sys/epoll.h>
+#  include <unistd.h>
+#  define CO_USE_EPOLL
+#  define MAX_EPOLL_EVENTS 256
+#endif
+
 namespace co
 {
 namespace
@@ -104,6 +113,12 @@ union Result
 };
 #endif // _WIN32
 
+#ifdef CO_USE_EPOLL
+typedef std::map< const Connection*, int > ConnectionFDs;
+typedef ConnectionFDs::iterator ConnectionFDsIter;
+typedef std::map< int, const Connection* > FDConnections;
+typedef FDConnections::iterator FDConnectionsIter;
+#endif
 }
 
 namespace detail
@@ -147,6 +162,25 @@ public:
     /** FD sets need rebuild. */
     bool dirty;
 
+#ifdef CO_USE_EPOLL
+    /** The epoll instance, or -1 if poll() is used. */
+    int epollFD;
+
+    /** The ready events of the last epoll_wait(), consumed by select(). */
+    epoll_event events[ MAX_EPOLL_EVENTS ];
+    size_t nEvents;   //!< Number of valid entries in events
+    size_t nextEvent; //!< Next entry in events to be handled by select()
+
+    /** The file descriptor registered for each connection. */
+    ConnectionFDs registered;
+
+    /** The connection owning each registered file descriptor. */
+    FDConnections owners;
+
+    /** Connections which lost their notifier while being in the set. */
+    Connections invalid;
+#endif
+
     ConnectionSet()
            : selfConnection( new EventConnection )
 #ifdef _WIN32
@@ -154,16 +188,41 @@ public:
 #endif
            , error( 0 )
            , dirty( true )
+#ifdef CO_USE_EPOLL
+           , epollFD( -1 )
+           , nEvents( 0 )
+           , nextEvent( 0 )
+#endif
     {
         // Whenever another threads modifies the connection list while the
         // connection set is waiting in a select, the select is interrupted
         // using this connection.
         LBCHECK( selfConnection->connect( ));
+
+#ifdef CO_USE_EPOLL
+        if( !Global::getIAttribute( Global::IATTR_CONNECTIONSET_EPOLL ))
+            return;
+
+        epollFD = ::epoll_create1( EPOLL_CLOEXEC );
+        if( epollFD < 0 )
+        {
+            LBWARN << "Can't create epoll instance, using poll(): "
+                   << lunchbox::sysError << std::endl;
+            return;
+        }
+        add( selfConnection.get( ));
+        dirty = false;
+#endif
     }
 
     ~ConnectionSet()
      {
          connection = 0;
+#ifdef CO_USE_EPOLL
+         if( epollFD >= 0 )
+             ::close( epollFD );
+         epollFD = -1;
+#endif
          selfConnection->close();
          selfConnection = 0;
      }
@@ -180,8 +239,98 @@ public:
 
     void interrupt() { selfConnection->set(); }
 
+#ifdef CO_USE_EPOLL
+    bool useEpoll() const { return epollFD >= 0; }
+
+    /** Register the connection's notifier with epoll. Needs lock. */
+    void add( const co::Connection* conn )
+    {
+        const int fd = conn->getNotifier();
+        if( fd <= 0 )
+        {
+            // reported as EVENT_INVALID_HANDLE by the next select()
+            invalid.push_back( const_cast< co::Connection* >( conn ));
+            interrupt();
+            return;
+        }
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = const_cast< co::Connection* >( conn );
+        if( ::epoll_ctl( epollFD, EPOLL_CTL_ADD, fd, &event ) != 0 )
+        {
+            LBWARN << "Can't add fd " << fd << " to epoll set: "
+                   << lunchbox::sysError << std::endl;
+            invalid.push_back( const_cast< co::Connection* >( conn ));
+            interrupt();
+            return;
+        }
+        registered[ conn ] = fd;
+        owners[ fd ] = conn;
+    }
+
+    /** Deregister the connection's notifier from epoll. Needs lock. */
+    void remove( const co::Connection* conn )
+    {
+        ConnectionFDsIter i = registered.find( conn );
+        if( i != registered.end( ))
+        {
+            const int fd = i->second;
+            FDConnectionsIter j = owners.find( fd );
+            // The fd might have been closed and reused by another connection
+            if( j != owners.end() && j->second == conn )
+            {
+                ::epoll_ctl( epollFD, EPOLL_CTL_DEL, fd, 0 ); // may be closed
+                owners.erase( j );
+            }
+            registered.erase( i );
+        }
+
+        ConnectionsIter j = std::find( invalid.begin(), invalid.end(), conn );
+        if( j != invalid.end( ))
+            invalid.erase( j );
+
+        // drop not yet handled results of the last epoll_wait
+        for( size_t k = nextEvent; k < nEvents; ++k )
+            if( events[k].data.ptr == conn )
+                events[k].data.ptr = 0;
+    }
+
+    /** Re-register the connection if its notifier changed. Needs lock. */
+    void update( const co::Connection* conn )
+    {
+        ConnectionFDsIter i = registered.find( conn );
+        if( i == registered.end( ))
+        {
+            if( std::find( invalid.begin(), invalid.end(), conn ) ==
+                invalid.end( ))
+            {
+                return; // not (yet) managed by us
+            }
+        }
+        else if( i->second == conn->getNotifier( ))
+            return;
+
+        remove( conn );
+        add( conn );
+    }
+#endif
+
 private:
-    virtual void notifyStateChanged( co::Connection* ) { setDirty(); }
+    virtual void notifyStateChanged( co::Connection* conn )
+    {
+#ifdef CO_USE_EPOLL
+        if( useEpoll( ))
+        {
+            lunchbox::ScopedWrite mutex( lock );
+            update( conn );
+            return;
+        }
+#else
+        (void)conn;
+#endif
+        setDirty();
+    }
 };
 }
 
@@ -275,6 +424,13 @@ void ConnectionSet::addConnection( ConnectionPtr connection )
         connection->addListener( _impl );
 
         LBASSERT( _impl->allConnections.size() < MAX_CONNECTIONS );
+#  ifdef CO_USE_EPOLL
+        if( _impl->useEpoll( ))
+        {
+            _impl->add( connection.get( ));
+            return; // registered incrementally, no rebuild needed
+        }
+#  endif
 #endif // _WIN32
     }
 
@@ -325,6 +481,14 @@ bool ConnectionSet::removeConnection( ConnectionPtr connection )
         }
 #else
         connection->removeListener( _impl );
+#  ifdef CO_USE_EPOLL
+        if( _impl->useEpoll( ))
+        {
+            _impl->remove( connection.get( ));
+            _impl->allConnections.erase( i );
+            return true;
+        }
+#  endif
 #endif
 
         _impl->allConnections.erase( i );
@@ -354,7 +518,16 @@ void ConnectionSet::_clear()
     Connections& connections = _impl->allConnections;
 #endif
     for( ConnectionsIter i = connections.begin(); i != connections.end(); ++i )
+    {
         (*i)->removeListener( _impl );
+#ifdef CO_USE_EPOLL
+        if( _impl->useEpoll( ))
+        {
+            lunchbox::ScopedWrite mutex( _impl->lock );
+            _impl->remove( i->get( ));
+        }
+#endif
+    }
 
     _impl->allConnections.clear();
 #ifdef _WIN32
@@ -400,8 +573,22 @@ ConnectionSet::Event ConnectionSet::select( const uint32_t timeout )
 #else
         const int pollTimeout = timeout == LB_TIMEOUT_INDEFINITE ?
                                 -1 : int( timeout );
+#  ifdef CO_USE_EPOLL
+        int ret;
+        if( _impl->useEpoll( ))
+        {
+            ret = ::epoll_wait( _impl->epollFD, _impl->events,
+                                MAX_EPOLL_EVENTS, pollTimeout );
+            _impl->nEvents = ret > 0 ? size_t( ret ) : 0;
+            _impl->nextEvent = 0;
+        }
+        else
+            ret = poll( _impl->fdSet.getData(), _impl->fdSet.getSize(),
+                        pollTimeout );
+#  else
         const int ret = poll( _impl->fdSet.getData(), _impl->fdSet.getSize(),
                               pollTimeout );
+#  endif
 #endif
         switch( ret )
         {
@@ -489,6 +676,48 @@ ConnectionSet::Event ConnectionSet::_parseSelect( const uint32_t index )
 #else // _WIN32
 ConnectionSet::Event ConnectionSet::_parseSelect( const uint32_t )
 {
+#ifdef CO_USE_EPOLL
+    if( _impl->useEpoll( ))
+    {
+        lunchbox::ScopedWrite mutex( _impl->lock );
+        while( _impl->nextEvent < _impl->nEvents )
+        {
+            const epoll_event& event = _impl->events[ _impl->nextEvent++ ];
+            if( !event.data.ptr ) // connection removed since epoll_wait
+                continue;
+
+            _impl->connection = static_cast< Connection* >( event.data.ptr );
+            LBVERB << "Got event on connection @"
+                   << (void*)_impl->connection.get() << std::endl;
+
+            if( event.events & EPOLLERR )
+            {
+                if( !_impl->connection->handleError( ))
+                {
+                    LBINFO << "Error during epoll(): " << lunchbox::sysError
+                           << std::endl;
+                    return EVENT_ERROR;
+                }
+                if( !( event.events & ( EPOLLHUP | EPOLLIN | EPOLLPRI )))
+                    continue;
+            }
+
+            // disconnect event or disconnected connection
+            if( event.events & EPOLLHUP )
+                return EVENT_DISCONNECT;
+
+            if( event.events & EPOLLIN || event.events & EPOLLPRI )
+                return EVENT_DATA;
+
+            LBERROR << "Unhandled epoll event(s): " << event.events
+                    << std::endl;
+            ::abort();
+        }
+        _impl->connection = 0;
+        return EVENT_NONE;
+    }
+#endif
+
     for( size_t i = 0; i < _impl->fdSet.getSize(); ++i )
     {
         pollfd& pollFD = _impl->fdSet[i];
@@ -507,9 +736,14 @@ ConnectionSet::Event ConnectionSet::_parseSelect( const uint32_t )
 
         if( pollEvents & POLLERR )
         {
-            LBINFO << "Error during poll(): " << lunchbox::sysError
-                   << std::endl;
-            return EVENT_ERROR;
+            if( !_impl->connection->handleError( ))
+            {
+                LBINFO << "Error during poll(): " << lunchbox::sysError
+                       << std::endl;
+                return EVENT_ERROR;
+            }
+            if( !( pollEvents & ( POLLHUP | POLLNVAL | POLLIN | POLLPRI )))
+                continue;
         }
 
         // disconnect event or disconnected connection
@@ -532,6 +766,34 @@ ConnectionSet::Event ConnectionSet::_parseSelect( const uint32_t )
 
 bool ConnectionSet::_setupFDSet()
 {
+#ifdef CO_USE_EPOLL
+    if( _impl->useEpoll( ))
+    {
+        // Connections are registered incrementally, only report invalid ones
+        // and resynchronize the registrations on an explicit setDirty().
+        lunchbox::ScopedWrite mutex( _impl->lock );
+        if( _impl->dirty )
+        {
+            _impl->dirty = false;
+            _impl->nEvents = 0;
+            _impl->nextEvent = 0;
+            for( ConnectionsCIter i = _impl->allConnections.begin();
+                 i != _impl->allConnections.end(); ++i )
+            {
+                _impl->update( i->get( ));
+            }
+        }
+
+        if( _impl->invalid.empty( ))
+            return true;
+
+        _impl->connection = _impl->invalid.front(); // until removed
+        LBINFO << "Cannot select connection " << _impl->connection
+               << ", connection doesn't have a file descriptor" << std::endl;
+        return false;
+    }
+#endif
+
     if( !_impl->dirty )
     {
 #ifndef _WIN32
@@ -36,6 +36,8 @@ namespace co
         CONNECTIONTYPE_IB,        //!< @deprecated Win XP Infiniband RDMA
         CONNECTIONTYPE_RDMA,      //!< Infiniband RDMA CM
         CONNECTIONTYPE_UDT,       //!< UDT connection
+        CONNECTIONTYPE_SHM,       //!< Shared memory, same host (Linux)
+        CONNECTIONTYPE_UNIX,      //!< Unix domain stream socket
         CONNECTIONTYPE_MULTICAST = 0x100, //!< @internal MC types after this:
         CONNECTIONTYPE_RSP        //!< UDP-based reliable stream protocol
     };
@@ -54,6 +56,8 @@ namespace co
             case CONNECTIONTYPE_NONE: return os << "NONE";
             case CONNECTIONTYPE_RDMA: return os << "RDMA";
             case CONNECTIONTYPE_UDT: return os << "UDT";
+            case CONNECTIONTYPE_SHM: return os << "SHM";
+            case CONNECTIONTYPE_UNIX: return os << "UNIX";
 
             default:
                 LBASSERTINFO( false, "Not implemented" );
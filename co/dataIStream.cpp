@@ -23,6 +23,7 @@
 #include "global.h"
 #include "log.h"
 #include "node.h"
+#include "pooled.h"
 
 #include <lunchbox/buffer.h>
 #include <lunchbox/debug.h>
@@ -35,16 +36,19 @@ namespace co
 {
 namespace detail
 {
-class DataIStream
+class DataIStream : public Pooled< DataIStream >
 {
 public:
     explicit DataIStream( const bool swap_ )
         : input( 0 )
         , inputSize( 0 )
         , position( 0 )
+        , decompressor( 0 )
         , swap( swap_ )
     {}
 
+    ~DataIStream() { delete decompressor; }
+
     /** The current input buffer */
     const uint8_t* input;
 
@@ -54,7 +58,7 @@ public:
     /** The current read position in the buffer */
     uint64_t position;
 
-    pression::Decompressor decompressor; //!< current decompressor
+    pression::Decompressor* decompressor; //!< current, created on demand
     lunchbox::Bufferb data; //!< decompressed buffer
     bool swap; //!< Invoke endian conversion
 };
@@ -185,8 +189,10 @@ const uint8_t* DataIStream::_decompress( const void* data, const uint32_t name,
 #endif
     _impl->data.reset( dataSize );
 
-    _impl->decompressor.setup( Global::getPluginRegistry(), name );
-    LBASSERT( _impl->decompressor.uses( name ));
+    if( !_impl->decompressor )
+        _impl->decompressor = new pression::Decompressor;
+    _impl->decompressor->setup( Global::getPluginRegistry(), name );
+    LBASSERT( _impl->decompressor->uses( name ));
 
     uint64_t outDim[2] = { 0, dataSize };
     uint64_t* chunkSizes = static_cast< uint64_t* >(
@@ -205,8 +211,8 @@ const uint8_t* DataIStream::_decompress( const void* data, const uint32_t name,
         src += size;
     }
 
-    _impl->decompressor.decompress( chunks, chunkSizes, nChunks,
-                                    _impl->data.getData(), outDim );
+    _impl->decompressor->decompress( chunks, chunkSizes, nChunks,
+                                     _impl->data.getData(), outDim );
     return _impl->data.getData();
 }
 
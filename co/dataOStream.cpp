@@ -34,6 +34,9 @@
 #include <pression/compressorResult.h>
 #include <pression/plugins/compressor.h>
 
+#include <lunchbox/clock.h>
+#include <lunchbox/thread.h>
+
 #include  <boost/foreach.hpp>
 
 namespace co
@@ -93,6 +96,15 @@ public:
     /** Save all sent data */
     bool save;
 
+    /** A block written by _writeBlock() is being sent */
+    bool sendingBlock;
+
+    /** Referenced by zero-copy sends of the buffer or compressed data */
+    co::Buffer bufferOwner;
+
+    /** Referenced by zero-copy sends of the data of written blocks */
+    co::Buffer blockOwner;
+
     DataOStream()
         : state( STATE_UNCOMPRESSED )
         , bufferStart( 0 )
@@ -101,6 +113,7 @@ public:
         , enabled( false )
         , dataSent( false )
         , save( false )
+        , sendingBlock( false )
     {}
 
     DataOStream( const DataOStream& rhs )
@@ -111,6 +124,7 @@ public:
         , enabled( rhs.enabled )
         , dataSent( rhs.dataSent )
         , save( rhs.save )
+        , sendingBlock( false )
     {}
 
     uint32_t getCompressor() const
@@ -120,6 +134,38 @@ public:
         return compressor.getInfo().name;
     }
 
+    /** Wait until no zero-copy send reads the data of this stream. */
+    void waitSent()
+    {
+        waitSent( bufferOwner );
+        waitSent( blockOwner );
+    }
+
+    /** Wait until no zero-copy send references the given owner. */
+    void waitSent( const co::Buffer& owner )
+    {
+        if( owner.getRefCount() == 0 )
+            return;
+
+        const uint32_t timeout = Global::getTimeout();
+        lunchbox::Clock clock;
+        while( owner.getRefCount() > 0 )
+        {
+            // completions are reaped by the receiver thread or here
+            BOOST_FOREACH( ConnectionPtr connection, connections )
+                connection->handleError();
+
+            if( timeout != LB_TIMEOUT_INDEFINITE &&
+                clock.getTime64() > int64_t( timeout ))
+            {
+                LBWARN << "Timeout waiting for zero-copy sends to complete"
+                       << std::endl;
+                return;
+            }
+            lunchbox::Thread::yield();
+        }
+    }
+
     uint32_t getNumChunks() const
     {
         if( state == STATE_UNCOMPRESSED || state == STATE_UNCOMPRESSIBLE )
@@ -145,6 +191,8 @@ public:
             return;
         }
 
+        waitSent(); // the previous compressed data may still be sent
+
         const uint64_t inDims[2] = { 0, size };
 
 #ifdef CO_INSTRUMENT_DATAOSTREAM
@@ -197,6 +245,7 @@ DataOStream::DataOStream( DataOStream& rhs )
     , _impl( new detail::DataOStream( *rhs._impl ))
 {
     _setupConnections( rhs.getConnections( ));
+    rhs._impl->waitSent();
     getBuffer().swap( rhs.getBuffer( ));
 
     // disable send of rhs
@@ -208,6 +257,7 @@ DataOStream::~DataOStream()
 {
     // Can't call disable() from destructor since it uses virtual functions
     LBASSERT( !_impl->enabled );
+    _impl->waitSent();
     delete _impl;
 }
 
@@ -226,6 +276,7 @@ void DataOStream::_enable()
     _impl->dataSent    = false;
     _impl->dataSize    = 0;
     _impl->enabled     = true;
+    _impl->waitSent();
     _impl->buffer.setSize( 0 );
 #ifdef CO_AGGRESSIVE_CACHING
     _impl->buffer.reserve( COMMAND_ALLOCSIZE );
@@ -276,7 +327,8 @@ void DataOStream::disable()
         return;
 
     _impl->dataSize = _impl->buffer.getSize();
-    _impl->dataSent = _impl->dataSize > 0;
+    if( _impl->dataSize > 0 ) // data may have been sent by _writeBlock
+        _impl->dataSent = true;
 
     if( _impl->dataSent && !_impl->connections.empty( ))
     {
@@ -288,6 +340,7 @@ void DataOStream::disable()
             // OPT: all data has been sent in one compressed chunk
             _impl->state = STATE_COMPLETE;
 #ifndef CO_AGGRESSIVE_CACHING
+            _impl->waitSent();
             _impl->buffer.clear();
 #endif
         }
@@ -302,10 +355,13 @@ void DataOStream::disable()
         sendData( ptr, size, true ); // always send to finalize istream
     }
 
+    if( !_impl->save ) // the caller may reuse the written blocks on return
+    {
+        _impl->waitSent();
 #ifndef CO_AGGRESSIVE_CACHING
-    if( !_impl->save )
         _impl->buffer.clear();
 #endif
+    }
     _impl->enabled = false;
     _impl->connections.clear();
 }
@@ -345,7 +401,45 @@ void DataOStream::_write( const void* data, uint64_t size )
     {
         flush( false );
     }
-    _impl->buffer.append( static_cast< const uint8_t* >( data ), size );
+
+    // zero-copy sends may still read the data overwritten or reallocated here
+    lunchbox::Bufferb& buffer = _impl->buffer;
+    if( !_impl->save || buffer.getSize() + size > buffer.getMaxSize( ))
+        _impl->waitSent( _impl->bufferOwner );
+    buffer.append( static_cast< const uint8_t* >( data ), size );
+}
+
+void DataOStream::_writeBlock( const void* data, uint64_t size )
+{
+    const int32_t minSize =
+        Global::getIAttribute( Global::IATTR_OBJECT_ZEROCOPY_SIZE );
+    if( minSize <= 0 || size < uint64_t( minSize ) || _impl->save ||
+        _impl->connections.empty( ))
+    {
+        _write( data, size );
+        return;
+    }
+
+    LBASSERT( _impl->enabled );
+#ifdef CO_INSTRUMENT_DATAOSTREAM
+    nBytes += size;
+#endif
+
+    // send the buffered data first to keep the stream in order
+    if( _impl->buffer.getSize() > _impl->bufferStart )
+        flush( false );
+
+    // The block is received as a separate command, which the DataIStream
+    // reads as one contiguous input buffer.
+    void* ptr = const_cast< void* >( data );
+    _impl->state = STATE_UNCOMPRESSED;
+    _impl->compress( ptr, size, STATE_PARTIAL );
+    _impl->sendingBlock = true;
+    sendData( ptr, size, false );
+    _impl->sendingBlock = false;
+
+    _impl->state = STATE_UNCOMPRESSED; // nothing of the buffer was compressed
+    _impl->dataSent = true;
 }
 
 void DataOStream::flush( const bool last )
@@ -419,8 +513,15 @@ DataOStream& DataOStream::streamDataHeader( DataOStream& os )
     return os;
 }
 
-void DataOStream::sendBody( ConnectionPtr connection, const void* data,
-                            const uint64_t size )
+size_t DataOStream::getNumBodyChunks() const
+{
+    if( _impl->getCompressor() == EQ_COMPRESSOR_NONE )
+        return 1;
+    return 2 * _impl->getNumChunks(); // size header and data of each chunk
+}
+
+void DataOStream::getBody( const void* data, const uint64_t size,
+                           Connection::Chunk* chunks, uint64_t* chunkSizes )
 {
 #ifdef EQ_INSTRUMENT_DATAOSTREAM
     nBytesSent += size;
@@ -429,8 +530,8 @@ void DataOStream::sendBody( ConnectionPtr connection, const void* data,
     const uint32_t compressor = _impl->getCompressor();
     if( compressor == EQ_COMPRESSOR_NONE )
     {
-        if( size > 0 )
-            LBCHECK( connection->send( data, size, true ));
+        chunks[0].data = data;
+        chunks[0].size = size;
         return;
     }
 
@@ -438,25 +539,33 @@ void DataOStream::sendBody( ConnectionPtr connection, const void* data,
     nBytesSent += _impl->buffer.getSize();
 #endif
     const size_t nChunks = _impl->compressor.getResult().chunks.size();
-    uint64_t* chunkSizes = static_cast< uint64_t* >
-                               ( alloca (nChunks * sizeof( uint64_t )));
-    void** chunks = static_cast< void ** >
+    void** compressed = static_cast< void ** >
                                   ( alloca( nChunks * sizeof( void* )));
 
 #ifdef CO_INSTRUMENT_DATAOSTREAM
-    const uint64_t compressedSize = _getCompressedData( chunks, chunkSizes );
+    const uint64_t compressedSize = _getCompressedData( compressed,
+                                                        chunkSizes );
     nBytesSaved += size - compressedSize;
 #else
-    _getCompressedData( chunks, chunkSizes );
+    _getCompressedData( compressed, chunkSizes );
 #endif
 
     for( size_t j = 0; j < nChunks; ++j )
     {
-        LBCHECK( connection->send( &chunkSizes[j], sizeof( uint64_t ), true ));
-        LBCHECK( connection->send( chunks[j], chunkSizes[j], true ));
+        chunks[ 2*j ].data = &chunkSizes[j];
+        chunks[ 2*j ].size = sizeof( uint64_t );
+        chunks[ 2*j + 1 ].data = compressed[j];
+        chunks[ 2*j + 1 ].size = chunkSizes[j];
     }
 }
 
+ConstBufferPtr DataOStream::getBodyOwner() const
+{
+    if( _impl->sendingBlock )
+        return &_impl->blockOwner;
+    return &_impl->bufferOwner;
+}
+
 uint64_t DataOStream::getCompressedDataSize() const
 {
     if( _impl->getCompressor() == EQ_COMPRESSOR_NONE )
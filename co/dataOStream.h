@@ -23,6 +23,7 @@
 #define CO_DATAOSTREAM_H
 
 #include <co/api.h>
+#include <co/connection.h> // Connection::Chunk
 #include <co/types.h>
 
 #include <lunchbox/array.h> // used inline
@@ -68,9 +69,25 @@ public:
     /** @internal Stream the data header (compressor, nChunks). */
     DataOStream& streamDataHeader( DataOStream& os );
 
-    /** @internal Send the (compressed) data using the given connection. */
-    void sendBody( ConnectionPtr connection, const void* data,
-                   const uint64_t dataSize );
+    /** @internal @return the number of chunks filled by getBody(). */
+    size_t getNumBodyChunks() const;
+
+    /**
+     * @internal Set up the chunks to send the (compressed) data.
+     *
+     * @param data the uncompressed data.
+     * @param dataSize the size of the uncompressed data.
+     * @param chunks the getNumBodyChunks() chunks to fill.
+     * @param sizes storage for the size header of each compressed chunk.
+     */
+    void getBody( const void* data, const uint64_t dataSize,
+                  Connection::Chunk* chunks, uint64_t* sizes );
+
+    /**
+     * @internal @return the owner of the body data, referenced by zero-copy
+     *           sends until the data has been transmitted.
+     */
+    ConstBufferPtr getBodyOwner() const;
 
     /** @internal @return the compressed data size, 0 if uncompressed.*/
     uint64_t getCompressedDataSize() const;
@@ -188,6 +205,15 @@ private:
     /** Write a number of bytes from data into the stream. */
     CO_API void _write( const void* data, uint64_t size );
 
+    /**
+     * Write a potentially large block of data.
+     *
+     * Blocks of at least IATTR_OBJECT_ZEROCOPY_SIZE bytes are sent directly
+     * from the given memory, unless the stream is saving its data. The memory
+     * has to stay valid until disable(), which waits for zero-copy sends.
+     */
+    CO_API void _writeBlock( const void* data, uint64_t size );
+
     /** Helper function preparing data for sendData() as needed. */
     void _sendData( const void* data, const uint64_t size );
 
@@ -201,7 +227,7 @@ private:
         const uint64_t nElems = value.size();
         _write( &nElems, sizeof( nElems ));
         if( nElems > 0 )
-            _write( &value.front(), nElems * sizeof( T ));
+            _writeBlock( &value.front(), nElems * sizeof( T ));
         return *this;
     }
 
@@ -220,7 +246,7 @@ private:
     /** Write an Array of POD data */
     template< class T >
     void _writeArray( const Array< T > array, const boost::true_type& )
-    { _write( array.data, array.getNumBytes( )); }
+    { _writeBlock( array.data, array.getNumBytes( )); }
 
     /** Write an Array of non-POD data */
     template< class T >
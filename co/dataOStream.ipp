@@ -56,13 +56,13 @@ void DataOStream::_writeSerializable( const T& object, const boost::true_type& )
 template<> inline void DataOStream::_writeArray( const Array< void > array,
                                                  const boost::false_type& )
 {
-    _write( array.data, array.getNumBytes( ));
+    _writeBlock( array.data, array.getNumBytes( ));
 }
 
 template<> inline void DataOStream::_writeArray( const Array< const void > array,
                                                  const boost::false_type& )
 {
-    _write( array.data, array.getNumBytes( ));
+    _writeBlock( array.data, array.getNumBytes( ));
 }
 
 /** @cond IGNORE */
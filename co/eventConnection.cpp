@@ -18,16 +18,25 @@
  */
 
 #include "eventConnection.h"
-#include "pipeConnection.h"
 
+#include <lunchbox/log.h>
 #include <lunchbox/scopedMutex.h>
 
+#ifdef __linux__
+#  include <errno.h>
+#  include <sys/eventfd.h>
+#  include <unistd.h>
+#endif
+
 namespace co
 {
 
 EventConnection::EventConnection()
 #ifdef _WIN32
         : _event( 0 )
+#elif defined __linux__
+        : _eventFD( -1 )
+        , _set( false )
 #else
         : _set( false )
 #endif
@@ -48,6 +57,16 @@ bool EventConnection::connect()
 
 #ifdef _WIN32
     _event = CreateEvent( 0, TRUE, FALSE, 0 );
+#elif defined __linux__
+    _eventFD = ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if( _eventFD < 0 )
+    {
+        LBERROR << "Could not create eventfd: " << lunchbox::sysError
+                << std::endl;
+        _setState( STATE_CLOSED );
+        return false;
+    }
+    _set = false;
 #else
     _connection = new PipeConnection;
     LBCHECK( _connection->connect( ));
@@ -64,6 +83,11 @@ void EventConnection::_close()
     if( _event )
         CloseHandle( _event );
     _event = 0;
+#elif defined __linux__
+    if( _eventFD >= 0 )
+        ::close( _eventFD );
+    _eventFD = -1;
+    _set = false;
 #else
     ConnectionPtr connection = _connection;
     _connection = 0;
@@ -80,6 +104,18 @@ void EventConnection::set()
 {
 #ifdef _WIN32
     SetEvent( _event );
+#elif defined __linux__
+    lunchbox::ScopedWrite mutex( _lock );
+    if( _set )
+        return;
+
+    const uint64_t value = 1;
+    if( ::write( _eventFD, &value, sizeof( value )) != sizeof( value ))
+    {
+        LBWARN << "eventfd write failed: " << lunchbox::sysError << std::endl;
+        return;
+    }
+    _set = true;
 #else
     lunchbox::ScopedWrite mutex( _lock );
     if( _set )
@@ -94,6 +130,15 @@ void EventConnection::reset()
 {
 #ifdef _WIN32
     ResetEvent( _event );
+#elif defined __linux__
+    lunchbox::ScopedWrite mutex( _lock );
+    if( !_set )
+        return;
+
+    uint64_t value;
+    if( ::read( _eventFD, &value, sizeof( value )) < 0 && errno != EAGAIN )
+        LBWARN << "eventfd read failed: " << lunchbox::sysError << std::endl;
+    _set = false;
 #else
     lunchbox::ScopedWrite mutex( _lock );
     if( !_set )
@@ -112,6 +157,8 @@ Connection::Notifier EventConnection::getNotifier() const
 {
 #ifdef _WIN32
     return _event;
+#elif defined __linux__
+    return _eventFD;
 #else
     return _connection->getNotifier();
 #endif
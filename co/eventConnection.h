@@ -22,8 +22,10 @@
 
 #include <co/connection.h>   // base class
 
-#include "buffer.h"
-#include "pipeConnection.h"
+#ifndef __linux__
+#  include "buffer.h"
+#  include "pipeConnection.h"
+#endif
 
 #include <lunchbox/lock.h>
 
@@ -33,7 +35,8 @@ namespace co
      * A connection signalling an event.
      *
      * The connection is only useful to signal something to a ConnectionSet. No
-     * data can be read or written from it.
+     * data can be read or written from it. On Linux, it is implemented using
+     * an eventfd, on other POSIX systems using a PipeConnection.
      */
     class EventConnection : public Connection
     {
@@ -60,13 +63,16 @@ namespace co
     private:
 #ifdef _WIN32
         void* _event;
+#elif defined __linux__
+        int _eventFD;
+        lunchbox::Lock _lock;
+        bool _set;
 #else
         PipeConnectionPtr _connection;
         lunchbox::Lock _lock;
         bool _set;
-#endif
-
         Buffer _buffer;
+#endif
 
         void _close();
     };
@@ -24,18 +24,396 @@
 #include "global.h"
 #include "log.h"
 
+#include <lunchbox/buffer.h>
 #include <lunchbox/os.h>
 
+#include <algorithm>
 #include <errno.h>
+#include <limits.h>
 #include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#ifdef COLLAGE_USE_LIBURING
+#  include <liburing.h>
+#endif
 
 namespace co
 {
+#ifdef COLLAGE_USE_LIBURING
+namespace
+{
+const unsigned URING_NUM_BUFFERS = 16; // power of two
+const unsigned URING_BUFFER_SIZE = 16384;
+const int URING_BUFFER_GROUP = 0;
+const uint64_t URING_RECV = 0; // user data of the multishot receive
+const uint64_t URING_POLL = 1; // user data of the fallback readiness poll
+
+/**
+ * A ring per thread without submissions. All rings set up by the thread
+ * attach to its kernel workers instead of creating their own.
+ */
+class SharedRing
+{
+public:
+    SharedRing()
+        : _initialized( io_uring_queue_init( 1, &_ring, 0 ) == 0 )
+    {}
+
+    ~SharedRing()
+    {
+        if( _initialized )
+            io_uring_queue_exit( &_ring );
+    }
+
+    int getFD() const { return _initialized ? _ring.ring_fd : -1; }
+
+private:
+    io_uring _ring;
+    const bool _initialized;
+};
+
+int _getSharedRingFD()
+{
+    static thread_local SharedRing ring;
+    return ring.getFD();
+}
+}
+
+namespace detail
+{
+/**
+ * Keeps a multishot receive posted on a socket into a ring of provided
+ * buffers. The ring fd is readable as long as completions are pending, which
+ * makes it usable as a connection notifier: the readiness reported to the
+ * ConnectionSet and the data read are the same completion.
+ *
+ * If the receive can't be re-posted, falls back to recv() on the socket,
+ * keeping a oneshot poll posted so the ring fd stays the notifier.
+ */
+class Uring
+{
+public:
+    explicit Uring( const int fd )
+        : _fd( fd )
+        , _buffers( 0 )
+        , _offset( 0 )
+        , _armed( false )
+        , _polling( false )
+        , _pollPending( false )
+        , _initialized( false )
+    {}
+
+    ~Uring()
+    {
+        if( _buffers )
+            io_uring_free_buf_ring( &_ring, _buffers, URING_NUM_BUFFERS,
+                                    URING_BUFFER_GROUP );
+        if( _initialized )
+            io_uring_queue_exit( &_ring );
+    }
+
+    bool init()
+    {
+        io_uring_params params;
+        ::memset( &params, 0, sizeof( params ));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_NUM_BUFFERS * 2;
+
+        const int sharedFD = _getSharedRingFD();
+        if( sharedFD >= 0 )
+        {
+            params.flags |= IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = sharedFD;
+        }
+
+        int error = io_uring_queue_init_params( 4, &_ring, &params );
+        if( error < 0 && sharedFD >= 0 ) // retry with own workers
+        {
+            params.flags &= ~IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = 0;
+            error = io_uring_queue_init_params( 4, &_ring, &params );
+        }
+        if( error < 0 )
+        {
+            LBINFO << "io_uring setup failed: " << strerror( -error )
+                   << std::endl;
+            return false;
+        }
+        _initialized = true;
+
+        _buffers = io_uring_setup_buf_ring( &_ring, URING_NUM_BUFFERS,
+                                            URING_BUFFER_GROUP, 0, &error );
+        if( !_buffers )
+        {
+            LBINFO << "io_uring buffer ring setup failed: "
+                   << strerror( -error ) << std::endl;
+            return false;
+        }
+
+        _data.resize( URING_NUM_BUFFERS * URING_BUFFER_SIZE );
+        for( unsigned i = 0; i < URING_NUM_BUFFERS; ++i )
+            _recycle( i, i );
+        io_uring_buf_ring_advance( _buffers, URING_NUM_BUFFERS );
+        return _arm();
+    }
+
+    int getFD() const { return _ring.ring_fd; }
+
+    /**
+     * Copy up to bytes of received data into buffer.
+     *
+     * @return the number of bytes copied, 0 on EOF, -ETIME on timeout or a
+     *         negative error code.
+     */
+    int64_t read( uint8_t* buffer, const uint64_t bytes, const int timeout )
+    {
+        if( _polling )
+            return _recv( buffer, bytes, timeout );
+
+        io_uring_cqe* cqe = 0;
+        if( io_uring_peek_cqe( &_ring, &cqe ) != 0 )
+        {
+            if( !_armed && !_rearm( ))
+                return -EIO;
+            if( _polling )
+                return _recv( buffer, bytes, timeout );
+
+            const int result = _wait( &cqe, timeout );
+            if( result < 0 )
+                return result;
+        }
+
+        // Copy as much as is available without entering the kernel
+        uint64_t copied = 0;
+        while( cqe && copied < bytes )
+        {
+            if( cqe->res <= 0 )
+            {
+                if( copied > 0 ) // report EOF or error on next read
+                    break;
+
+                const int result = cqe->res;
+                const bool more = cqe->flags & IORING_CQE_F_MORE;
+                io_uring_cqe_seen( &_ring, cqe );
+                if( !more && !_rearm( ))
+                    return -EIO;
+                if( result == -ENOBUFS ) // all buffers were in use, re-armed
+                    return -EAGAIN;
+                return result;
+            }
+
+            LBASSERT( cqe->flags & IORING_CQE_F_BUFFER );
+            const unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            const uint64_t size = std::min( bytes - copied,
+                                           uint64_t( cqe->res ) - _offset );
+            ::memcpy( buffer + copied,
+                      _data.getData() + id * URING_BUFFER_SIZE + _offset,
+                      size );
+            copied += size;
+            _offset += size;
+
+            if( _offset < unsigned( cqe->res ))
+                break; // keep cqe pending, ring fd stays readable
+
+            _offset = 0;
+            _recycle( id, 0 );
+            io_uring_buf_ring_advance( _buffers, 1 );
+
+            const bool more = cqe->flags & IORING_CQE_F_MORE;
+            io_uring_cqe_seen( &_ring, cqe );
+            if( !more && !_rearm( ))
+                return -EIO;
+            if( _polling )
+                break;
+
+            if( io_uring_peek_cqe( &_ring, &cqe ) != 0 )
+                cqe = 0;
+        }
+        return copied;
+    }
+
+private:
+    const int _fd;
+    io_uring _ring;
+    io_uring_buf_ring* _buffers;
+    lunchbox::Bufferb _data;
+    unsigned _offset; //!< consumed bytes of the first pending completion
+    bool _armed;
+    bool _polling; //!< receive using recv() after a failed re-arm
+    bool _pollPending; //!< the fallback poll has not completed yet
+    bool _initialized;
+
+    int _wait( io_uring_cqe** cqe, const int timeout )
+    {
+        __kernel_timespec time;
+        time.tv_sec = timeout / 1000;
+        time.tv_nsec = ( timeout % 1000 ) * 1000000;
+        return io_uring_wait_cqe_timeout( &_ring, cqe,
+                                          timeout < 0 ? 0 : &time );
+    }
+
+    bool _submit( io_uring_sqe* sqe, const uint64_t userData )
+    {
+        io_uring_sqe_set_data64( sqe, userData );
+        const int result = io_uring_submit( &_ring );
+        if( result >= 0 )
+            return true;
+
+        LBWARN << "io_uring submit failed: " << strerror( -result )
+               << std::endl;
+        return false;
+    }
+
+    bool _arm()
+    {
+        io_uring_sqe* sqe = io_uring_get_sqe( &_ring );
+        if( !sqe )
+            return false;
+
+        io_uring_prep_recv_multishot( sqe, _fd, 0, 0, 0 );
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        if( !_submit( sqe, URING_RECV ))
+            return false;
+        _armed = true;
+        return true;
+    }
+
+    /** Post a oneshot poll, completing at once if data is readable. */
+    bool _poll()
+    {
+        if( _pollPending )
+            return true;
+
+        io_uring_sqe* sqe = io_uring_get_sqe( &_ring );
+        if( !sqe )
+            return false;
+
+        io_uring_prep_poll_add( sqe, _fd, POLLIN );
+        if( !_submit( sqe, URING_POLL ))
+            return false;
+        _pollPending = true;
+        return true;
+    }
+
+    /**
+     * Re-post the terminated multishot receive, or fall back to recv().
+     * @return false if neither is possible.
+     */
+    bool _rearm()
+    {
+        _armed = false;
+        if( _arm( ))
+            return true;
+
+        LBWARN << "io_uring receive re-arm failed, falling back to recv"
+               << std::endl;
+        _polling = true;
+        return _poll();
+    }
+
+    /** Reap the completions of the fallback poll. */
+    void _reap()
+    {
+        io_uring_cqe* cqe = 0;
+        while( io_uring_peek_cqe( &_ring, &cqe ) == 0 )
+        {
+            if( io_uring_cqe_get_data64( cqe ) == URING_POLL )
+                _pollPending = false;
+            io_uring_cqe_seen( &_ring, cqe );
+        }
+    }
+
+    int64_t _recv( uint8_t* buffer, const uint64_t bytes, const int timeout )
+    {
+        for( ;; )
+        {
+            _reap();
+            const ssize_t result = ::recv( _fd, buffer, bytes, MSG_DONTWAIT );
+            const int error = errno;
+
+            // re-post, completes at once and keeps the notifier readable if
+            // data is left after this read
+            if( !_poll( ))
+                return -EIO;
+
+            if( result >= 0 )
+                return result;
+            if( error != EAGAIN && error != EWOULDBLOCK )
+                return -error;
+
+            io_uring_cqe* cqe = 0;
+            const int waited = _wait( &cqe, timeout );
+            if( waited < 0 )
+                return waited;
+        }
+    }
+
+    void _recycle( const unsigned id, const int offset )
+    {
+        io_uring_buf_ring_add( _buffers,
+                               _data.getData() + id * URING_BUFFER_SIZE,
+                               URING_BUFFER_SIZE, id,
+                               io_uring_buf_ring_mask( URING_NUM_BUFFERS ),
+                               offset );
+    }
+};
+}
+#else
+namespace detail { class Uring {}; }
+#endif
+
 FDConnection::FDConnection()
         : _readFD( 0 ),
-          _writeFD( 0 )
+          _writeFD( 0 ),
+          _uring( 0 )
 {}
 
+FDConnection::~FDConnection()
+{
+    _exitUring();
+}
+
+void FDConnection::abortSends()
+{
+    // wakes up a write polling the socket, fails with ENOTSOCK on pipes
+    if( _writeFD > 0 )
+        ::shutdown( _writeFD, SHUT_WR );
+}
+
+Connection::Notifier FDConnection::getNotifier() const
+{
+#ifdef COLLAGE_USE_LIBURING
+    if( _uring )
+        return _uring->getFD();
+#endif
+    return _readFD;
+}
+
+void FDConnection::_initUring()
+{
+#ifdef COLLAGE_USE_LIBURING
+    LBASSERT( !_uring );
+    if( !Global::getIAttribute( Global::IATTR_TCP_URING ))
+        return;
+
+    _uring = new detail::Uring( _readFD );
+    if( _uring->init( ))
+        return;
+
+    LBINFO << "io_uring not supported, using read on " << this << std::endl;
+    _exitUring();
+#endif
+}
+
+void FDConnection::_exitUring()
+{
+    delete _uring;
+    _uring = 0;
+}
+
 int FDConnection::_getTimeOut()
 {
     const uint32_t timeout = Global::getTimeout();
@@ -50,6 +428,11 @@ int64_t FDConnection::readSync( void* buffer, const uint64_t bytes, const bool )
     if( _readFD < 1 )
         return -1;
 
+#ifdef COLLAGE_USE_LIBURING
+    if( _uring )
+        return _readUring( buffer, bytes );
+#endif
+
     ssize_t bytesRead = ::read( _readFD, buffer, bytes );
     if( bytesRead > 0 )
         return bytesRead;
@@ -94,15 +477,61 @@ int64_t FDConnection::readSync( void* buffer, const uint64_t bytes, const bool )
     return -1;
 }
 
+#ifdef COLLAGE_USE_LIBURING
+int64_t FDConnection::_readUring( void* buffer, const uint64_t bytes )
+{
+    const int64_t bytesRead = _uring->read( static_cast< uint8_t* >( buffer ),
+                                            bytes, _getTimeOut( ));
+    if( bytesRead > 0 )
+        return bytesRead;
+
+    switch( bytesRead )
+    {
+    case 0: // EOF
+        LBDEBUG << "Got EOF, closing " << getDescription()->toString()
+                << std::endl;
+        close();
+        return -1;
+
+    case -ETIME:
+        throw Exception( Exception::TIMEOUT_READ );
+
+    case -EINTR: // if interrupted, try again
+    case -EAGAIN:
+        return 0;
+
+    default:
+        LBWARN << "Error during read: " << strerror( -bytesRead ) << ", "
+               << bytes << "b on fd " << _readFD << std::endl;
+        return -1;
+    }
+}
+#endif
+
 //----------------------------------------------------------------------
 // write
 //----------------------------------------------------------------------
 int64_t FDConnection::write( const void* buffer, const uint64_t bytes )
+{
+    const Chunk chunk = { buffer, bytes };
+    return writev( &chunk, 1 );
+}
+
+int64_t FDConnection::writev( const Chunk* chunks, const size_t nChunks )
 {
     if( !isConnected() || _writeFD < 1 )
         return -1;
 
-    ssize_t bytesWritten = ::write( _writeFD, buffer, bytes );
+    struct iovec vectors[ 64 ];
+    const int nVectors = int( LB_MIN( LB_MIN( nChunks, size_t( 64 )),
+                                      size_t( IOV_MAX )));
+    for( int i = 0; i < nVectors; ++i )
+    {
+        vectors[i].iov_base = const_cast< void* >( chunks[i].data );
+        vectors[i].iov_len = chunks[i].size;
+    }
+
+    ssize_t bytesWritten = ::writev( _writeFD, vectors, nVectors );
     if( bytesWritten > 0 )
         return bytesWritten;
 
@@ -121,7 +550,7 @@ int64_t FDConnection::write( const void* buffer, const uint64_t bytes )
         if( res == 0)
             throw Exception( Exception::TIMEOUT_WRITE );
 
-        bytesWritten = ::write( _writeFD, buffer, bytes );
+        bytesWritten = ::writev( _writeFD, vectors, nVectors );
     }
 
     if( bytesWritten > 0 )
@@ -24,30 +24,45 @@
 
 namespace co
 {
+namespace detail { class Uring; }
 
 /** A generic file descriptor-based connection, to be subclassed. */
 class FDConnection : public Connection
 {
 public:
-    Notifier getNotifier() const final { return _readFD; }
+    Notifier getNotifier() const final;
+    void abortSends() override;
 
 protected:
     FDConnection();
-    virtual ~FDConnection() {}
+    virtual ~FDConnection();
 
     void readNB( void*, const uint64_t ) override { /* NOP */ }
     int64_t readSync( void* buffer, const uint64_t bytes,
                       const bool ignored ) override;
     int64_t write( const void* buffer,
                    const uint64_t bytes ) override;
+    int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
 
     int   _readFD;     //!< The read file descriptor.
     int   _writeFD;    //!< The write file descriptor.
 
+    /**
+     * Receive from _readFD using io_uring multishot receives, if supported.
+     *
+     * Needs to be called before the connection is marked connected, since it
+     * changes the notifier.
+     */
+    void _initUring();
+    void _exitUring(); //!< Stop receiving using io_uring
+
     friend inline std::ostream& operator << ( std::ostream& os,
                                               const FDConnection* connection );
 private:
+    detail::Uring* _uring;
+
     int _getTimeOut();
+    int64_t _readUring( void* buffer, const uint64_t bytes );
 
 };
 
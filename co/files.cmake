@@ -66,6 +66,7 @@ set(COLLAGE_HEADERS
   eventConnection.h
   fullMasterCM.h
   instanceCache.h
+  localConnection.h
   masterCMCommand.h
   nodeCommand.h
   nullCM.h
@@ -80,6 +81,7 @@ set(COLLAGE_HEADERS
   objectSlaveDataOStream.h
   objectStore.h
   pipeConnection.h
+  pooled.h
   queueCommand.h
   rspConnection.h
   socketConnection.h
@@ -114,6 +116,7 @@ set(COLLAGE_SOURCES
   iCommand.cpp
   init.cpp
   instanceCache.cpp
+  localConnection.cpp
   localNode.cpp
   masterCMCommand.cpp
   node.cpp
@@ -153,8 +156,8 @@ if(WIN32)
   list(APPEND COLLAGE_HEADERS namedPipeConnection.h)
   list(APPEND COLLAGE_SOURCES namedPipeConnection.cpp)
 else()
-  list(APPEND COLLAGE_HEADERS fdConnection.h)
-  list(APPEND COLLAGE_SOURCES fdConnection.cpp)
+  list(APPEND COLLAGE_HEADERS fdConnection.h unixConnection.h)
+  list(APPEND COLLAGE_SOURCES fdConnection.cpp unixConnection.cpp)
 endif()
 
 if(OFED_FOUND)
@@ -162,6 +165,13 @@ if(OFED_FOUND)
   list(APPEND COLLAGE_SOURCES rdmaConnection.cpp)
 endif()
 
+if(LINUX)
+  list(APPEND COLLAGE_HEADERS compressedConnection.h shmConnection.h
+    stripedConnection.h)
+  list(APPEND COLLAGE_SOURCES compressedConnection.cpp shmConnection.cpp
+    stripedConnection.cpp)
+endif()
+
 if(UDT_FOUND)
   list(APPEND COLLAGE_HEADERS udtConnection.h)
   list(APPEND COLLAGE_SOURCES udtConnection.cpp)
@@ -95,6 +95,21 @@ int32_t     _iAttributes[Global::IATTR_ALL] =
     _getTimeout(), // IATTR_TIMEOUT_DEFAULT
     1023,   // IATTR_OBJECT_COMPRESSION
     0,      // IATTR_CMD_QUEUE_LIMIT
+    1,      // IATTR_CONNECTIONSET_EPOLL
+    0,      // IATTR_RECEIVER_THREADS
+    0,      // IATTR_TCP_URING
+    65536,  // IATTR_RECEIVE_BUFFER_SIZE
+    0,      // IATTR_COMMAND_THREADS
+    1048576, // IATTR_OBJECT_ZEROCOPY_SIZE
+    0,      // IATTR_TCP_ZEROCOPY_SIZE
+    4194304, // IATTR_SHM_RING_SIZE
+    2097152, // IATTR_PIPE_SPLICE_SIZE
+    0,      // IATTR_SEND_COALESCE_SIZE
+    1,      // IATTR_SEND_COALESCE_TIME
+    262144, // IATTR_TCP_STRIPE_SIZE
+    0,      // IATTR_SEND_QUEUE_SIZE
+    1023,   // IATTR_CONNECTION_COMPRESSION
+    32,     // IATTR_RSP_BATCH_SIZE
 };
 }
 
@@ -102,6 +102,21 @@ namespace co
             IATTR_TIMEOUT_DEFAULT,       //!< @internal default timeout
             IATTR_OBJECT_COMPRESSION,    //!< @internal threshold to compress
             IATTR_CMD_QUEUE_LIMIT,     //!< @internal max cmd thread q size/1024
+            IATTR_CONNECTIONSET_EPOLL, //!< @internal use epoll on Linux
+            IATTR_RECEIVER_THREADS,    //!< @internal additional receivers
+            IATTR_TCP_URING,           //!< @internal io_uring TCP receives
+            IATTR_RECEIVE_BUFFER_SIZE, //!< @internal bulk read staging size
+            IATTR_COMMAND_THREADS,     //!< @internal additional cmd workers
+            IATTR_OBJECT_ZEROCOPY_SIZE, //!< @internal min size to send directly
+            IATTR_TCP_ZEROCOPY_SIZE,   //!< @internal min size for MSG_ZEROCOPY
+            IATTR_SHM_RING_SIZE,       //!< @internal shared memory ring size
+            IATTR_PIPE_SPLICE_SIZE,    //!< @internal min size for vmsplice
+            IATTR_SEND_COALESCE_SIZE,  //!< @internal node send buffer size
+            IATTR_SEND_COALESCE_TIME,  //!< @internal max send buffer time, ms
+            IATTR_TCP_STRIPE_SIZE,     //!< @internal striped piece size
+            IATTR_SEND_QUEUE_SIZE,     //!< @internal async node send budget
+            IATTR_CONNECTION_COMPRESSION, //!< @internal min compressed send
+            IATTR_RSP_BATCH_SIZE,      //!< @internal datagrams per syscall
             IATTR_ALL
         };
 
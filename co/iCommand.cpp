@@ -23,29 +23,33 @@
 #include "buffer.h"
 #include "localNode.h"
 #include "node.h"
+#include "pooled.h"
 #include <pression/plugins/compressorTypes.h>
 
 namespace co
 {
 namespace detail
 {
-class ICommand
+class ICommand : public Pooled< ICommand >
 {
 public:
     ICommand()
         : func( 0, 0 )
         , buffer( 0 )
+        , offset( 0 )
         , size( 0 )
         , type( COMMANDTYPE_INVALID )
         , cmd( CMD_INVALID )
         , consumed( false )
     {}
 
-    ICommand( LocalNodePtr local_, NodePtr remote_, ConstBufferPtr buffer_ )
+    ICommand( LocalNodePtr local_, NodePtr remote_, ConstBufferPtr buffer_,
+              const uint64_t offset_ )
         : local( local_ )
         , remote( remote_ )
         , func( 0, 0 )
         , buffer( buffer_ )
+        , offset( offset_ )
         , size( 0 )
         , type( COMMANDTYPE_INVALID )
         , cmd( CMD_INVALID )
@@ -61,6 +65,7 @@ public:
     NodePtr remote; //!< The node sending the command
     co::Dispatcher::Func func;
     ConstBufferPtr buffer;
+    uint64_t offset; //!< start of the command within buffer
     uint64_t size;
     uint32_t type;
     uint32_t cmd;
@@ -77,11 +82,25 @@ ICommand::ICommand()
 ICommand::ICommand( LocalNodePtr local, NodePtr remote, ConstBufferPtr buffer,
                     const bool swap_ )
     : DataIStream( swap_ )
-    , _impl( new detail::ICommand( local, remote, buffer ))
+    , _impl( new detail::ICommand( local, remote, buffer, 0 ))
+{
+    _readHeader();
+}
+
+ICommand::ICommand( LocalNodePtr local, NodePtr remote, ConstBufferPtr buffer,
+                    const uint64_t offset, const bool swap_ )
+    : DataIStream( swap_ )
+    , _impl( new detail::ICommand( local, remote, buffer, offset ))
+{
+    _readHeader();
+}
+
+void ICommand::_readHeader()
 {
     if( _impl->buffer )
     {
-        LBASSERT( buffer->getSize() >= sizeof( _impl->size ) +
+        LBASSERT( _impl->buffer->getSize() >= _impl->offset +
+                  sizeof( _impl->size ) +
                   sizeof( _impl->type ) + sizeof( _impl->cmd ));
 
         *this >> _impl->size >> _impl->type >> _impl->cmd;
@@ -162,6 +181,11 @@ ConstBufferPtr ICommand::getBuffer() const
     return _impl->buffer;
 }
 
+uint64_t ICommand::getOffset() const
+{
+    return _impl->offset;
+}
+
 size_t ICommand::nRemainingBuffers() const
 {
     return _impl->buffer ? 1 : 0;
@@ -182,7 +206,7 @@ bool ICommand::getNextBuffer( uint32_t& compressor, uint32_t& nChunks,
         return false;
 
     _impl->consumed = true;
-    *chunkData = _impl->buffer->getData();
+    *chunkData = _impl->buffer->getData() + _impl->offset;
     size = reinterpret_cast< const uint64_t* >( *chunkData )[ 0 ];
     compressor = EQ_COMPRESSOR_NONE;
     nChunks = 1;
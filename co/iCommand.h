@@ -46,6 +46,10 @@ public:
     CO_API ICommand(); //!< @internal
     CO_API ICommand( LocalNodePtr local, NodePtr remote,
                      ConstBufferPtr buffer, const bool swap ); //!<@internal
+
+    /** @internal Construct a command starting at offset in buffer. */
+    CO_API ICommand( LocalNodePtr local, NodePtr remote, ConstBufferPtr buffer,
+                     const uint64_t offset, const bool swap );
     CO_API ICommand( const ICommand& rhs ); //!< @internal
 
     CO_API virtual ~ICommand(); //!< @internal
@@ -82,6 +86,9 @@ public:
 
     /** @internal @return the buffer */
     CO_API ConstBufferPtr getBuffer() const;
+
+    /** @internal @return the start of the command in the buffer. */
+    CO_API uint64_t getOffset() const;
     //@}
 
     /** @internal @name Command dispatch */
@@ -112,6 +119,7 @@ private:
                                uint64_t& ) override;
     //@}
 
+    void _readHeader(); //!< @internal
     void _skipHeader(); //!< @internal
 };
 
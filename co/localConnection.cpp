@@ -0,0 +1,537 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "localConnection.h"
+
+#include "buffer.h"
+#include "bufferListener.h"
+#include "commands.h"
+#include "connectionDescription.h"
+#include "exception.h"
+#include "global.h"
+
+#include <lunchbox/atomic.h>
+#include <lunchbox/log.h>
+#include <lunchbox/referenced.h>
+#include <lunchbox/scopedMutex.h>
+#include <lunchbox/spinLock.h>
+
+#include <atomic>
+#include <errno.h>
+#include <vector>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#  ifdef __linux__
+#    include <sys/eventfd.h>
+#  endif
+#endif
+
+namespace co
+{
+namespace detail
+{
+/** A level-triggered event usable as a Connection::Notifier. */
+class Event
+{
+public:
+    Event()
+#ifdef _WIN32
+        : _event( CreateEvent( 0, TRUE, FALSE, 0 ))
+#elif defined __linux__
+        : _fd( ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ))
+#endif
+    {
+#ifdef _WIN32
+        if( !_event )
+            LBERROR << "CreateEvent failed: " << lunchbox::sysError
+                    << std::endl;
+#elif defined __linux__
+        if( _fd < 0 )
+            LBERROR << "eventfd failed: " << lunchbox::sysError << std::endl;
+#else
+        if( ::pipe( _fds ) == -1 )
+        {
+            LBERROR << "pipe failed: " << lunchbox::sysError << std::endl;
+            _fds[0] = _fds[1] = -1;
+        }
+        else
+        {
+            ::fcntl( _fds[0], F_SETFL, O_NONBLOCK );
+            ::fcntl( _fds[1], F_SETFL, O_NONBLOCK );
+        }
+#endif
+    }
+
+    ~Event()
+    {
+#ifdef _WIN32
+        if( _event )
+            CloseHandle( _event );
+#elif defined __linux__
+        if( _fd >= 0 )
+            ::close( _fd );
+#else
+        if( _fds[0] >= 0 )
+            ::close( _fds[0] );
+        if( _fds[1] >= 0 )
+            ::close( _fds[1] );
+#endif
+    }
+
+    bool isValid() const
+    {
+#ifdef _WIN32
+        return _event != 0;
+#else
+        return getNotifier() >= 0;
+#endif
+    }
+
+    Connection::Notifier getNotifier() const
+    {
+#ifdef _WIN32
+        return _event;
+#elif defined __linux__
+        return _fd;
+#else
+        return _fds[0];
+#endif
+    }
+
+    void set()
+    {
+#ifdef _WIN32
+        SetEvent( _event );
+#elif defined __linux__
+        const uint64_t value = 1;
+        if( ::write( _fd, &value, sizeof( value )) != sizeof( value ))
+            LBWARN << "eventfd write failed: " << lunchbox::sysError
+                   << std::endl;
+#else
+        const char c = 42;
+        if( ::write( _fds[1], &c, 1 ) != 1 && errno != EAGAIN )
+            LBWARN << "pipe write failed: " << lunchbox::sysError << std::endl;
+#endif
+    }
+
+    void reset()
+    {
+#ifdef _WIN32
+        ResetEvent( _event );
+#elif defined __linux__
+        uint64_t value;
+        if( ::read( _fd, &value, sizeof( value )) < 0 && errno != EAGAIN )
+            LBWARN << "eventfd read failed: " << lunchbox::sysError
+                   << std::endl;
+#else
+        char buffer[ 64 ];
+        while( ::read( _fds[0], buffer, sizeof( buffer )) > 0 )
+            /* nop */ ;
+#endif
+    }
+
+    /** @return false on timeout, true if the event is set. */
+    bool wait( const uint32_t timeout )
+    {
+#ifdef _WIN32
+        return WaitForSingleObject( _event, timeout ) == WAIT_OBJECT_0;
+#else
+        struct pollfd fds[1];
+        fds[0].fd = getNotifier();
+        fds[0].events = POLLIN;
+        const int ms = timeout == LB_TIMEOUT_INDEFINITE ? -1 : int( timeout );
+        const int result = ::poll( fds, 1, ms );
+        if( result >= 0 )
+            return result > 0;
+        if( errno == EINTR ) // spurious wakeup, caller reads again
+            return true;
+
+        LBWARN << "poll failed: " << lunchbox::sysError << std::endl;
+        return false;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE _event;
+#elif defined __linux__
+    int _fd;
+#else
+    int _fds[2];
+#endif
+};
+
+/**
+ * Allocates the buffers sent over a channel.
+ *
+ * Received buffers are handed out as a whole and may be referenced by commands
+ * well after the connection is gone. Each used buffer holds a reference to its
+ * allocator, which therefore lives until all its buffers have been released.
+ */
+class Buffers : public BufferListener, public lunchbox::Referenced
+{
+public:
+    BufferPtr alloc( const uint64_t size )
+    {
+        co::Buffer* buffer = 0;
+        {
+            lunchbox::ScopedFastWrite mutex( _lock );
+            if( !_free.empty( ))
+            {
+                buffer = _free.back();
+                _free.pop_back();
+            }
+        }
+        if( !buffer )
+            buffer = new co::Buffer( this );
+
+        ref(); // released by notifyFree
+        buffer->setUsed();
+        buffer->reserve( size );
+        buffer->resize( 0 );
+        return buffer;
+    }
+
+protected:
+    virtual ~Buffers()
+    {
+        for( co::Buffer* buffer : _free )
+            delete buffer;
+    }
+
+private:
+    static const size_t _maxFree = 8;
+    static const uint64_t _maxFreeSize = LB_1MB;
+
+    std::vector< co::Buffer* > _free;
+    lunchbox::SpinLock _lock; //!< protects _free
+
+    void notifyFree( co::Buffer* buffer ) override
+    {
+        if( buffer->getMaxSize() <= _maxFreeSize )
+        {
+            lunchbox::ScopedFastWrite mutex( _lock );
+            if( _free.size() < _maxFree )
+            {
+                _free.push_back( buffer );
+                buffer = 0;
+            }
+        }
+        delete buffer;
+        unref(); // may delete this
+    }
+};
+
+typedef lunchbox::RefPtr< Buffers > BuffersPtr;
+
+/**
+ * One direction of a local connection.
+ *
+ * Buffers are passed through a lock-free multi-producer, single-consumer
+ * queue. The event is set while the queue holds buffers.
+ */
+class Channel : public lunchbox::Referenced
+{
+public:
+    Channel()
+        : buffers( new Buffers )
+        , _head( new Node )
+        , _tail( _head.load( ))
+        , _size( 0 )
+        , _closed( false )
+    {}
+
+    /** Queue a buffer for the consumer, may be called from any thread. */
+    void push( BufferPtr buffer )
+    {
+        // count first so that the count never lags behind the queued buffers
+        if( ++_size == 1 )
+            event.set();
+
+        Node* node = new Node( buffer );
+        Node* previous = _head.exchange( node, std::memory_order_acq_rel );
+        previous->next.store( node, std::memory_order_release );
+    }
+
+    /** @return the oldest buffer, or 0 if none is available yet. */
+    BufferPtr pop()
+    {
+        Node* next = _tail->next.load( std::memory_order_acquire );
+        if( !next )
+            return BufferPtr();
+
+        BufferPtr buffer = next->buffer;
+        next->buffer = 0;
+        delete _tail;
+        _tail = next;
+        return buffer;
+    }
+
+    /** Account for a popped buffer, resetting the event when drained. */
+    void consumed()
+    {
+        if( --_size > 0 )
+            return;
+
+        event.reset();
+        if( _size > 0 ) // raced with a producer
+            event.set();
+    }
+
+    void close()
+    {
+        _closed = true;
+        event.set();
+    }
+
+    bool isClosed() const { return _closed; }
+
+    /** The producer's buffers, outliving the channel while in use. */
+    const BuffersPtr buffers;
+
+    Event event;
+
+protected:
+    virtual ~Channel()
+    {
+        while( pop( ))
+            /* nop */ ;
+        delete _tail;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next( 0 ) {}
+        explicit Node( BufferPtr buffer_ ) : buffer( buffer_ ), next( 0 ) {}
+
+        BufferPtr buffer;
+        std::atomic< Node* > next;
+    };
+
+    std::atomic< Node* > _head; //!< last pushed node, producers
+    Node* _tail; //!< already consumed stub node, consumer only
+    lunchbox::a_int32_t _size;
+    std::atomic< bool > _closed;
+};
+
+typedef lunchbox::RefPtr< Channel > ChannelPtr;
+
+class LocalConnection
+{
+public:
+    LocalConnection() : offset( 0 ) {}
+
+    co::LocalConnectionPtr sibling;
+    ChannelPtr in; //!< data sent by the sibling
+    ChannelPtr out; //!< data sent to the sibling
+
+    BufferPtr current; //!< the partially read buffer
+    uint64_t offset; //!< read position in current
+};
+}
+
+LocalConnection::LocalConnection()
+    : _impl( new detail::LocalConnection )
+{
+    ConnectionDescriptionPtr description = _getDescription();
+    description->type = CONNECTIONTYPE_PIPE;
+    description->bandwidth = 1024000;
+}
+
+LocalConnection::~LocalConnection()
+{
+    _close();
+    delete _impl;
+}
+
+bool LocalConnection::connect()
+{
+    LBASSERT( getDescription()->type == CONNECTIONTYPE_PIPE );
+
+    if( !isClosed( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    detail::ChannelPtr in = new detail::Channel;
+    detail::ChannelPtr out = new detail::Channel;
+    if( !in->event.isValid() || !out->event.isValid( ))
+    {
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    LocalConnectionPtr sibling = new LocalConnection;
+    _impl->in = in;
+    _impl->out = out;
+    _impl->sibling = sibling;
+    sibling->_impl->in = out;
+    sibling->_impl->out = in;
+    sibling->_impl->sibling = this;
+
+    _setState( STATE_CONNECTED );
+    sibling->_setState( STATE_CONNECTED );
+    return true;
+}
+
+void LocalConnection::_close()
+{
+    if( isClosed( ))
+        return;
+
+    if( _impl->out )
+        _impl->out->close();
+    if( _impl->in )
+        _impl->in->close();
+
+    _impl->current = 0;
+    _impl->sibling = 0;
+    _setState( STATE_CLOSED );
+}
+
+ConnectionPtr LocalConnection::acceptSync()
+{
+    return _impl->sibling;
+}
+
+LocalConnectionPtr LocalConnection::getSibling()
+{
+    return _impl->sibling;
+}
+
+Connection::Notifier LocalConnection::getNotifier() const
+{
+    if( !_impl->in )
+        return Notifier( -1 );
+    return _impl->in->event.getNotifier();
+}
+
+//----------------------------------------------------------------------
+// read
+//----------------------------------------------------------------------
+BufferPtr LocalConnection::readBuffer( const uint64_t minBytes,
+                                       const uint64_t maxBytes )
+{
+    if( !_impl->in )
+        return BufferPtr();
+
+    if( !_impl->current )
+    {
+        _impl->current = _impl->in->pop();
+        _impl->offset = 0;
+    }
+
+    if( !_impl->current || _impl->offset > 0 )
+        return BufferPtr();
+
+    const uint64_t size = _impl->current->getSize();
+    if( size < minBytes || size > maxBytes )
+        return BufferPtr();
+
+    BufferPtr buffer = _impl->current;
+    _impl->current = 0;
+    _impl->in->consumed();
+    return buffer;
+}
+
+int64_t LocalConnection::readSync( void* buffer, const uint64_t bytes,
+                                   const bool block )
+{
+    if( !_impl->in )
+        return -1;
+
+    detail::Channel& in = *_impl->in;
+    uint8_t* ptr = static_cast< uint8_t* >( buffer );
+    uint64_t read = 0;
+
+    while( read < bytes )
+    {
+        if( !_impl->current )
+        {
+            _impl->current = in.pop();
+            _impl->offset = 0;
+            if( !_impl->current )
+                break;
+        }
+
+        const uint64_t size = _impl->current->getSize();
+        const uint64_t nBytes = LB_MIN( size - _impl->offset, bytes - read );
+        ::memcpy( ptr + read, _impl->current->getData() + _impl->offset,
+                  nBytes );
+        read += nBytes;
+        _impl->offset += nBytes;
+
+        if( _impl->offset == size )
+        {
+            _impl->current = 0;
+            in.consumed();
+        }
+    }
+
+    if( read > 0 )
+        return read;
+
+    if( in.isClosed( ))
+    {
+        LBDEBUG << "Got EOF, closing " << getDescription()->toString()
+                << std::endl;
+        close();
+        return -1;
+    }
+
+    if( block && !in.event.wait( Global::getTimeout( )))
+        throw Exception( Exception::TIMEOUT_READ );
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// write
+//----------------------------------------------------------------------
+int64_t LocalConnection::write( const void* buffer, const uint64_t bytes )
+{
+    const Chunk chunk = { buffer, bytes };
+    return writev( &chunk, 1 );
+}
+
+int64_t LocalConnection::writev( const Chunk* chunks, const size_t nChunks )
+{
+    detail::ChannelPtr out = _impl->out;
+    if( !isConnected() || !out || out->isClosed( ))
+        return -1;
+
+    // gather into one buffer, which the receiver can use as a whole
+    uint64_t bytes = 0;
+    for( size_t i = 0; i < nChunks; ++i )
+        bytes += chunks[i].size;
+
+    BufferPtr data = out->buffers->alloc( LB_MAX( bytes,
+                                                 uint64_t( COMMAND_ALLOCSIZE )));
+    for( size_t i = 0; i < nChunks; ++i )
+        data->append( static_cast< const uint8_t* >( chunks[i].data ),
+                      chunks[i].size );
+    out->push( data );
+    return bytes;
+}
+
+}
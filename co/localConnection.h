@@ -0,0 +1,78 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CO_LOCALCONNECTION_H
+#define CO_LOCALCONNECTION_H
+
+#include <co/connection.h> // base class
+
+namespace co
+{
+namespace detail { class LocalConnection; }
+
+class LocalConnection;
+typedef lunchbox::RefPtr< LocalConnection > LocalConnectionPtr;
+
+/**
+ * An in-process, bi-directional connection between threads.
+ *
+ * Like the PipeConnection, it consists of a pair of siblings representing the
+ * two endpoints. Sent data is stored in buffers which are handed over to the
+ * sibling using a lock-free queue, without passing through the kernel. The
+ * receiver uses these buffers directly whenever a receive can be completed
+ * with a whole buffer. Pending data is signalled using an eventfd on Linux.
+ */
+class LocalConnection : public Connection
+{
+public:
+    /** Construct a new local connection. */
+    LocalConnection();
+
+    /** Destruct this local connection. */
+    virtual ~LocalConnection();
+
+    bool connect() override;
+    void close() override { _close(); }
+
+    void acceptNB() override { /* nop */ }
+
+    /** @return the sibling of this local connection. */
+    ConnectionPtr acceptSync() override;
+
+    /** @return the sibling connection. */
+    LocalConnectionPtr getSibling();
+
+    Notifier getNotifier() const override;
+
+protected:
+    void readNB( void*, const uint64_t ) override { /* nop */ }
+    int64_t readSync( void* buffer, const uint64_t bytes,
+                      const bool block ) override;
+    BufferPtr readBuffer( const uint64_t minBytes,
+                          const uint64_t maxBytes ) override;
+    int64_t write( const void* buffer, const uint64_t bytes ) override;
+    int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
+
+private:
+    detail::LocalConnection* const _impl;
+
+    void _close();
+};
+}
+
+#endif //CO_LOCALCONNECTION_H
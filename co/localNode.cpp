@@ -25,28 +25,31 @@
 #include "bufferCache.h"
 #include "commandQueue.h"
 #include "connectionDescription.h"
+#include "connectionListener.h"
 #include "connectionSet.h"
 #include "customICommand.h"
 #include "dataIStream.h"
 #include "exception.h"
 #include "global.h"
 #include "iCommand.h"
+#include "localConnection.h"
 #include "nodeCommand.h"
 #include "oCommand.h"
 #include "object.h"
 #include "objectICommand.h"
 #include "objectStore.h"
-#include "pipeConnection.h"
 #include "sendToken.h"
-#include "worker.h"
+#include "worker.ipp" // WorkerThread< CommandThreadQueue >
 #include "zeroconf.h"
 
 #include <lunchbox/clock.h>
 #include <lunchbox/futureFunction.h>
 #include <lunchbox/hash.h>
 #include <lunchbox/lockable.h>
+#include <lunchbox/mtQueue.h>
 #include <lunchbox/request.h>
 #include <lunchbox/rng.h>
+#include <lunchbox/scopedMutex.h>
 #include <lunchbox/servus.h>
 #include <lunchbox/sleep.h>
 
@@ -54,7 +57,12 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
+#include <deque>
 #include <list>
+#ifdef __linux__
+#  include <unistd.h>
+#endif
 
 namespace bp = boost::posix_time;
 
@@ -66,6 +74,9 @@ lunchbox::a_int32_t _threadIDs;
 
 typedef CommandFunc< LocalNode > CmdFunc;
 typedef std::list< ICommand > CommandList;
+typedef std::deque< ICommand > CommandDeque;
+typedef stde::hash_map< uint128_t, CommandDeque > ObjectCommandsHash;
+typedef ObjectCommandsHash::iterator ObjectCommandsHashIter;
 typedef lunchbox::RefPtrHash< Connection, NodePtr > ConnectionNodeHash;
 typedef ConnectionNodeHash::const_iterator ConnectionNodeHashCIter;
 typedef ConnectionNodeHash::iterator ConnectionNodeHashIter;
@@ -77,10 +88,253 @@ typedef std::pair< LocalNode::CommandHandler, CommandQueue* > CommandPair;
 typedef stde::hash_map< uint128_t, CommandPair > CommandHash;
 typedef CommandHash::const_iterator CommandHashCIter;
 typedef lunchbox::FutureFunction< bool > FuturebImpl;
+
+/** @return the size of the staging buffers receiving from connections. */
+uint64_t _getReceiveBufferSize()
+{
+    const int32_t size =
+        Global::getIAttribute( Global::IATTR_RECEIVE_BUFFER_SIZE );
+    return size > int32_t( COMMAND_ALLOCSIZE ) ? size : COMMAND_ALLOCSIZE;
+}
+
+#ifdef __linux__
+std::string _getHostname()
+{
+    char name[ 256 ] = { 0 };
+    if( ::gethostname( name, sizeof( name ) - 1 ) != 0 )
+        return std::string();
+    return name;
+}
+#endif
+
+/** @return true for a shared memory connection to a node on this host. */
+bool _isLocalSHM( const ConnectionDescriptionPtr& description )
+{
+#ifdef __linux__
+    static const std::string hostname = _getHostname();
+    return description->type == CONNECTIONTYPE_SHM && !hostname.empty() &&
+           description->getHostname() == hostname;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Enable send coalescing and queueing on a node connection, if configured.
+ * The flusher gets notified about coalesced sends to bound their delay.
+ */
+void _setupSends( ConnectionPtr connection, ConnectionListener* flusher )
+{
+    if( connection->isMulticast( ))
+        return;
+
+    const int32_t size =
+        Global::getIAttribute( Global::IATTR_SEND_COALESCE_SIZE );
+    const int32_t time =
+        Global::getIAttribute( Global::IATTR_SEND_COALESCE_TIME );
+    if( size > 0 )
+    {
+        if( time > 0 ) // before enabling, senders notify it under the lock
+            connection->addListener( flusher );
+        connection->setSendCoalescing( size, LB_MAX( time, 0 ));
+    }
+
+    const int32_t budget =
+        Global::getIAttribute( Global::IATTR_SEND_QUEUE_SIZE );
+    if( budget > 0 )
+        connection->setSendQueue( budget );
+}
+
+/**
+ * Start the next receive on a connection.
+ *
+ * The buffer already contains the incomplete data of the last read. At least
+ * the data needed to complete the next command or its header is requested. In
+ * bulk mode, everything available is read, up to the staging buffer size.
+ */
+void _startRead( ConnectionPtr connection, BufferPtr buffer,
+                 const uint64_t needed )
+{
+    const bool bulk =
+        Global::getIAttribute( Global::IATTR_RECEIVE_BUFFER_SIZE ) > 0;
+    const uint64_t left = buffer->getSize();
+    const uint64_t minBytes = needed > left ? needed - left : 1;
+    const uint64_t maxSize = _getReceiveBufferSize();
+    const uint64_t maxBytes = bulk && maxSize > left + minBytes ?
+                              maxSize - left : minBytes;
+    connection->recvNB( buffer, minBytes, maxBytes );
+}
 }
 
 namespace detail
 {
+/**
+ * Reads the available data from a connection and slices it into commands.
+ *
+ * Commands bigger than COMMAND_ALLOCSIZE reference sub-ranges of the shared
+ * staging buffer, smaller commands are copied out, so that a long-lived small
+ * command does not keep the whole staging buffer alive. Incomplete trailing
+ * data is carried over to the next receive, commands larger than the staging
+ * buffer are completed synchronously in a dedicated buffer.
+ */
+class CommandReader
+{
+public:
+    CommandReader( co::LocalNode* localNode, co::ConnectionSet& incoming,
+                   co::BufferCache& smallBuffers, co::BufferCache& bigBuffers )
+        : _localNode( localNode )
+        , _incoming( incoming )
+        , _smallBuffers( smallBuffers )
+        , _bigBuffers( bigBuffers )
+        , _offset( 0 )
+        , _needed( 0 )
+    {}
+
+    /** Finish the pending receive. @return false if no data was read. */
+    bool read( ConnectionPtr connection )
+    {
+        _smallBuffers.compact();
+        _bigBuffers.compact();
+
+        BufferPtr buffer;
+        const bool gotData = connection->recvSync( buffer, false );
+
+        if( !buffer ) // fluke signal
+        {
+            LBWARN << "Erronous network event on "
+                   << connection->getDescription() << std::endl;
+            _incoming.setDirty();
+            return false;
+        }
+
+        if( !gotData )
+        {
+            // Some systems signal data on dead connections.
+            _startRead( connection, buffer, 0 );
+            return false;
+        }
+
+        _connection = connection;
+        _buffer = buffer;
+        _offset = 0;
+        _needed = OCommand::getSize();
+        return true;
+    }
+
+    /** @return the next complete command, or an invalid command. */
+    ICommand next( NodePtr node )
+    {
+        const uint64_t headerSize = OCommand::getSize();
+        const uint64_t left = _buffer->getSize() - _offset;
+        _needed = headerSize;
+        if( left < headerSize )
+            return ICommand();
+
+        ICommand command = _localNode->_setupCommand( node, _buffer, _offset );
+        const uint64_t size = _getFrameSize( command.getSize( ));
+        if( !command.isValid( ))
+        {
+            LBERROR << "Dropping " << left << " bytes of unknown data from "
+                    << _connection->getDescription() << std::endl;
+            _offset = _buffer->getSize();
+            return command;
+        }
+
+        if( size <= left )
+        {
+            if( size <= COMMAND_ALLOCSIZE )
+            {
+                BufferPtr buffer = _smallBuffers.alloc( COMMAND_ALLOCSIZE );
+                buffer->append( _buffer->getData() + _offset, size );
+                command = ICommand( command.getLocalNode(),
+                                    command.getRemoteNode(), buffer,
+                                    command.isSwapping( ));
+            }
+            _offset += size;
+            return command;
+        }
+
+        if( size <= _getReceiveBufferSize( ))
+        {
+            _needed = size; // carry over to next receive
+            return ICommand();
+        }
+
+        LBASSERTINFO( size < LB_BIT48,
+                      "Out-of-sync network stream: " << command << "?" );
+        if( _connection->isClosed( )) // by a handler of a previous command
+            return ICommand();
+
+        // not enough space for remaining data, alloc and copy to new buffer
+        BufferPtr buffer = _bigBuffers.alloc( size );
+        buffer->append( _buffer->getData() + _offset, left );
+        _offset = _buffer->getSize();
+        command = ICommand( command.getLocalNode(), command.getRemoteNode(),
+                            buffer, command.isSwapping( ));
+
+        // read remaining data
+        _connection->recvNB( buffer, size - left );
+        if( _connection->recvSync( buffer ))
+            return command;
+
+        LBERROR << "Incomplete command read: " << command << std::endl;
+        return ICommand();
+    }
+
+    /** @return true if the received data holds another complete command. */
+    bool hasNext( const ICommand& last ) const
+    {
+        const uint64_t left = _buffer->getSize() - _offset;
+        if( left < OCommand::getSize( ))
+            return false;
+
+        uint64_t size;
+        ::memcpy( &size, _buffer->getData() + _offset, sizeof( size ));
+        if( last.isSwapping( ))
+            lunchbox::byteswap( size );
+        return _getFrameSize( size ) <= left;
+    }
+
+    /** Start the next receive, carrying over the unprocessed data. */
+    void finish()
+    {
+        if( _connection->isClosed( )) // by a handler of a received command
+        {
+            _connection = 0;
+            _buffer = 0;
+            return;
+        }
+
+        BufferPtr buffer = _smallBuffers.alloc( _getReceiveBufferSize( ));
+        const uint64_t left = _buffer->getSize() - _offset;
+        if( left > 0 )
+            buffer->append( _buffer->getData() + _offset, left );
+
+        _startRead( _connection, buffer, _needed );
+        _connection = 0;
+        _buffer = 0;
+    }
+
+private:
+    co::LocalNode* const _localNode;
+    co::ConnectionSet& _incoming;
+    co::BufferCache& _smallBuffers;
+    co::BufferCache& _bigBuffers;
+
+    ConnectionPtr _connection;
+    BufferPtr _buffer;
+    uint64_t _offset; //!< start of the unprocessed data in _buffer
+    uint64_t _needed; //!< bytes needed to complete the next command
+
+    /** @return the bytes used by a command on the wire, including padding. */
+    uint64_t _getFrameSize( const uint64_t size ) const
+    {
+        if( _connection->getFraming() == FRAMING_PADDED )
+            return LB_MAX( size, uint64_t( COMMAND_MINSIZE ));
+        return size;
+    }
+};
+
 class ReceiverThread : public lunchbox::Thread
 {
 public:
@@ -101,11 +355,71 @@ private:
     co::LocalNode* const _localNode;
 };
 
-class CommandThread : public Worker
+/**
+ * The queue of the command thread.
+ *
+ * With additional command workers, object commands pushed to this queue are
+ * handed over to the workers by object identifier, so that the commands of one
+ * object are handled in order by the same worker. All other commands are
+ * handled by the command thread itself.
+ *
+ * Handlers of object commands registered on the command thread queue, e.g.,
+ * Barrier and QueueMaster commands, then run concurrently with node commands
+ * such as ObjectStore::_cmdMap, _cmdSync and _cmdRemoveNode. Those only
+ * access objects through the locked ObjectStore object list and the locked
+ * slave list of the master change managers, while the object handlers of
+ * Collage only access their own object's state. Application objects sharing
+ * state with node command handlers need their own locking, which is why
+ * workers are disabled by default.
+ */
+class CommandThreadQueue : public CommandQueue
+{
+public:
+    explicit CommandThreadQueue( const size_t maxSize )
+        : CommandQueue( maxSize )
+    {}
+
+    void addWorker( CommandQueue* queue ) { _workers.push_back( queue ); }
+
+    void push( const ICommand& command ) override
+    {
+        CommandQueue* worker = _select( command );
+        if( worker )
+            worker->push( command );
+        else
+            CommandQueue::push( command );
+    }
+
+    void pushFront( const ICommand& command ) override
+    {
+        CommandQueue* worker = _select( command );
+        if( worker )
+            worker->pushFront( command );
+        else
+            CommandQueue::pushFront( command );
+    }
+
+private:
+    std::vector< CommandQueue* > _workers;
+
+    /** @return the worker queue for the command, or 0 for this queue. */
+    CommandQueue* _select( const ICommand& command ) const
+    {
+        if( _workers.empty() || command.getType() != COMMANDTYPE_OBJECT )
+            return 0;
+
+        const ObjectICommand objectCommand( command );
+        const uint128_t& id = objectCommand.getObjectID();
+        return _workers[ ( id.high() ^ id.low( )) % _workers.size() ];
+    }
+};
+
+class CommandThread : public WorkerThread< CommandThreadQueue >
 {
 public:
     explicit CommandThread( co::LocalNode* localNode )
-        : Worker( Global::getCommandQueueLimit( ))
+        : WorkerThread< CommandThreadQueue >(
+            Global::getCommandQueueLimit( ))
         , threadID( 0 )
         , _localNode( localNode )
     {}
@@ -127,6 +441,124 @@ private:
     co::LocalNode* const _localNode;
 };
 
+/** An additional worker processing object commands of the command thread. */
+class CommandWorker : public Worker
+{
+public:
+    explicit CommandWorker( const size_t index )
+        : Worker( Global::getCommandQueueLimit( ))
+        , threadID( 0 )
+        , _index( index )
+        , _stopped( false )
+    {}
+
+    int32_t threadID;
+
+    /** Handle the stop command queued after all pending commands. */
+    bool cmdStop( ICommand& )
+    {
+        _stopped = true;
+        return true;
+    }
+
+protected:
+    bool init() override
+    {
+        setName( std::string( "Cmd" ) +
+                 boost::lexical_cast< std::string >( threadID ) + "." +
+                 boost::lexical_cast< std::string >( _index ));
+        return true;
+    }
+
+    bool stopRunning() override { return _stopped; }
+
+private:
+    const size_t _index;
+    bool _stopped; //!< set by cmdStop() in the worker thread
+};
+typedef std::vector< CommandWorker* > CommandWorkers;
+typedef CommandWorkers::const_iterator CommandWorkersCIter;
+
+class ReceiverShard;
+typedef std::vector< ReceiverShard* > ReceiverShards;
+typedef ReceiverShards::const_iterator ReceiverShardsCIter;
+
+/** A command or disconnect read by a shard, handled by the receiver thread. */
+struct ShardEvent
+{
+    ShardEvent() {}
+    ShardEvent( ConnectionPtr connection_, const co::ICommand& command_ )
+        : connection( connection_ ), command( command_ ) {}
+
+    ConnectionPtr connection;
+    co::ICommand command; //!< invalid for a disconnect
+};
+
+/**
+ * Flushes the node connections with coalesced sends after
+ * IATTR_SEND_COALESCE_TIME, for the receiver thread. Idle receivers wait
+ * without a timeout.
+ */
+class SendFlusher : public ConnectionListener
+{
+public:
+    explicit SendFlusher( co::ConnectionSet& incoming )
+        : _incoming( incoming ) {}
+
+    void notifyCoalesced( Connection* connection ) override
+    {
+        bool first = false;
+        {
+            lunchbox::ScopedFastWrite mutex( _pending );
+            first = _pending->empty();
+            if( first )
+                _clock.reset();
+            _pending->push_back( connection );
+        }
+        if( first )
+            _incoming.interrupt(); // select with the flush timeout
+    }
+
+    /** @return the time until the pending sends are due, in ms. */
+    uint32_t getTimeout() const
+    {
+        lunchbox::ScopedFastRead mutex( _pending );
+        if( _pending->empty( ))
+            return LB_TIMEOUT_INDEFINITE;
+
+        const int64_t left = Global::getIAttribute(
+                          Global::IATTR_SEND_COALESCE_TIME ) - _clock.getTime64();
+        return uint32_t( LB_MAX( left, 0 ));
+    }
+
+    /** Write the coalesced sends of all pending connections, if due. */
+    void flush()
+    {
+        Connections connections;
+        {
+            lunchbox::ScopedFastWrite mutex( _pending );
+            if( _pending->empty() || _clock.getTime64() <
+                Global::getIAttribute( Global::IATTR_SEND_COALESCE_TIME ))
+            {
+                return;
+            }
+            connections.swap( _pending.data );
+        }
+
+        for( ConnectionsCIter i = connections.begin();
+             i != connections.end(); ++i )
+        {
+            if( (*i)->isConnected( ))
+                (*i)->flushCoalesced();
+        }
+    }
+
+private:
+    co::ConnectionSet& _incoming;
+    lunchbox::Lockable< Connections, lunchbox::SpinLock > _pending;
+    lunchbox::Clock _clock; //!< age of the oldest pending send
+};
+
 class LocalNode
 {
 public:
@@ -136,6 +568,7 @@ public:
         , sendToken( true )
         , lastSendToken( 0 )
         , objectStore( 0 )
+        , sendFlusher( incoming )
         , receiverThread( 0 )
         , commandThread( 0 )
         , service( "_collage._tcp" )
@@ -144,8 +577,10 @@ public:
     ~LocalNode()
     {
         LBASSERT( incoming.isEmpty( ));
+        LBASSERT( shards.empty( ));
         LBASSERT( connectionNodes.empty( ));
         LBASSERT( pendingCommands.empty( ));
+        LBASSERT( objectCommands.empty( ));
         LBASSERT( nodes->empty( ));
 
         delete objectStore;
@@ -154,6 +589,14 @@ public:
         delete commandThread;
         commandThread = 0;
 
+        for( CommandWorkersCIter i = commandWorkers.begin();
+             i != commandWorkers.end(); ++i )
+        {
+            LBASSERT( !(*i)->isRunning( ));
+            delete *i;
+        }
+        commandWorkers.clear();
+
         LBASSERT( !receiverThread->isRunning( ));
         delete receiverThread;
         receiverThread = 0;
@@ -161,9 +604,43 @@ public:
 
     bool inReceiverThread() const { return receiverThread->isCurrent(); }
 
+    NodePtr findNode( ConnectionPtr connection ) const
+    {
+        ConnectionNodeHashCIter i = connectionNodes.find( connection );
+        return i == connectionNodes.end() ? NodePtr() : i->second;
+    }
+
+    void startShards( co::LocalNode* localNode );
+    Connections stopShards();
+    void deleteShards();
+    bool removeFromShards( ConnectionPtr connection );
+    void scheduleMigration( ConnectionPtr connection );
+    void migrateConnections();
+
+    /** Queue an event from a shard, see wakeupReceiver(). */
+    void pushShardEvent( ConnectionPtr connection, const co::ICommand& command )
+        { shardEvents.push( ShardEvent( connection, command )); }
+
+    /** Wake up the receiver thread to handle the queued shard events. */
+    void wakeupReceiver() { incoming.interrupt(); }
+
     /** Commands re-scheduled for dispatch. */
     CommandList pendingCommands;
 
+    /** Object commands waiting for their object to be attached, in order. */
+    ObjectCommandsHash objectCommands;
+
+    size_t getNumPendingCommands() const
+    {
+        size_t size = pendingCommands.size();
+        for( ObjectCommandsHash::const_iterator i = objectCommands.begin();
+             i != objectCommands.end(); ++i )
+        {
+            size += i->second.size();
+        }
+        return size;
+    }
+
     /** The command buffer 'allocator' for small packets */
     co::BufferCache smallBuffers;
 
@@ -189,6 +666,18 @@ public:
     /** The connection set of all connections from/to this node. */
     co::ConnectionSet incoming;
 
+    /** Additional receivers reading connected nodes, may be empty. */
+    ReceiverShards shards;
+
+    /** Commands and disconnects read by the shards. */
+    lunchbox::MTQueue< ShardEvent > shardEvents;
+
+    /** Established node connections to be handed to a shard. */
+    Connections newConnections; // recv thread only
+
+    /** Node connections with coalesced sends to flush. */
+    SendFlusher sendFlusher;
+
     /** The process-global clock. */
     lunchbox::Clock clock;
 
@@ -201,11 +690,267 @@ public:
     ReceiverThread* receiverThread;
     CommandThread* commandThread;
 
+    /** Additional workers for object commands, and the queue feeding them. */
+    CommandWorkers commandWorkers;
+
     lunchbox::Lockable< servus::Servus > service;
 
     // Performance counters:
     a_ssize_t counters[ co::LocalNode::COUNTER_ALL ];
 };
+
+/**
+ * Reads commands from a subset of the connected nodes.
+ *
+ * Established node connections are migrated from the receiver thread to the
+ * shards. The shards read complete commands in parallel and hand them to the
+ * receiver thread, which dispatches them in per-connection order.
+ */
+class ReceiverShard : public lunchbox::Thread
+{
+public:
+    ReceiverShard( co::LocalNode* localNode, const size_t index )
+        : smallBuffers( 200 )
+        , bigBuffers( 20 )
+        , _localNode( localNode )
+        , _index( index )
+        , _running( true )
+    {}
+
+    void add( ConnectionPtr connection, NodePtr node )
+    {
+        lunchbox::ScopedWrite mutex( _lock );
+        _nodes[ connection ] = node;
+        incoming.addConnection( connection );
+    }
+
+    bool remove( ConnectionPtr connection )
+    {
+        lunchbox::ScopedWrite mutex( _lock );
+        if( _nodes.erase( connection ) == 0 )
+            return false;
+        incoming.removeConnection( connection );
+        return true;
+    }
+
+    /** Stop the thread and return the connections still owned. */
+    Connections stop()
+    {
+        {
+            lunchbox::ScopedWrite mutex( _lock );
+            _running = false;
+        }
+        incoming.interrupt();
+        join();
+
+        const Connections connections = incoming.getConnections();
+        for( ConnectionsCIter i = connections.begin();
+             i != connections.end(); ++i )
+        {
+            incoming.removeConnection( *i );
+        }
+        _nodes.clear();
+        return connections;
+    }
+
+    size_t getSize()
+    {
+        lunchbox::ScopedWrite mutex( _lock );
+        return _nodes.size();
+    }
+
+    co::ConnectionSet incoming;
+    co::BufferCache smallBuffers;
+    co::BufferCache bigBuffers;
+
+protected:
+    bool init() override
+    {
+        setName( std::string( "RcvShard" ) +
+                 boost::lexical_cast< std::string >( _index ));
+        return true;
+    }
+
+    void run() override
+    {
+        int nErrors = 0;
+        while( true )
+        {
+            const ConnectionSet::Event result = incoming.select();
+            ConnectionPtr connection = incoming.getConnection();
+            NodePtr node;
+            {
+                lunchbox::ScopedWrite mutex( _lock );
+                if( !_running )
+                    return;
+
+                if( connection )
+                {
+                    ConnectionNodeHashCIter i = _nodes.find( connection );
+                    if( i == _nodes.end( ))
+                        continue; // removed by receiver thread in the meantime
+                    node = i->second;
+                }
+            }
+
+            switch( result )
+            {
+            case ConnectionSet::EVENT_DATA:
+                nErrors = 0;
+                if( _handleData( connection, node ))
+                    _localNode->_impl->wakeupReceiver();
+                break;
+
+            case ConnectionSet::EVENT_DISCONNECT:
+            case ConnectionSet::EVENT_INVALID_HANDLE:
+                _handleDisconnect( connection, node );
+                break;
+
+            case ConnectionSet::EVENT_ERROR:
+                ++nErrors;
+                LBWARN << "Connection error during select" << std::endl;
+                if( nErrors > 100 )
+                {
+                    LBWARN << "Too many errors in a row, capping connection"
+                           << std::endl;
+                    _handleDisconnect( connection, node );
+                }
+                break;
+
+            case ConnectionSet::EVENT_SELECT_ERROR:
+                LBWARN << "Error during select" << std::endl;
+                break;
+
+            case ConnectionSet::EVENT_INTERRUPT:
+            case ConnectionSet::EVENT_TIMEOUT:
+                break;
+
+            default:
+                LBUNIMPLEMENTED;
+            }
+        }
+    }
+
+private:
+    co::LocalNode* const _localNode;
+    const size_t _index;
+    lunchbox::Lock _lock; //!< protects _nodes and _running
+    ConnectionNodeHash _nodes;
+    bool _running;
+
+    /** Queue the commands of one read. @return true if any were queued. */
+    bool _handleData( ConnectionPtr connection, NodePtr node )
+    {
+        CommandReader reader( _localNode, incoming, smallBuffers, bigBuffers );
+        if( !reader.read( connection ))
+            return false;
+
+        bool gotCommand = false;
+        while( true )
+        {
+            ICommand command = reader.next( node );
+            if( !command.isValid( ))
+            {
+                reader.finish();
+                return gotCommand;
+            }
+
+            gotCommand = true;
+            _localNode->_impl->pushShardEvent( connection, command );
+        }
+    }
+
+    void _handleDisconnect( ConnectionPtr connection, NodePtr node )
+    {
+        while( _handleData( connection, node )) ; // read remaining data
+
+        {
+            lunchbox::ScopedWrite mutex( _lock );
+            if( _nodes.erase( connection ) > 0 )
+            {
+                incoming.removeConnection( connection );
+                _localNode->_impl->pushShardEvent( connection, co::ICommand( ));
+            }
+        }
+        _localNode->_impl->wakeupReceiver();
+    }
+};
+
+void LocalNode::startShards( co::LocalNode* localNode )
+{
+    LBASSERT( shards.empty( ));
+    const int32_t nShards =
+        Global::getIAttribute( Global::IATTR_RECEIVER_THREADS );
+
+    for( int32_t i = 0; i < nShards; ++i )
+    {
+        ReceiverShard* shard = new ReceiverShard( localNode, i );
+        if( !shard->start( ))
+        {
+            LBWARN << "Failed to start receiver shard " << i << std::endl;
+            delete shard;
+            break;
+        }
+        shards.push_back( shard );
+    }
+}
+
+Connections LocalNode::stopShards()
+{
+    Connections connections;
+    for( ReceiverShardsCIter i = shards.begin(); i != shards.end(); ++i )
+    {
+        const Connections& shardConnections = (*i)->stop();
+        connections.insert( connections.end(), shardConnections.begin(),
+                            shardConnections.end( ));
+    }
+    shardEvents.clear();
+    newConnections.clear();
+    return connections;
+}
+
+void LocalNode::deleteShards()
+{
+    for( ReceiverShardsCIter i = shards.begin(); i != shards.end(); ++i )
+        delete *i;
+    shards.clear();
+}
+
+bool LocalNode::removeFromShards( ConnectionPtr connection )
+{
+    for( ReceiverShardsCIter i = shards.begin(); i != shards.end(); ++i )
+        if( (*i)->remove( connection ))
+            return true;
+    return false;
+}
+
+void LocalNode::scheduleMigration( ConnectionPtr connection )
+{
+    if( !shards.empty() && !connection->isMulticast( ))
+        newConnections.push_back( connection );
+}
+
+void LocalNode::migrateConnections()
+{
+    for( ConnectionsCIter i = newConnections.begin();
+         i != newConnections.end(); ++i )
+    {
+        ConnectionPtr connection = *i;
+        ConnectionNodeHashCIter j = connectionNodes.find( connection );
+        if( j == connectionNodes.end() ||
+            !incoming.removeConnection( connection ))
+        {
+            continue; // closed in the meantime
+        }
+
+        ReceiverShard* target = shards.front();
+        for( ReceiverShardsCIter k = shards.begin(); k != shards.end(); ++k )
+            if( (*k)->getSize() < target->getSize( ))
+                target = *k;
+        target->add( connection, j->second );
+    }
+    newConnections.clear();
+}
 }
 
 LocalNode::LocalNode( const uint32_t type )
@@ -214,6 +959,19 @@ LocalNode::LocalNode( const uint32_t type )
 {
     _impl->receiverThread = new detail::ReceiverThread( this );
     _impl->commandThread  = new detail::CommandThread( this );
+    const int32_t nWorkers =
+        Global::getIAttribute( Global::IATTR_COMMAND_THREADS );
+    if( nWorkers > 0 )
+    {
+        for( int32_t i = 0; i < nWorkers; ++i )
+        {
+            detail::CommandWorker* worker =
+                new detail::CommandWorker( i + 1 );
+            _impl->commandWorkers.push_back( worker );
+            _impl->commandThread->getWorkerQueue()->addWorker(
+                worker->getWorkerQueue( ));
+        }
+    }
     _impl->objectStore = new ObjectStore( this, _impl->counters );
 
     CommandQueue* queue = getCommandThreadQueue();
@@ -363,6 +1121,7 @@ bool LocalNode::listen()
         LBVERB << "Added node " << getNodeID() << " using " << connection
                << std::endl;
     }
+    _listenSHM();
 
     LBVERB << lunchbox::className(this) << " start command and receiver thread "
            << std::endl;
@@ -374,11 +1133,57 @@ bool LocalNode::listen()
     return true;
 }
 
+void LocalNode::_listenSHM()
+{
+    if( Global::getIAttribute( Global::IATTR_SHM_RING_SIZE ) <= 0 )
+        return;
+
+    // Offer shared memory to nodes on the same host next to point-to-point
+    // listeners, unless it is configured explicitly
+    bool hasListener = false;
+    const ConnectionDescriptions& descriptions = getConnectionDescriptions();
+    for( ConnectionDescriptionsCIter i = descriptions.begin();
+         i != descriptions.end(); ++i )
+    {
+        if( (*i)->type == CONNECTIONTYPE_SHM )
+            return;
+        if( (*i)->type < CONNECTIONTYPE_MULTICAST )
+            hasListener = true;
+    }
+    if( !hasListener )
+        return;
+
+#ifdef __linux__
+    const std::string hostname = _getHostname();
+    if( hostname.empty( ))
+        return;
+
+    ConnectionDescriptionPtr description = new ConnectionDescription;
+    description->type = CONNECTIONTYPE_SHM;
+    description->setHostname( hostname );
+    description->filename = getNodeID().getString();
+
+    ConnectionPtr connection = Connection::create( description );
+    if( !connection || !connection->listen( ))
+    {
+        LBINFO << "Can't create shared memory listener: " << description
+               << std::endl;
+        return;
+    }
+
+    addConnectionDescription( description );
+    _impl->connectionNodes[ connection ] = this;
+    connection->acceptNB();
+    _impl->incoming.addConnection( connection );
+#endif
+}
+
 bool LocalNode::close()
 {
     if( !isListening() )
         return false;
 
+    flushSends();
     send( CMD_NODE_STOP_RCV );
 
     LBCHECK( _impl->receiverThread->join( ));
@@ -482,8 +1287,8 @@ void LocalNode::_addConnection( ConnectionPtr connection )
         return;
     }
 
-    BufferPtr buffer = _impl->smallBuffers.alloc( COMMAND_ALLOCSIZE );
-    connection->recvNB( buffer, COMMAND_MINSIZE );
+    _startRead( connection, _impl->smallBuffers.alloc( _getReceiveBufferSize( )),
+                OCommand::getSize( ));
     _impl->incoming.addConnection( connection );
 }
 
@@ -491,7 +1296,8 @@ void LocalNode::_removeConnection( ConnectionPtr connection )
 {
     LBASSERT( connection );
 
-    _impl->incoming.removeConnection( connection );
+    if( !_impl->incoming.removeConnection( connection ))
+        _impl->removeFromShards( connection );
     connection->resetRecvData();
     if( !connection->isClosed( ))
         connection->close(); // cancel pending IO's
@@ -536,6 +1342,17 @@ void LocalNode::_closeNode( NodePtr node )
     ConnectionPtr connection = node->getConnection();
     ConnectionPtr mcConnection = node->_getMulticast();
 
+    if( connection )
+    {
+        // send the commands still buffered by send coalescing
+        if( connection->isConnected( ))
+            connection->flushCoalesced();
+
+        connection->lockSend(); // senders notify the flusher
+        connection->removeListener( &_impl->sendFlusher );
+        connection->unlockSend();
+    }
+
     node->_disconnect();
 
     if( connection )
@@ -564,7 +1381,7 @@ void LocalNode::_closeNode( NodePtr node )
 bool LocalNode::_connectSelf()
 {
     // setup local connection to myself
-    PipeConnectionPtr connection = new PipeConnection;
+    LocalConnectionPtr connection = new LocalConnection;
     if( !connection->connect( ))
     {
         LBERROR << "Could not create local connection to receiver thread."
@@ -572,6 +1389,8 @@ bool LocalNode::_connectSelf()
         return false;
     }
 
+    connection->setFraming( FRAMING_CURRENT );
+    connection->getSibling()->setFraming( FRAMING_CURRENT );
     Node::_connect( connection->getSibling( ));
     _setClosed(); // reset state after _connect set it to connected
 
@@ -991,14 +1810,21 @@ uint32_t LocalNode::_connect( NodePtr node )
     LBASSERT( node->isClosed( ));
     LBDEBUG << "Connecting " << node << std::endl;
 
-    // try connecting using the given descriptions
-    const ConnectionDescriptions& cds = node->getConnectionDescriptions();
+    // try connecting using the given descriptions, starting with shared
+    // memory if the node runs on the same host
+    ConnectionDescriptions cds = node->getConnectionDescriptions();
+    std::stable_partition( cds.begin(), cds.end(), _isLocalSHM );
     for( ConnectionDescriptionsCIter i = cds.begin();
         i != cds.end(); ++i )
     {
         ConnectionDescriptionPtr description = *i;
         if( description->type >= CONNECTIONTYPE_MULTICAST )
             continue; // Don't use multicast for primary connections
+        if( description->type == CONNECTIONTYPE_SHM &&
+            !_isLocalSHM( description ))
+        {
+            continue; // node on another host
+        }
 
         ConnectionPtr connection = Connection::create( description );
         if( !connection || !connection->connect( ))
@@ -1039,7 +1865,8 @@ uint32_t LocalNode::_connect( NodePtr node, ConnectionPtr connection )
     const uint32_t cmd = CMD_NODE_CONNECT;
 #endif
     OCommand( Connections( 1, connection ), cmd )
-        << getNodeID() << request << getType() << serialize();
+        << getNodeID() << request << getType() << serialize()
+        << uint32_t( FRAMING_CURRENT );
 
     bool connected = false;
     try
@@ -1141,6 +1968,14 @@ void LocalNode::flushCommands()
     _impl->incoming.interrupt();
 }
 
+void LocalNode::flushSends()
+{
+    Nodes nodes;
+    getNodes( nodes, false );
+    for( NodesCIter i = nodes.begin(); i != nodes.end(); ++i )
+        (*i)->flush();
+}
+
 //----------------------------------------------------------------------
 // receiver thread functions
 //----------------------------------------------------------------------
@@ -1148,11 +1983,19 @@ void LocalNode::_runReceiverThread()
 {
     LB_TS_THREAD( _rcvThread );
     _initService();
+    _impl->startShards( this );
 
     int nErrors = 0;
     while( isListening( ))
     {
-        const ConnectionSet::Event result = _impl->incoming.select();
+        if( !_impl->newConnections.empty( ))
+            _impl->migrateConnections();
+
+        // bound the delay of coalesced sends, if any
+        _impl->sendFlusher.flush();
+        const uint32_t timeout = _impl->sendFlusher.getTimeout();
+
+        const ConnectionSet::Event result = _impl->incoming.select( timeout );
         switch( result )
         {
             case ConnectionSet::EVENT_CONNECT:
@@ -1170,7 +2013,8 @@ void LocalNode::_runReceiverThread()
                 break;
 
             case ConnectionSet::EVENT_TIMEOUT:
-                LBINFO << "select timeout" << std::endl;
+                if( timeout == LB_TIMEOUT_INDEFINITE )
+                    LBINFO << "select timeout" << std::endl;
                 break;
 
             case ConnectionSet::EVENT_ERROR:
@@ -1195,6 +2039,7 @@ void LocalNode::_runReceiverThread()
                 break;
 
             case ConnectionSet::EVENT_INTERRUPT:
+                _handleShardEvents();
                 _redispatchCommands();
                 break;
 
@@ -1203,20 +2048,35 @@ void LocalNode::_runReceiverThread()
         }
     }
 
-    if( !_impl->pendingCommands.empty( ))
-        LBWARN << _impl->pendingCommands.size()
-               << " commands pending while leaving command thread" << std::endl;
+    const size_t nPending = _impl->getNumPendingCommands();
+    if( nPending > 0 )
+        LBWARN << nPending << " commands pending while leaving command thread"
+               << std::endl;
 
     _impl->pendingCommands.clear();
+    _impl->objectCommands.clear();
     LBCHECK( _impl->commandThread->join( ));
+    _stopCommandWorkers();
 
     ConnectionPtr connection = getConnection();
-    PipeConnectionPtr pipe = LBSAFECAST( PipeConnection*, connection.get( ));
-    connection = pipe->getSibling();
+    LocalConnectionPtr self = LBSAFECAST( LocalConnection*, connection.get( ));
+    connection = self->getSibling();
     _removeConnection( connection );
     _impl->connectionNodes.erase( connection );
     _disconnect();
 
+    const Connections& shardConnections = _impl->stopShards();
+    for( ConnectionsCIter i = shardConnections.begin();
+         i != shardConnections.end(); ++i )
+    {
+        connection = *i;
+        NodePtr node = _impl->connectionNodes[ connection ];
+
+        if( node )
+            _closeNode( node );
+        _removeConnection( connection );
+    }
+
     const Connections& connections = _impl->incoming.getConnections();
     while( !connections.empty( ))
     {
@@ -1230,8 +2090,10 @@ void LocalNode::_runReceiverThread()
 
     _impl->objectStore->clear();
     _impl->pendingCommands.clear();
+    _impl->objectCommands.clear();
     _impl->smallBuffers.flush();
     _impl->bigBuffers.flush();
+    _impl->deleteShards();
 
     LBDEBUG << "Leaving receiver thread of " << lunchbox::className( this )
            << std::endl;
@@ -1245,15 +2107,31 @@ void LocalNode::_handleConnect()
 
     if( newConn )
         _addConnection( newConn );
-    else
-        LBINFO << "Received connect event, but accept() failed" << std::endl;
+    else // failed, or a striped connection waiting for more streams
+        LBVERB << "Received connect event, but accept() failed" << std::endl;
 }
 
 void LocalNode::_handleDisconnect()
 {
     while( _handleData( )) ; // read remaining data off connection
 
-    ConnectionPtr connection = _impl->incoming.getConnection();
+    _closeConnection( _impl->incoming.getConnection( ));
+}
+
+void LocalNode::_handleShardEvents()
+{
+    detail::ShardEvent event;
+    while( _impl->shardEvents.tryPop( event ))
+    {
+        if( event.command.isValid( ))
+            _dispatchCommand( event.command );
+        else
+            _closeConnection( event.connection );
+    }
+}
+
+void LocalNode::_closeConnection( ConnectionPtr connection )
+{
     ConnectionNodeHash::iterator i = _impl->connectionNodes.find( connection );
 
     if( i != _impl->connectionNodes.end( ))
@@ -1277,63 +2155,39 @@ void LocalNode::_handleDisconnect()
 
 bool LocalNode::_handleData()
 {
-    _impl->smallBuffers.compact();
-    _impl->bigBuffers.compact();
-
     ConnectionPtr connection = _impl->incoming.getConnection();
     LBASSERT( connection );
 
-    BufferPtr buffer = _readHead( connection );
-    if( !buffer ) // fluke signal
+    detail::CommandReader reader( this, _impl->incoming, _impl->smallBuffers,
+                                  _impl->bigBuffers );
+    if( !reader.read( connection ))
         return false;
 
-    ICommand command = _setupCommand( connection, buffer );
-    const bool gotCommand = _readTail( command, buffer, connection );
-    LBASSERT( gotCommand );
-
-    // start next receive
-    BufferPtr nextBuffer = _impl->smallBuffers.alloc( COMMAND_ALLOCSIZE );
-    connection->recvNB( nextBuffer, COMMAND_MINSIZE );
-
-    if( gotCommand )
+    bool gotCommand = false;
+    while( true )
     {
-        _dispatchCommand( command );
-        return true;
-    }
-
-    LBERROR << "Incomplete command read: " << command << std::endl;
-    return false;
-}
+        ICommand command = reader.next( _impl->findNode( connection ));
+        if( !command.isValid( ))
+        {
+            reader.finish();
+            return gotCommand;
+        }
 
-BufferPtr LocalNode::_readHead( ConnectionPtr connection )
-{
-    BufferPtr buffer;
-    const bool gotSize = connection->recvSync( buffer, false );
+        // start next receive before the last command may close the connection
+        gotCommand = true;
+        const bool last = !reader.hasNext( command );
+        if( last )
+            reader.finish();
 
-    if( !buffer ) // fluke signal
-    {
-        LBWARN << "Erronous network event on " << connection->getDescription()
-               << std::endl;
-        _impl->incoming.setDirty();
-        return 0;
+        _dispatchCommand( command );
+        if( last )
+            return true;
     }
-
-    if( gotSize )
-        return buffer;
-
-    // Some systems signal data on dead connections.
-    buffer->setSize( 0 );
-    connection->recvNB( buffer, COMMAND_MINSIZE );
-    return 0;
 }
 
-ICommand LocalNode::_setupCommand( ConnectionPtr connection,
-                                   ConstBufferPtr buffer )
+ICommand LocalNode::_setupCommand( NodePtr node, ConstBufferPtr buffer,
+                                   const uint64_t offset )
 {
-    NodePtr node;
-    ConnectionNodeHashCIter i = _impl->connectionNodes.find( connection );
-    if( i != _impl->connectionNodes.end( ))
-        node = i->second;
     LBVERB << "Handle data from " << node << std::endl;
 
 #ifdef COLLAGE_BIGENDIAN
@@ -1341,7 +2195,7 @@ ICommand LocalNode::_setupCommand( ConnectionPtr connection,
 #else
     const bool swapping = node ? node->isBigEndian() : false;
 #endif
-    ICommand command( this, node, buffer, swapping );
+    ICommand command( this, node, buffer, offset, swapping );
 
     if( node )
     {
@@ -1359,7 +2213,7 @@ ICommand LocalNode::_setupCommand( ConnectionPtr connection,
     case CMD_NODE_CONNECT_REPLY:
     case CMD_NODE_ID:
 #ifdef COLLAGE_BIGENDIAN
-        command = ICommand( this, node, buffer, true );
+        command = ICommand( this, node, buffer, offset, true );
 #endif
         break;
 
@@ -1367,7 +2221,7 @@ ICommand LocalNode::_setupCommand( ConnectionPtr connection,
     case CMD_NODE_CONNECT_REPLY_BE:
     case CMD_NODE_ID_BE:
 #ifndef COLLAGE_BIGENDIAN
-        command = ICommand( this, node, buffer, true );
+        command = ICommand( this, node, buffer, offset, true );
 #endif
         break;
 
@@ -1380,35 +2234,8 @@ ICommand LocalNode::_setupCommand( ConnectionPtr connection,
     return command;
 }
 
-bool LocalNode::_readTail( ICommand& command, BufferPtr buffer,
-                           ConnectionPtr connection )
-{
-    const uint64_t needed = command.getSize();
-    if( needed <= buffer->getSize( ))
-        return true;
-
-    if( needed > buffer->getMaxSize( ))
-    {
-        LBASSERT( needed > COMMAND_ALLOCSIZE );
-        LBASSERTINFO( needed < LB_BIT48,
-                      "Out-of-sync network stream: " << command << "?" );
-        // not enough space for remaining data, alloc and copy to new buffer
-        BufferPtr newBuffer = _impl->bigBuffers.alloc( needed );
-        newBuffer->replace( *buffer );
-        buffer = newBuffer;
-
-        command = ICommand( this, command.getRemoteNode(), buffer,
-                            command.isSwapping( ));
-    }
-
-    // read remaining data
-    connection->recvNB( buffer, command.getSize() - buffer->getSize( ));
-    return connection->recvSync( buffer );
-}
-
 BufferPtr LocalNode::allocBuffer( const uint64_t size )
 {
-    LBASSERT( _impl->receiverThread->isStopped() || _impl->inReceiverThread( ));
     BufferPtr buffer = size > COMMAND_ALLOCSIZE ?
         _impl->bigBuffers.alloc( size ) :
         _impl->smallBuffers.alloc( COMMAND_ALLOCSIZE );
@@ -1419,6 +2246,32 @@ void LocalNode::_dispatchCommand( ICommand& command )
 {
     LBASSERTINFO( command.isValid(), command );
 
+    if( command.getType() == COMMANDTYPE_OBJECT )
+    {
+        if( !_impl->objectCommands.empty( ))
+        {
+            // keep order behind the commands waiting for the same object
+            const ObjectICommand objectCommand( command );
+            ObjectCommandsHashIter i =
+                _impl->objectCommands.find( objectCommand.getObjectID( ));
+            if( i != _impl->objectCommands.end( ))
+            {
+                i->second.push_back( command );
+                return;
+            }
+        }
+
+        if( !dispatchCommand( command ))
+        {
+            const ObjectICommand objectCommand( command );
+            _impl->objectCommands[ objectCommand.getObjectID( )].push_back(
+                command );
+        }
+        else if( !_impl->pendingCommands.empty( ))
+            _redispatchCommands();
+        return;
+    }
+
     if( dispatchCommand( command ))
         _redispatchCommands();
     else
@@ -1457,17 +2310,18 @@ void LocalNode::_redispatchCommands()
         changes = false;
 
         for( CommandList::iterator i = _impl->pendingCommands.begin();
-             i != _impl->pendingCommands.end(); ++i )
+             i != _impl->pendingCommands.end(); )
         {
             ICommand& command = *i;
             LBASSERT( command.isValid( ));
 
             if( dispatchCommand( command ))
             {
-                _impl->pendingCommands.erase( i );
+                i = _impl->pendingCommands.erase( i );
                 changes = true;
-                break;
             }
+            else
+                ++i;
         }
     }
 
@@ -1479,6 +2333,33 @@ void LocalNode::_redispatchCommands()
 #endif
 }
 
+void LocalNode::_redispatchCommands( const uint128_t& objectID )
+{
+    ObjectCommandsHashIter i = _impl->objectCommands.find( objectID );
+    if( i == _impl->objectCommands.end( ))
+        return;
+
+    // Detach the queue, dispatching may attach objects and recurse into here
+    CommandDeque commands;
+    commands.swap( i->second );
+    _impl->objectCommands.erase( i );
+
+    while( !commands.empty( ))
+    {
+        ICommand& command = commands.front();
+        LBASSERT( command.isValid( ));
+        if( !dispatchCommand( command ))
+            break;
+        commands.pop_front();
+    }
+
+    if( commands.empty( ))
+        return;
+
+    CommandDeque& pending = _impl->objectCommands[ objectID ];
+    pending.insert( pending.begin(), commands.begin(), commands.end( ));
+}
+
 void LocalNode::_initService()
 {
     LB_TS_SCOPED( _rcvThread );
@@ -1526,7 +2407,28 @@ Zeroconf LocalNode::getZeroconf()
 bool LocalNode::_startCommandThread( const int32_t threadID )
 {
     _impl->commandThread->threadID = threadID;
-    return _impl->commandThread->start();
+    if( !_impl->commandThread->start( ))
+        return false;
+
+    for( detail::CommandWorkersCIter i = _impl->commandWorkers.begin();
+         i != _impl->commandWorkers.end(); ++i )
+    {
+        detail::CommandWorker* worker = *i;
+        worker->threadID = threadID;
+        if( !worker->start( ))
+            return false;
+    }
+    return true;
+}
+
+void LocalNode::_stopCommandWorkers()
+{
+    LBASSERT( isClosed( ));
+    for( detail::CommandWorkersCIter i = _impl->commandWorkers.begin();
+         i != _impl->commandWorkers.end(); ++i )
+    {
+        LBCHECK( (*i)->join( ));
+    }
 }
 
 bool LocalNode::_notifyCommandThreadIdle()
@@ -1553,6 +2455,17 @@ bool LocalNode::_cmdStopRcv( ICommand& command )
 
     command.setCommand( CMD_NODE_STOP_CMD ); // causes cmd thread exit
     _dispatchCommand( command );
+
+    // stop the workers after their pending commands
+    for( detail::CommandWorkersCIter i = _impl->commandWorkers.begin();
+         i != _impl->commandWorkers.end(); ++i )
+    {
+        detail::CommandWorker* worker = *i;
+        ICommand stop( command );
+        stop.setDispatchFunction( CommandFunc< detail::CommandWorker >(
+                                      worker, &detail::CommandWorker::cmdStop ));
+        worker->getWorkerQueue()->push( stop );
+    }
     return true;
 }
 
@@ -1582,6 +2495,9 @@ bool LocalNode::_cmdConnect( ICommand& command )
     const uint32_t requestID = command.get< uint32_t >();
     const uint32_t nodeType = command.get< uint32_t >();
     std::string data = command.get< std::string >();
+    // older peers do not send their framing and need padded commands
+    const uint32_t framing = command.getRemainingBufferSize() > 0 ?
+                             command.get< uint32_t >() : FRAMING_PADDED;
 
     LBVERB << "handle connect " << command << " req " << requestID << " type "
            << nodeType << " data " << data << std::endl;
@@ -1654,9 +2570,11 @@ bool LocalNode::_cmdConnect( ICommand& command )
     }
     LBVERB << "Added node " << nodeID << std::endl;
 
-    // send our information as reply
+    // send our information as reply, still using the padded handshake framing
     OCommand( Connections( 1, connection ), cmd )
-        << getNodeID() << requestID << getType() << serialize();
+        << getNodeID() << requestID << getType() << serialize()
+        << uint32_t( FRAMING_CURRENT );
+    connection->setFraming( LB_MIN( framing, uint32_t( FRAMING_CURRENT )));
 
     return true;
 }
@@ -1686,6 +2604,8 @@ bool LocalNode::_cmdConnectReply( ICommand& command )
 
     const uint32_t nodeType = command.get< uint32_t >();
     std::string data = command.get< std::string >();
+    const uint32_t framing = command.getRemainingBufferSize() > 0 ?
+                             command.get< uint32_t >() : FRAMING_PADDED;
 
     LBVERB << "handle connect reply " << command << " req " << requestID
            << " type " << nodeType << " data " << data << std::endl;
@@ -1732,12 +2652,15 @@ bool LocalNode::_cmdConnectReply( ICommand& command )
     LBASSERT( data.empty( ));
     LBASSERT( peer->getNodeID() == nodeID );
 
-    // send ACK to peer
+    // send ACK to peer, the first command using the negotiated framing
+    connection->setFraming( LB_MIN( framing, uint32_t( FRAMING_CURRENT )));
     // cppcheck-suppress unusedScopedObject
     OCommand( Connections( 1, connection ), CMD_NODE_CONNECT_ACK );
 
     peer->_connect( connection );
+    _setupSends( connection, &_impl->sendFlusher );
     _impl->connectionNodes[ connection ] = peer;
+    _impl->scheduleMigration( connection );
     {
         lunchbox::ScopedFastWrite mutex( _impl->nodes );
         _impl->nodes.data[ peer->getNodeID() ] = peer;
@@ -1758,7 +2681,10 @@ bool LocalNode::_cmdConnectAck( ICommand& command )
     LBASSERT( _impl->inReceiverThread( ));
     LBVERB << "handle connect ack" << std::endl;
 
-    node->_connect( _impl->incoming.getConnection( ));
+    ConnectionPtr connection = _impl->incoming.getConnection();
+    node->_connect( connection );
+    _setupSends( connection, &_impl->sendFlusher );
+    _impl->scheduleMigration( connection );
     _connectMulticast( node );
     notifyConnect( node );
     return true;
@@ -32,7 +32,14 @@
 
 namespace co
 {
-namespace detail { class LocalNode; class ReceiverThread; class CommandThread; }
+namespace detail
+{
+class LocalNode;
+class ReceiverThread;
+class ReceiverShard;
+class CommandReader;
+class CommandThread;
+}
 
 /**
  * Node specialization for a local node.
@@ -415,7 +422,14 @@ public:
     /** Assemble a vector of the currently connected nodes. @version 1.0 */
     CO_API void getNodes( Nodes& nodes, const bool addSelf = true ) const;
 
-    /** Return the command queue to the command thread. @version 1.0 */
+    /**
+     * Return the command queue to the command thread.
+     *
+     * With additional command workers (Global::IATTR_COMMAND_THREADS), object
+     * commands pushed to this queue are distributed by object identifier over
+     * the command thread and the workers.
+     * @version 1.0
+     */
     CO_API CommandQueue* getCommandThreadQueue();
 
     /**
@@ -448,10 +462,23 @@ public:
      *
      * This causes the receiver thread to redispatch all pending commands,
      * which are normally only redispatched when a new command is received.
+     * Commands for objects which are not yet attached are redispatched when
+     * the object is attached.
      */
     CO_API void flushCommands();
 
-    /** @internal Allocate a command buffer from the receiver thread. */
+    /**
+     * Send all commands buffered on the connections to all nodes.
+     *
+     * Small commands are buffered when IATTR_SEND_COALESCE_SIZE is set, until
+     * the buffer is full or IATTR_SEND_COALESCE_TIME has passed. Thread safe.
+     *
+     * @sa Node::flush()
+     * @version 1.4
+     */
+    CO_API void flushSends();
+
+    /** @internal Allocate a command buffer, may be called from any thread. */
     CO_API BufferPtr allocBuffer( const uint64_t size );
 
     /**
@@ -549,8 +576,12 @@ private:
 
     friend class detail::ReceiverThread;
     bool _startCommandThread( const int32_t threadID );
+    void _stopCommandWorkers();
     void _runReceiverThread();
 
+    friend class detail::ReceiverShard;
+    friend class detail::CommandReader;
+
     friend class detail::CommandThread;
     bool _notifyCommandThreadIdle();
 
@@ -567,13 +598,14 @@ private:
     NodePtr _connect( const NodeID& nodeID, NodePtr peer );
     NodePtr _connectFromZeroconf( const NodeID& nodeID );
     bool _connectSelf();
+    void _listenSHM();
 
     void _handleConnect();
     void _handleDisconnect();
+    void _closeConnection( ConnectionPtr connection );
     bool _handleData();
-    BufferPtr _readHead( ConnectionPtr connection );
-    ICommand _setupCommand( ConnectionPtr, ConstBufferPtr );
-    bool _readTail( ICommand&, BufferPtr, ConnectionPtr );
+    void _handleShardEvents();
+    ICommand _setupCommand( NodePtr, ConstBufferPtr, const uint64_t offset );
     void _initService();
     void _exitService();
 
@@ -587,6 +619,7 @@ private:
 
     void _dispatchCommand( ICommand& command );
     void _redispatchCommands();
+    void _redispatchCommands( const uint128_t& objectID );
 
     /** The command functions. */
     bool _cmdAckRequest( ICommand& command );
@@ -351,6 +351,18 @@ CustomOCommand Node::send( const uint128_t& commandID, const bool multicast )
     return CustomOCommand( Connections( 1, connection ), commandID );
 }
 
+bool Node::flush()
+{
+    ConnectionPtr connection = _impl->outgoing;
+    ConnectionPtr multicast = _impl->outMulticast.data;
+    bool result = true;
+    if( connection )
+        result = connection->flush();
+    if( multicast )
+        result = multicast->flush() && result;
+    return result;
+}
+
 const NodeID& Node::getNodeID() const
 {
     return _impl->id;
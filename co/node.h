@@ -158,6 +158,18 @@ public:
      */
     CO_API CustomOCommand send( const uint128_t& commandID,
                                 const bool multicast = false );
+
+    /**
+     * Send all commands buffered on the connections to this node.
+     *
+     * Commands are only buffered when send coalescing is enabled on the
+     * connection. Thread safe.
+     *
+     * @return true if all data has been sent, false on error.
+     * @sa Connection::setSendCoalescing()
+     * @version 1.4
+     */
+    CO_API bool flush();
     //@}
 
     /** @internal @return last receive time. */
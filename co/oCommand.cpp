@@ -33,13 +33,20 @@ class OCommand
 public:
     OCommand( co::Dispatcher* const dispatcher_, LocalNodePtr localNode_ )
         : isLocked( false )
+        , isPadded( false )
         , size( 0 )
+        , body( 0 )
+        , nBodyChunks( 0 )
         , dispatcher( dispatcher_ )
         , localNode( localNode_ )
     {}
 
     bool isLocked;
+    bool isPadded; //!< padding was sent with the header and body
     uint64_t size;
+    const co::Connection::Chunk* body; //!< to send along with the header
+    size_t nBodyChunks;
+    ConstBufferPtr bodyOwner; //!< of the big body chunks
     co::Dispatcher* const dispatcher;
     LocalNodePtr localNode;
 };
@@ -76,14 +83,19 @@ OCommand::~OCommand()
         LBASSERT( _impl->size > 0 );
         const uint64_t size = _impl->size + getBuffer().getSize();
         const Connections& connections = getConnections();
-        if( size < COMMAND_MINSIZE ) // Fill send to minimal size
+        // Fill send to minimal size
+        if( size < COMMAND_MINSIZE && !_impl->isPadded )
         {
             const size_t delta = COMMAND_MINSIZE - size;
-            void* padding = alloca( delta );
+            void* padding = 0;
             for( ConnectionsCIter i = connections.begin();
                  i != connections.end(); ++i )
             {
                 ConnectionPtr connection = *i;
+                if( connection->getFraming() != FRAMING_PADDED )
+                    continue;
+                if( !padding )
+                    padding = alloca( delta );
                 connection->send( padding, delta, true );
             }
         }
@@ -94,6 +106,7 @@ OCommand::~OCommand()
             connection->unlockSend();
         }
         _impl->isLocked = false;
+        _impl->isPadded = false;
         _impl->size = 0;
         reset();
     }
@@ -146,6 +159,22 @@ void OCommand::sendHeader( const uint64_t additionalSize )
     flush( true );
 }
 
+void OCommand::sendHeader( const Connection::Chunk* body, const size_t nChunks,
+                           const ConstBufferPtr& owner )
+{
+    uint64_t additionalSize = 0;
+    for( size_t i = 0; i < nChunks; ++i )
+        additionalSize += body[i].size;
+
+    _impl->body = body;
+    _impl->nBodyChunks = nChunks;
+    _impl->bodyOwner = owner;
+    sendHeader( additionalSize );
+    _impl->body = 0;
+    _impl->nBodyChunks = 0;
+    _impl->bodyOwner = 0;
+}
+
 size_t OCommand::getSize()
 {
     return sizeof( uint64_t ) + sizeof( uint32_t ) + sizeof( uint32_t );
@@ -165,17 +194,62 @@ void OCommand::sendData( const void* buffer LB_UNUSED, const uint64_t size,
     // cppcheck-suppress unreadVariable
     uint8_t* bytes = getBuffer().getData();
     reinterpret_cast< uint64_t* >( bytes )[ 0 ] = _impl->size + size;
-    const uint64_t sendSize = _impl->isLocked ? size : LB_MAX( size,
+    if( _impl->body )
+    {
+        _sendWithBody( size );
+        return;
+    }
+
+    const uint64_t paddedSize = _impl->isLocked ? size : LB_MAX( size,
                                                                COMMAND_MINSIZE);
     const Connections& connections = getConnections();
     for( ConnectionsCIter i = connections.begin(); i != connections.end(); ++i )
     {
         ConnectionPtr connection = *i;
         if ( connection )
-            connection->send( bytes, sendSize, _impl->isLocked );
+        {
+            const bool padded = connection->getFraming() == FRAMING_PADDED;
+            connection->send( bytes, padded ? paddedSize : size,
+                              _impl->isLocked );
+        }
         else
             LBERROR << "Can't send data, node is closed" << std::endl;
     }
 }
 
+void OCommand::_sendWithBody( const uint64_t size )
+{
+    static const uint8_t padding[ COMMAND_MINSIZE ] = { 0 };
+
+    LBASSERT( _impl->isLocked );
+    const uint64_t totalSize = _impl->size + size;
+    Connection::Chunk* chunks = static_cast< Connection::Chunk* >(
+                      alloca(( _impl->nBodyChunks + 2 ) * sizeof( Connection::Chunk )));
+    chunks[0].data = getBuffer().getData();
+    chunks[0].size = size;
+    ::memcpy( chunks + 1, _impl->body,
+              _impl->nBodyChunks * sizeof( Connection::Chunk ));
+
+    const Connections& connections = getConnections();
+    for( ConnectionsCIter i = connections.begin(); i != connections.end(); ++i )
+    {
+        ConnectionPtr connection = *i;
+        if( !connection )
+        {
+            LBERROR << "Can't send data, node is closed" << std::endl;
+            continue;
+        }
+
+        size_t nChunks = _impl->nBodyChunks + 1;
+        if( totalSize < COMMAND_MINSIZE &&
+            connection->getFraming() == FRAMING_PADDED )
+        {
+            chunks[ nChunks ].data = padding;
+            chunks[ nChunks++ ].size = COMMAND_MINSIZE - totalSize;
+        }
+        LBCHECK( connection->send( chunks, nChunks, _impl->bodyOwner, true ));
+    }
+    _impl->isPadded = true;
+}
+
 }
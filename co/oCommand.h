@@ -77,6 +77,19 @@ public:
      */
     CO_API void sendHeader( const uint64_t additionalSize );
 
+    /** @internal
+     * Send the header and the given data along with this command.
+     *
+     * Sends the header and body with one vectored send per connection, and
+     * locks the connections like sendHeader( const uint64_t ).
+     *
+     * @param body the data to send after the header.
+     * @param nChunks the number of body chunks.
+     * @param owner the owner of the big body chunks, see Connection::send().
+     */
+    CO_API void sendHeader( const Connection::Chunk* body,
+                            const size_t nChunks, const ConstBufferPtr& owner );
+
     /** @internal @return the static base header size of this command. */
     CO_API static size_t getSize();
 
@@ -90,6 +103,7 @@ private:
     detail::OCommand* const _impl;
 
     void _init( const uint32_t cmd, const uint32_t type );
+    void _sendWithBody( const uint64_t size );
 };
 }
 
@@ -21,6 +21,8 @@
 #include "objectDataICommand.h"
 
 #include "buffer.h"
+#include "pooled.h"
+
 #include <pression/plugins/compressorTypes.h>
 
 namespace co
@@ -28,7 +30,7 @@ namespace co
 namespace detail
 {
 
-class ObjectDataICommand
+class ObjectDataICommand : public Pooled< ObjectDataICommand >
 {
 public:
     ObjectDataICommand()
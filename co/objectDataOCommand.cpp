@@ -98,14 +98,14 @@ ObjectDataOCommand::~ObjectDataOCommand()
 {
     if( _impl->stream && _impl->size > 0 )
     {
-        sendHeader( _impl->size );
-        const Connections& connections = getConnections();
-        for( ConnectionsCIter i = connections.begin(); i != connections.end();
-             ++i )
-        {
-            ConnectionPtr conn = *i;
-            _impl->stream->sendBody( conn, _impl->data, _impl->size );
-        }
+        const size_t nChunks = _impl->stream->getNumBodyChunks();
+        Connection::Chunk* chunks = static_cast< Connection::Chunk* >(
+                                alloca( nChunks * sizeof( Connection::Chunk )));
+        uint64_t* sizes = static_cast< uint64_t* >(
+                                alloca( nChunks * sizeof( uint64_t )));
+
+        _impl->stream->getBody( _impl->data, _impl->size, chunks, sizes );
+        sendHeader( chunks, nChunks, _impl->stream->getBodyOwner( ));
     }
 
     delete _impl;
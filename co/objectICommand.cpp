@@ -21,6 +21,7 @@
 #include "objectICommand.h"
 
 #include "buffer.h"
+#include "pooled.h"
 
 
 namespace co
@@ -28,7 +29,7 @@ namespace co
 namespace detail
 {
 
-class ObjectICommand
+class ObjectICommand : public Pooled< ObjectICommand >
 {
 public:
     ObjectICommand()
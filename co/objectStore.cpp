@@ -281,7 +281,7 @@ void ObjectStore::_attach( Object* object, const uint128_t& id,
         objects.push_back( object );
     }
 
-    _localNode->flushCommands(); // redispatch pending commands
+    _localNode->_redispatchCommands( id ); // commands waiting for object
 
     LBLOG( LOG_OBJECTS ) << "attached " << *object << " @"
                          << static_cast< void* >( object ) << std::endl;
@@ -669,7 +669,9 @@ bool ObjectStore::notifyCommandThreadIdle()
 void ObjectStore::removeNode( NodePtr node )
 {
     lunchbox::Request< void > request = _localNode->registerRequest< void >();
-    _localNode->send( CMD_NODE_REMOVE_NODE ) << node.get() << request;
+    // local command dispatching
+    OCommand( _localNode, _localNode, CMD_NODE_REMOVE_NODE )
+        << node.get() << request;
 }
 
 //===========================================================================
@@ -21,6 +21,7 @@
 #include "pipeConnection.h"
 
 #include "connectionDescription.h"
+#include "global.h"
 #include "node.h"
 #ifdef _WIN32
 #  include "namedPipeConnection.h"
@@ -30,11 +31,20 @@
 #include <lunchbox/thread.h>
 
 #include <errno.h>
+#ifdef __linux__
+#  include <fcntl.h>
+#  include <sys/uio.h>
+#  include <unistd.h>
+#endif
 
 namespace co
 {
 
 PipeConnection::PipeConnection()
+#ifdef __linux__
+    : _pipeSize( 0 )
+    , _spliceSize( 0 )
+#endif
 {
     ConnectionDescriptionPtr description = _getDescription();
     description->type = CONNECTIONTYPE_PIPE;
@@ -175,14 +185,93 @@ bool PipeConnection::_createPipes()
 
     _sibling->_readFD  = pipeFDs[0];
     _writeFD = pipeFDs[1];
+
+#ifdef __linux__
+    _setupPipe();
+    _sibling->_setupPipe();
+#endif
     return true;
 }
 
+#ifdef __linux__
+namespace
+{
+static const int _pipeCapacity = LB_1MB;
+static const uint64_t _pageSize = ::sysconf( _SC_PAGESIZE );
+}
+
+void PipeConnection::_setupPipe()
+{
+    // A larger pipe needs fewer wakeups. The size is limited by
+    // /proc/sys/fs/pipe-max-size for unprivileged processes, keep the default
+    // size if the request fails.
+    ::fcntl( _writeFD, F_SETPIPE_SZ, _pipeCapacity );
+    const int size = ::fcntl( _writeFD, F_GETPIPE_SZ );
+    _pipeSize = size > 0 ? size : 0;
+
+    const int32_t spliceSize =
+        Global::getIAttribute( Global::IATTR_PIPE_SPLICE_SIZE );
+    if( spliceSize <= 0 || _pipeSize == 0 )
+        _spliceSize = 0;
+    else
+        _spliceSize = LB_MAX( uint64_t( spliceSize ), 2 * _pipeSize );
+}
+
+int64_t PipeConnection::writev( const Chunk* chunks, const size_t nChunks )
+{
+    const Chunk& chunk = chunks[0];
+    const uintptr_t address = reinterpret_cast< uintptr_t >( chunk.data );
+    if( _spliceSize == 0 || chunk.size < _spliceSize ||
+        ( address & ( _pageSize - 1 )) != 0 )
+    {
+        return FDConnection::writev( chunks, nChunks );
+    }
+    return _writeSpliced( chunk.data, chunk.size );
+}
+
+int64_t PipeConnection::_writeSpliced( const void* buffer,
+                                       const uint64_t bytes )
+{
+    if( !isConnected() || _writeFD < 1 )
+        return -1;
+
+    // Map the pages of all but the last pipe size worth of data into the
+    // pipe, the receiver copies them out directly. The remainder is written
+    // normally: once it is in the pipe, the pipe no longer references any of
+    // the mapped pages, so the caller can reuse the buffer when we return.
+    const uint8_t* ptr = static_cast< const uint8_t* >( buffer );
+    const uint64_t spliceBytes = bytes - _pipeSize;
+    uint64_t spliced = 0;
+    while( spliced < spliceBytes )
+    {
+        struct iovec vector;
+        vector.iov_base = const_cast< uint8_t* >( ptr + spliced );
+        vector.iov_len = spliceBytes - spliced;
+
+        const ssize_t result = ::vmsplice( _writeFD, &vector, 1, 0 );
+        if( result < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            LBWARN << "Error during vmsplice: " << lunchbox::sysError
+                   << std::endl;
+            return -1;
+        }
+        spliced += result;
+    }
+
+    const Chunk rest = { ptr + spliced, bytes - spliced };
+    const int64_t written = FDConnection::writev( &rest, 1 );
+    return written < 0 ? -1 : int64_t( spliced ) + written;
+}
+#endif
+
 void PipeConnection::_close()
 {
     if( isClosed( ))
         return;
 
+    _setState( STATE_CLOSING ); // stops the send queue using the pipe
     if( _writeFD > 0 )
     {
         ::close( _writeFD );
@@ -78,6 +78,8 @@ namespace co
                                   const bool ignored ) override;
         int64_t write( const void* buffer,
                                const uint64_t bytes ) override;
+#elif defined __linux__
+        int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
 #endif
 
     private:
@@ -88,6 +90,12 @@ namespace co
         NamedPipeConnectionPtr _namedPipe;
 
         LB_TS_VAR( _recvThread );
+#elif defined __linux__
+        uint64_t _pipeSize; //!< capacity of the write pipe
+        uint64_t _spliceSize; //!< min size for vmsplice(), 0 if disabled
+
+        void _setupPipe();
+        int64_t _writeSpliced( const void* buffer, const uint64_t bytes );
 #endif
 
         bool _createPipes();
@@ -0,0 +1,140 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CO_POOLED_H
+#define CO_POOLED_H
+
+#include <lunchbox/debug.h>
+#include <lunchbox/scopedMutex.h>
+#include <lunchbox/spinLock.h>
+
+#include <new>
+
+namespace co
+{
+namespace detail
+{
+/** @internal
+ * Base class recycling the memory of frequently allocated objects.
+ *
+ * Used for the implementation objects of commands and input streams, which are
+ * created and copied several times for each received command. Freed memory is
+ * kept in a per-thread cache, which is exchanged in batches with a shared
+ * list. Objects may be freed by another thread than the allocating one. The
+ * memory is retained for the lifetime of the process.
+ */
+template< class T > class Pooled
+{
+public:
+    static void* operator new( const size_t size )
+    {
+        static_assert( sizeof( T ) >= sizeof( Node ), "Object too small" );
+        LBASSERT( size == sizeof( T ));
+        List& cache = _getCache();
+        if( !cache.head )
+            _getShared().take( cache );
+        if( !cache.head )
+            return ::operator new( size );
+
+        Node* node = cache.head;
+        cache.head = node->next;
+        if( --cache.size == 0 )
+            cache.tail = 0;
+        return node;
+    }
+
+    static void operator delete( void* ptr )
+    {
+        if( !ptr )
+            return;
+
+        List& cache = _getCache();
+        Node* node = static_cast< Node* >( ptr );
+        node->next = cache.head;
+        cache.head = node;
+        if( !cache.tail )
+            cache.tail = node;
+        if( ++cache.size >= _batchSize )
+            _getShared().give( cache );
+    }
+
+private:
+    enum { _batchSize = 256 };
+
+    struct Node
+    {
+        Node* next;
+    };
+
+    struct List
+    {
+        List() : head( 0 ), tail( 0 ), size( 0 ) {}
+        ~List() { if( head ) _getShared().give( *this ); } // thread exit
+
+        Node* head;
+        Node* tail;
+        size_t size;
+    };
+
+    class Shared
+    {
+    public:
+        void take( List& to )
+        {
+            lunchbox::ScopedFastWrite mutex( _lock );
+            to.head = _list.head;
+            to.tail = _list.tail;
+            to.size = _list.size;
+            _list.head = _list.tail = 0;
+            _list.size = 0;
+        }
+
+        void give( List& from )
+        {
+            lunchbox::ScopedFastWrite mutex( _lock );
+            from.tail->next = _list.head;
+            _list.head = from.head;
+            if( !_list.tail )
+                _list.tail = from.tail;
+            _list.size += from.size;
+            from.head = from.tail = 0;
+            from.size = 0;
+        }
+
+    private:
+        lunchbox::SpinLock _lock;
+        List _list;
+    };
+
+    static List& _getCache()
+    {
+        static thread_local List cache;
+        return cache;
+    }
+
+    static Shared& _getShared()
+    {
+        // never destroyed, objects may be freed during static destruction
+        static Shared* shared = new Shared;
+        return *shared;
+    }
+};
+}
+}
+
+#endif // CO_POOLED_H
@@ -40,6 +40,11 @@
 #else
 #  define CO_RSP_DEFAULT_PORT ( (getuid() % 64511) + 1024 )
 #endif
+#ifdef __linux__
+#  define CO_RSP_BATCH_IO // recvmmsg and sendmmsg
+#  include <errno.h>
+#  include <sys/socket.h>
+#endif
 
 
 // Note: Do not use version > 255, endianness detection magic relies on this.
@@ -76,6 +81,36 @@ lunchbox::Clock instrumentClock;
 static uint16_t _numBuffers = 0;
 }
 
+/** Datagrams received and sent with one system call each. */
+struct RSPConnection::Batch
+{
+#ifdef CO_RSP_BATCH_IO
+    Batch( const size_t size, const int32_t mtu )
+        : recvMsgs( size )
+        , recvIOVs( size )
+        , sendMsgs( size )
+        , sendIOVs( size )
+        , nSends( 0 )
+    {
+        for( size_t i = 0; i < size; ++i )
+            buffers.push_back( new Buffer( mtu ));
+    }
+
+    ~Batch()
+    {
+        for( BuffersCIter i = buffers.begin(); i != buffers.end(); ++i )
+            delete *i;
+    }
+
+    Buffers buffers; //!< Receive buffers, swapped with _recvBuffer to handle
+    std::vector< mmsghdr > recvMsgs;
+    std::vector< iovec > recvIOVs;
+    std::vector< mmsghdr > sendMsgs;
+    std::vector< iovec > sendIOVs;
+    size_t nSends; //!< Pending datagrams in sendMsgs
+#endif
+};
+
 RSPConnection::RSPConnection()
     : _id( 0 )
     , _idAccepted( false )
@@ -100,6 +135,7 @@ RSPConnection::RSPConnection()
     , _sequence( 0 )
     // ensure we have a handleConnectedTimeout before the write pop
     , _writeTimeOut( Global::IATTR_RSP_ACK_TIMEOUT * CO_RSP_MAX_TIMEOUTS * 2 )
+    , _batch( 0 )
 {
     _buildNewID();
     ConnectionDescriptionPtr description = _getDescription();
@@ -129,6 +165,7 @@ RSPConnection::~RSPConnection()
         delete _buffers.back();
         _buffers.pop_back();
     }
+    delete _batch;
 }
 
 void RSPConnection::_close()
@@ -294,6 +331,13 @@ bool RSPConnection::listen()
         return false;
     }
 
+#ifdef CO_RSP_BATCH_IO
+    const int32_t batchSize =
+        Global::getIAttribute( Global::IATTR_RSP_BATCH_SIZE );
+    if( batchSize > 1 && !_batch )
+        _batch = new Batch( batchSize, _mtu );
+#endif
+
     // init communication protocol thread
     _thread = new Thread( this );
     _bucketSize = 0;
@@ -615,10 +659,21 @@ void RSPConnection::_processOutgoing()
     }
 #endif
 
-    if( !_repeatQueue.empty( ))
-        _repeatData();
-    else
-        _writeData();
+#ifdef CO_RSP_BATCH_IO
+    const size_t burst = _batch ? _batch->sendMsgs.size() : 1;
+#else
+    const size_t burst = 1;
+#endif
+    for( size_t i = 0; i < burst; ++i )
+    {
+        if( !_repeatQueue.empty( ))
+            _repeatData();
+        else if( !_threadBuffers.isEmpty( ))
+            _writeData();
+        else
+            break;
+    }
+    _flushDatagrams();
 
     if( !_threadBuffers.isEmpty() || !_repeatQueue.empty( ))
     {
@@ -704,7 +759,7 @@ void RSPConnection::_writeData()
 
     _waitWritable( size ); // OPT: process incoming in between
     header->byteswap();
-    _write->send( boost::asio::buffer( header, size ));
+    _sendDatagram( header, size );
 
 #ifdef CO_INSTRUMENT_RSP
     ++nDatagrams;
@@ -717,6 +772,7 @@ void RSPConnection::_writeData()
     if( _children.size() == 1 ) // We're all alone
     {
         LBASSERT( _children.front()->_id == _id );
+        _flushDatagrams(); // before the buffer is handed to the reader
         _finishWriteQueue( _sequence - 1 );
     }
 }
@@ -732,6 +788,8 @@ void RSPConnection::_waitWritable( const uint64_t bytes )
     _bucketSize = LB_MIN( _bucketSize, _maxBucketSize );
 
     const uint64_t size = LB_MIN( bytes, static_cast< uint64_t >( _mtu ));
+    if( _bucketSize < size ) // send the burst instead of holding it back
+        _flushDatagrams();
     while( _bucketSize < size )
     {
         lunchbox::Thread::yield();
@@ -797,7 +855,7 @@ void RSPConnection::_repeatData()
             // send data
             _waitWritable( size ); // OPT: process incoming in between
             // already done by _writeData: header->byteswap();
-            _write->send( boost::asio::buffer( header, size ) );
+            _sendDatagram( header, size );
 #ifdef CO_INSTRUMENT_RSP
             ++nRepeated;
 #endif
@@ -813,6 +871,56 @@ void RSPConnection::_repeatData()
     }
 }
 
+void RSPConnection::_sendDatagram( const void* data, const size_t size )
+{
+#ifdef CO_RSP_BATCH_IO
+    if( _batch )
+    {
+        Batch& batch = *_batch;
+        iovec& iov = batch.sendIOVs[ batch.nSends ];
+        iov.iov_base = const_cast< void* >( data );
+        iov.iov_len = size;
+
+        mmsghdr& msg = batch.sendMsgs[ batch.nSends ];
+        ::memset( &msg, 0, sizeof( msg ));
+        msg.msg_hdr.msg_iov = &iov;
+        msg.msg_hdr.msg_iovlen = 1;
+
+        if( ++batch.nSends == batch.sendMsgs.size( ))
+            _flushDatagrams();
+        return;
+    }
+#endif
+    _write->send( boost::asio::buffer( data, size ));
+}
+
+void RSPConnection::_flushDatagrams()
+{
+#ifdef CO_RSP_BATCH_IO
+    if( !_batch )
+        return;
+
+    Batch& batch = *_batch;
+    size_t sent = 0;
+    while( sent < batch.nSends )
+    {
+        const int result = ::sendmmsg( _write->native(),
+                                       &batch.sendMsgs[ sent ],
+                                       unsigned( batch.nSends - sent ), 0 );
+        if( result < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            // dropped datagrams are repeated on nack
+            LBWARN << "sendmmsg failed: " << lunchbox::sysError << std::endl;
+            break;
+        }
+        sent += result;
+    }
+    batch.nSends = 0;
+#endif
+}
+
 void RSPConnection::_finishWriteQueue( const uint16_t sequence )
 {
     LBASSERT( !_writeBuffers.empty( ));
@@ -896,17 +1004,81 @@ void RSPConnection::_finishWriteQueue( const uint16_t sequence )
 
 void RSPConnection::_handlePacket( const boost::system::error_code& /* error */,
                                    const size_t bytes )
+{
+    const bool connected = isListening();
+    if( !_handleDatagram( bytes ))
+        return;
+
+    if( connected )
+        _processOutgoing();
+
+    //LBLOG( LOG_RSP ) << "_handlePacket timeout " << timeout << std::endl;
+    _asyncReceiveFrom();
+}
+
+void RSPConnection::_handleBatch( const boost::system::error_code& error )
+{
+#ifdef CO_RSP_BATCH_IO
+    if( error )
+    {
+        _handlePacket( error, 0 );
+        return;
+    }
+
+    Batch& batch = *_batch;
+    const size_t size = batch.buffers.size();
+    for( size_t i = 0; i < size; ++i )
+    {
+        iovec& iov = batch.recvIOVs[i];
+        iov.iov_base = batch.buffers[i]->getData();
+        iov.iov_len = _mtu;
+
+        mmsghdr& msg = batch.recvMsgs[i];
+        ::memset( &msg, 0, sizeof( msg ));
+        msg.msg_hdr.msg_iov = &iov;
+        msg.msg_hdr.msg_iovlen = 1;
+    }
+
+    const int nPackets = ::recvmmsg( _read->native(), batch.recvMsgs.data(),
+                                     unsigned( size ), MSG_DONTWAIT, 0 );
+    if( nPackets < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+        errno != EINTR )
+    {
+        LBWARN << "recvmmsg failed: " << lunchbox::sysError << std::endl;
+    }
+
+    // handle all packets, then send once for the whole batch
+    bool connected = false;
+    for( int i = 0; i < nPackets; ++i )
+    {
+        connected = connected || isListening();
+
+        Buffer& buffer = *batch.buffers[i];
+        _recvBuffer.swap( buffer );
+        const bool running = _handleDatagram( batch.recvMsgs[i].msg_len );
+        _recvBuffer.swap( buffer ); // might be another buffer of the same size
+        if( !running )
+            return;
+    }
+
+    if( connected )
+        _processOutgoing();
+    _asyncReceiveFrom();
+#else
+    LBUNREACHABLE;
+    _handlePacket( error, 0 );
+#endif
+}
+
+bool RSPConnection::_handleDatagram( const size_t bytes )
 {
     if( isListening( ))
     {
         _handleConnectedData( bytes );
-
-        if( isListening( ))
-            _processOutgoing();
-        else
+        if( !isListening( ))
         {
             _ioService.stop();
-            return;
+            return false;
         }
     }
     else if( bytes >= sizeof( DatagramNode ))
@@ -916,9 +1088,7 @@ void RSPConnection::_handlePacket( const boost::system::error_code& /* error */,
         else
             _handleAcceptIDData( bytes );
     }
-
-    //LBLOG( LOG_RSP ) << "_handlePacket timeout " << timeout << std::endl;
-    _asyncReceiveFrom();
+    return true;
 }
 
 void RSPConnection::_handleAcceptIDData( const size_t bytes )
@@ -1046,6 +1216,14 @@ void RSPConnection::_handleConnectedData( const size_t bytes )
 
 void RSPConnection::_asyncReceiveFrom()
 {
+    if( _batch ) // wait until readable, receive all pending in _handleBatch
+    {
+        _read->async_receive( boost::asio::null_buffers(),
+                              boost::bind( &RSPConnection::_handleBatch, this,
+                                           boost::asio::placeholders::error ));
+        return;
+    }
+
     _read->async_receive_from(
         boost::asio::buffer( _recvBuffer.getData(), _mtu ), _readAddr,
         boost::bind( &RSPConnection::_handlePacket, this,
@@ -298,6 +298,9 @@ private:
 
     const unsigned _writeTimeOut;
 
+    struct Batch;
+    Batch* _batch; //!< Batched datagram I/O, 0 if not used
+
     void _close();
     uint16_t _buildNewID();
 
@@ -306,6 +309,10 @@ private:
     void _repeatData();
     void _finishWriteQueue( const uint16_t sequence );
 
+    /** Send a data datagram, batched until _flushDatagrams() if enabled */
+    void _sendDatagram( const void* data, const size_t size );
+    void _flushDatagrams();
+
     bool _handleData( const size_t bytes );
     bool _handleAck( const size_t bytes );
     bool _handleNack();
@@ -324,6 +331,9 @@ private:
     /* handle data about the comunication state */
     void _handlePacket( const boost::system::error_code& error,
                         const size_t bytes );
+    void _handleBatch( const boost::system::error_code& error );
+    /* @return false if the protocol thread stops */
+    bool _handleDatagram( const size_t bytes );
     void _handleConnectedData( const size_t bytes );
     void _handleInitData( const size_t bytes, const bool connected );
     void _handleAcceptIDData( const size_t bytes );
@@ -341,7 +351,7 @@ private:
     /** find the connection corresponding to the identifier */
     RSPConnectionPtr _findConnection( const uint16_t id );
 
-    /** Sleep until allowed to send according to send rate */
+    /** Flush batched datagrams and sleep until allowed by the send rate */
     void _waitWritable( const uint64_t bytes );
 
     /** format and send a datagram count node */
@@ -0,0 +1,663 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "shmConnection.h"
+
+#include "connectionDescription.h"
+#include "exception.h"
+#include "global.h"
+
+#include <lunchbox/clock.h>
+#include <lunchbox/log.h>
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace co
+{
+namespace
+{
+static const uint32_t _magic = 0x436f5368; // 'CoSh'
+static const uint64_t _headerSize = 4096;
+static const uint64_t _minRingSize = 65536;
+static const uint64_t _maxRingSize = 1ull << 40;
+static const int _acceptTimeout = 1000; // ms, the connector sends right away
+static const int _nFDs = 3; // segment, data event for each direction
+
+/** @return the size of the address of the listener for a segment name. */
+socklen_t _getAddress( const std::string& name, sockaddr_un& address )
+{
+    ::memset( &address, 0, sizeof( address ));
+    address.sun_family = AF_UNIX;
+
+    // abstract namespace, starts with a null byte and leaves no file behind
+    const std::string path = "collage-shm-" + name;
+    const size_t length = LB_MIN( path.length(),
+                                  sizeof( address.sun_path ) - 1 );
+    ::memcpy( address.sun_path + 1, path.c_str(), length );
+    return socklen_t( offsetof( sockaddr_un, sun_path ) + 1 + length );
+}
+
+uint64_t _getRingSize()
+{
+    const uint64_t size = LB_MAX( int64_t( Global::getIAttribute(
+                                       Global::IATTR_SHM_RING_SIZE )),
+                                  int64_t( _minRingSize ));
+    uint64_t ringSize = _minRingSize;
+    while( ringSize < size )
+        ringSize <<= 1;
+    return ringSize;
+}
+
+/** Wait on the futex for a change of the given value, shared by processes. */
+void _futexWait( std::atomic< uint32_t >& word, const uint32_t value,
+                 const int ms )
+{
+    timespec timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_nsec = ( ms % 1000 ) * 1000000;
+    ::syscall( SYS_futex, &word, FUTEX_WAIT, value, &timeout, 0, 0 );
+}
+
+void _futexWake( std::atomic< uint32_t >& word )
+{
+    ::syscall( SYS_futex, &word, FUTEX_WAKE, 1, 0, 0, 0 );
+}
+}
+
+namespace detail
+{
+/** The control block of one direction, shared by both processes. */
+struct Queue
+{
+    alignas( 64 ) std::atomic< uint64_t > head; //!< bytes written, producer
+    alignas( 64 ) std::atomic< uint64_t > tail; //!< bytes read, consumer
+    std::atomic< uint32_t > space; //!< futex, bumped when tail moves
+    std::atomic< uint32_t > waiting; //!< the producer waits for space
+    std::atomic< uint32_t > closed; //!< one of the endpoints closed
+};
+
+/** The header of the shared memory segment, followed by the two rings. */
+struct Segment
+{
+    uint32_t magic;
+    uint64_t ringSize;
+    Queue queues[2]; //!< written by the connecting and the accepting side
+};
+
+class ShmConnection
+{
+public:
+    ShmConnection()
+        : segment( 0 )
+        , mapSize( 0 )
+        , ringSize( 0 )
+        , in( 0 )
+        , out( 0 )
+        , inData( 0 )
+        , outData( 0 )
+        , inEvent( -1 )
+        , outEvent( -1 )
+        , listenFD( -1 )
+        , socketFD( -1 )
+        , epollFD( -1 )
+    {}
+
+    /** Map the segment and set up the rings for the given side. */
+    bool map( const int fd, const uint64_t size, const bool isConnector )
+    {
+        mapSize = _headerSize + 2 * size;
+        void* data = ::mmap( 0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             fd, 0 );
+        if( data == MAP_FAILED )
+        {
+            LBWARN << "mmap failed: " << lunchbox::sysError << std::endl;
+            return false;
+        }
+
+        segment = static_cast< Segment* >( data );
+        ringSize = size;
+        uint8_t* rings = static_cast< uint8_t* >( data ) + _headerSize;
+        in = &segment->queues[ isConnector ? 1 : 0 ];
+        out = &segment->queues[ isConnector ? 0 : 1 ];
+        inData = rings + ( isConnector ? size : 0 );
+        outData = rings + ( isConnector ? 0 : size );
+        return true;
+    }
+
+    void unmap()
+    {
+        if( segment )
+            ::munmap( segment, mapSize );
+        segment = 0;
+        in = out = 0;
+        inData = outData = 0;
+    }
+
+    void closeFDs()
+    {
+        if( inEvent >= 0 )
+            ::close( inEvent );
+        if( outEvent >= 0 )
+            ::close( outEvent );
+        if( listenFD >= 0 )
+            ::close( listenFD );
+        if( socketFD >= 0 )
+            ::close( socketFD );
+        if( epollFD >= 0 )
+            ::close( epollFD );
+        inEvent = outEvent = listenFD = socketFD = epollFD = -1;
+    }
+
+    /** Watch the data event and the liveness socket through one notifier. */
+    bool setupNotifier()
+    {
+        epollFD = ::epoll_create1( EPOLL_CLOEXEC );
+        if( epollFD < 0 )
+        {
+            LBWARN << "epoll_create1 failed: " << lunchbox::sysError
+                   << std::endl;
+            return false;
+        }
+
+        const int fds[] = { inEvent, socketFD };
+        for( const int fd : fds )
+        {
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            if( ::epoll_ctl( epollFD, EPOLL_CTL_ADD, fd, &event ) != 0 )
+            {
+                LBWARN << "epoll_ctl failed: " << lunchbox::sysError
+                       << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @return false if the peer process went away. The peer never sends on
+     *         the socket after the handshake, so any event on it is a hangup.
+     */
+    bool isPeerAlive() const
+    {
+        struct pollfd pollFD = { socketFD, POLLIN | POLLRDHUP, 0 };
+        return ::poll( &pollFD, 1, 0 ) == 0;
+    }
+
+    static void signal( const int fd )
+    {
+        const uint64_t value = 1;
+        if( ::write( fd, &value, sizeof( value )) != sizeof( value ))
+            LBWARN << "eventfd write failed: " << lunchbox::sysError
+                   << std::endl;
+    }
+
+    void reset()
+    {
+        uint64_t value;
+        if( ::read( inEvent, &value, sizeof( value )) < 0 && errno != EAGAIN )
+            LBWARN << "eventfd read failed: " << lunchbox::sysError
+                   << std::endl;
+    }
+
+    /** @return false on timeout, true if data may be available. */
+    bool wait( const uint32_t timeout )
+    {
+        struct pollfd fds[2];
+        fds[0].fd = inEvent;
+        fds[0].events = POLLIN;
+        fds[1].fd = socketFD;
+        fds[1].events = POLLIN | POLLRDHUP;
+        const int ms = timeout == LB_TIMEOUT_INDEFINITE ? -1 : int( timeout );
+        const int result = ::poll( fds, 2, ms );
+        if( result < 0 && errno != EINTR )
+            LBWARN << "poll failed: " << lunchbox::sysError << std::endl;
+        return result != 0;
+    }
+
+    /** @return false if the peer closed, true once the out ring has space. */
+    bool waitForSpace( const uint64_t head )
+    {
+        const uint32_t timeout = Global::getTimeout();
+        lunchbox::Clock clock;
+        while( true )
+        {
+            const uint32_t space = out->space.load();
+            out->waiting.store( 1 );
+            if( head - out->tail.load() < ringSize )
+                return true;
+            if( out->closed.load() || !isPeerAlive( ))
+                return false;
+
+            if( timeout != LB_TIMEOUT_INDEFINITE &&
+                clock.getTime64() > int64_t( timeout ))
+            {
+                throw Exception( Exception::TIMEOUT_WRITE );
+            }
+            _futexWait( out->space, space, 100 /*ms*/ );
+        }
+    }
+
+    /** Wake the peer's producer after the in ring got space. */
+    void notifySpace()
+    {
+        if( !in->waiting.exchange( 0 ))
+            return;
+        ++in->space;
+        _futexWake( in->space );
+    }
+
+    Segment* segment;
+    uint64_t mapSize;
+    uint64_t ringSize; //!< power of two
+    Queue* in; //!< data sent by the peer
+    Queue* out; //!< data sent to the peer
+    uint8_t* inData;
+    uint8_t* outData;
+    int inEvent; //!< signalled by the peer when in got data
+    int outEvent; //!< signalled for the peer when out got data
+    int listenFD; //!< unix socket accepting connections
+    int socketFD; //!< connected unix socket, hangs up when the peer dies
+    int epollFD; //!< notifier for inEvent and socketFD
+};
+}
+
+ShmConnection::ShmConnection()
+    : _impl( new detail::ShmConnection )
+{
+    ConnectionDescriptionPtr description = _getDescription();
+    description->type = CONNECTIONTYPE_SHM;
+    description->bandwidth = 1024000;
+}
+
+ShmConnection::~ShmConnection()
+{
+    _close();
+    delete _impl;
+}
+
+//----------------------------------------------------------------------
+// connect
+//----------------------------------------------------------------------
+bool ShmConnection::connect()
+{
+    ConstConnectionDescriptionPtr description = getDescription();
+    LBASSERT( description->type == CONNECTIONTYPE_SHM );
+    if( !isClosed() || description->filename.empty( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    const int fd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    sockaddr_un address;
+    const socklen_t length = _getAddress( description->filename, address );
+    if( fd < 0 || ::connect( fd, (sockaddr*)&address, length ) != 0 )
+    {
+        LBDEBUG << "Could not connect to shared memory listener '"
+                << description->filename << "': " << lunchbox::sysError
+                << std::endl;
+        if( fd >= 0 )
+            ::close( fd );
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    // create the segment and the events, the listener gets them over fd
+    uint64_t ringSize = _getRingSize();
+    const int fds[ _nFDs ] = {
+        ::memfd_create( description->filename.c_str(), MFD_CLOEXEC ),
+        ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ),
+        ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC )
+    };
+
+    bool ok = fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 &&
+              ::ftruncate( fds[0], _headerSize + 2 * ringSize ) == 0 &&
+              _impl->map( fds[0], ringSize, true );
+    if( ok )
+    {
+        detail::Segment* segment = new( _impl->segment ) detail::Segment;
+        segment->magic = _magic;
+        segment->ringSize = ringSize;
+        for( size_t i = 0; i < 2; ++i )
+        {
+            detail::Queue& queue = segment->queues[i];
+            queue.head = 0;
+            queue.tail = 0;
+            queue.space = 0;
+            queue.waiting = 0;
+            queue.closed = 0;
+        }
+
+        char control[ CMSG_SPACE( sizeof( fds )) ];
+        ::memset( control, 0, sizeof( control ));
+        iovec vector = { &ringSize, sizeof( ringSize ) };
+        msghdr message;
+        ::memset( &message, 0, sizeof( message ));
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof( control );
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR( &message );
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN( sizeof( fds ));
+        ::memcpy( CMSG_DATA( cmsg ), fds, sizeof( fds ));
+
+        // wait for the acknowledgement of the listener
+        uint8_t ack = 0;
+        struct pollfd pollFD = { fd, POLLIN, 0 };
+        const uint32_t timeout = Global::getTimeout();
+        ok = ::sendmsg( fd, &message, MSG_NOSIGNAL ) ==
+                 ssize_t( sizeof( ringSize )) &&
+             ::poll( &pollFD, 1, timeout == LB_TIMEOUT_INDEFINITE ?
+                                     -1 : int( timeout )) == 1 &&
+             ::recv( fd, &ack, 1, 0 ) == 1 && ack == 1;
+    }
+
+    if( fds[0] >= 0 )
+        ::close( fds[0] ); // the mapping keeps the segment alive
+    _impl->socketFD = fd;
+    _impl->outEvent = fds[1];
+    _impl->inEvent = fds[2];
+    ok = ok && _impl->setupNotifier();
+
+    if( !ok )
+    {
+        LBWARN << "Shared memory handshake with '" << description->filename
+               << "' failed: " << lunchbox::sysError << std::endl;
+        _impl->unmap();
+        _impl->closeFDs();
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    _setState( STATE_CONNECTED );
+    LBDEBUG << "Connected " << description->toString() << std::endl;
+    return true;
+}
+
+bool ShmConnection::listen()
+{
+    ConstConnectionDescriptionPtr description = getDescription();
+    LBASSERT( description->type == CONNECTIONTYPE_SHM );
+    if( !isClosed() || description->filename.empty( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    const int fd = ::socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    sockaddr_un address;
+    const socklen_t length = _getAddress( description->filename, address );
+    if( fd < 0 || ::bind( fd, (sockaddr*)&address, length ) != 0 ||
+        ::listen( fd, SOMAXCONN ) != 0 )
+    {
+        LBWARN << "Could not listen on shared memory connection '"
+               << description->filename << "': " << lunchbox::sysError
+               << std::endl;
+        if( fd >= 0 )
+            ::close( fd );
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    _impl->listenFD = fd;
+    _setState( STATE_LISTENING );
+    LBDEBUG << "Listening on " << description->toString() << std::endl;
+    return true;
+}
+
+void ShmConnection::abortSends()
+{
+    if( !_impl->out )
+        return;
+
+    // waitForSpace() gives up once the ring is closed
+    _impl->out->closed = 1;
+    ++_impl->out->space;
+    _futexWake( _impl->out->space );
+}
+
+void ShmConnection::_close()
+{
+    if( isClosed( ))
+        return;
+
+    _setState( STATE_CLOSING ); // stops the send queue using the segment
+
+    if( _impl->segment )
+    {
+        _impl->out->closed = 1;
+        _impl->in->closed = 1;
+        ++_impl->in->space; // wake the peer's blocked producer
+        _futexWake( _impl->in->space );
+        detail::ShmConnection::signal( _impl->outEvent );
+    }
+
+    _impl->unmap();
+    _impl->closeFDs();
+    _setState( STATE_CLOSED );
+}
+
+ConnectionPtr ShmConnection::acceptSync()
+{
+    if( !isListening( ))
+        return 0;
+
+    const int fd = ::accept4( _impl->listenFD, 0, 0, SOCK_CLOEXEC );
+    if( fd < 0 )
+    {
+        LBWARN << "accept failed: " << lunchbox::sysError << std::endl;
+        return 0;
+    }
+
+    uint64_t ringSize = 0;
+    int fds[ _nFDs ] = { -1, -1, -1 };
+    char control[ CMSG_SPACE( sizeof( fds )) ];
+    iovec vector = { &ringSize, sizeof( ringSize ) };
+    msghdr message;
+    ::memset( &message, 0, sizeof( message ));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof( control );
+
+    // bound the wait, acceptSync runs on the receiver thread
+    struct pollfd pollFD = { fd, POLLIN, 0 };
+    if( ::poll( &pollFD, 1, _acceptTimeout ) == 1 &&
+        ::recvmsg( fd, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT ) ==
+        ssize_t( sizeof( ringSize )))
+    {
+        const cmsghdr* cmsg = CMSG_FIRSTHDR( &message );
+        if( cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN( sizeof( fds )))
+        {
+            ::memcpy( fds, CMSG_DATA( cmsg ), sizeof( fds ));
+        }
+    }
+
+    ShmConnectionPtr newConnection = new ShmConnection;
+    detail::ShmConnection* impl = newConnection->_impl;
+    impl->socketFD = fd;
+    impl->inEvent = fds[1];
+    impl->outEvent = fds[2];
+
+    // the segment has to be as large as its header claims before mapping it
+    struct stat info;
+    const bool mapped = fds[0] >= 0 && ringSize >= _minRingSize &&
+                        ringSize <= _maxRingSize &&
+                        ( ringSize & ( ringSize - 1 )) == 0 &&
+                        ::fstat( fds[0], &info ) == 0 &&
+                        uint64_t( info.st_size ) >=
+                            _headerSize + 2 * ringSize &&
+                        impl->map( fds[0], ringSize, false ) &&
+                        impl->segment->magic == _magic &&
+                        impl->segment->ringSize == ringSize;
+    if( fds[0] >= 0 )
+        ::close( fds[0] );
+
+    const uint8_t ack = 1;
+    if( !mapped || impl->inEvent < 0 || impl->outEvent < 0 ||
+        !impl->setupNotifier() || ::send( fd, &ack, 1, MSG_NOSIGNAL ) != 1 )
+    {
+        LBWARN << "Shared memory handshake failed" << std::endl;
+        impl->unmap();
+        impl->closeFDs();
+        return 0;
+    }
+
+    ConnectionDescriptionPtr description = newConnection->_getDescription();
+    description->filename = getDescription()->filename;
+    description->bandwidth = getDescription()->bandwidth;
+    newConnection->_setState( STATE_CONNECTED );
+
+    LBDEBUG << "Accepted " << description->toString() << std::endl;
+    return newConnection;
+}
+
+Connection::Notifier ShmConnection::getNotifier() const
+{
+    if( isListening( ))
+        return _impl->listenFD;
+    return _impl->epollFD;
+}
+
+//----------------------------------------------------------------------
+// read
+//----------------------------------------------------------------------
+int64_t ShmConnection::readSync( void* buffer, const uint64_t bytes,
+                                 const bool block )
+{
+    detail::Queue* in = _impl->in;
+    if( !in )
+        return -1;
+
+    const uint64_t tail = in->tail.load( std::memory_order_relaxed );
+    const uint64_t head = in->head.load( std::memory_order_acquire );
+    if( head - tail > _impl->ringSize )
+    {
+        LBWARN << "Corrupt shared memory ring, closing "
+               << getDescription()->toString() << std::endl;
+        close();
+        return -1;
+    }
+
+    const uint64_t nBytes = LB_MIN( head - tail, bytes );
+    if( nBytes > 0 )
+    {
+        const uint64_t offset = tail & ( _impl->ringSize - 1 );
+        const uint64_t first = LB_MIN( nBytes, _impl->ringSize - offset );
+        uint8_t* ptr = static_cast< uint8_t* >( buffer );
+        ::memcpy( ptr, _impl->inData + offset, first );
+        ::memcpy( ptr + first, _impl->inData, nBytes - first );
+
+        in->tail.store( tail + nBytes );
+        _impl->notifySpace();
+
+        if( tail + nBytes == head ) // drained, reset unless raced by producer
+        {
+            _impl->reset();
+            if( in->head.load() != head )
+                detail::ShmConnection::signal( _impl->inEvent );
+        }
+        return nBytes;
+    }
+
+    if( in->closed.load() || !_impl->isPeerAlive( ))
+    {
+        LBDEBUG << "Got EOF, closing " << getDescription()->toString()
+                << std::endl;
+        close();
+        return -1;
+    }
+
+    if( block && !_impl->wait( Global::getTimeout( )))
+        throw Exception( Exception::TIMEOUT_READ );
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// write
+//----------------------------------------------------------------------
+int64_t ShmConnection::write( const void* buffer, const uint64_t bytes )
+{
+    const Chunk chunk = { buffer, bytes };
+    return writev( &chunk, 1 );
+}
+
+int64_t ShmConnection::writev( const Chunk* chunks, const size_t nChunks )
+{
+    detail::Queue* out = _impl->out;
+    if( !isConnected() || !out || out->closed.load( ))
+        return -1;
+
+    const uint64_t head = out->head.load( std::memory_order_relaxed );
+    uint64_t used = head - out->tail.load();
+    if( used == _impl->ringSize )
+    {
+        if( !_impl->waitForSpace( head ))
+            return -1;
+        used = head - out->tail.load();
+    }
+    if( used > _impl->ringSize )
+    {
+        LBWARN << "Corrupt shared memory ring, closing "
+               << getDescription()->toString() << std::endl;
+        close();
+        return -1;
+    }
+
+    // copy as much as fits directly into the ring
+    const uint64_t mask = _impl->ringSize - 1;
+    uint64_t space = _impl->ringSize - used;
+    uint64_t written = 0;
+    for( size_t i = 0; i < nChunks && space > 0; ++i )
+    {
+        const uint64_t nBytes = LB_MIN( chunks[i].size, space );
+        const uint8_t* ptr = static_cast< const uint8_t* >( chunks[i].data );
+        const uint64_t offset = ( head + written ) & mask;
+        const uint64_t first = LB_MIN( nBytes, _impl->ringSize - offset );
+        ::memcpy( _impl->outData + offset, ptr, first );
+        ::memcpy( _impl->outData, ptr + first, nBytes - first );
+        written += nBytes;
+        space -= nBytes;
+    }
+
+    out->head.store( head + written );
+    if( out->tail.load() == head ) // was empty, consumer might have reset
+        detail::ShmConnection::signal( _impl->outEvent );
+    return written;
+}
+}
@@ -0,0 +1,74 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CO_SHMCONNECTION_H
+#define CO_SHMCONNECTION_H
+
+#include <co/connection.h> // base class
+
+namespace co
+{
+namespace detail { class ShmConnection; }
+
+class ShmConnection;
+typedef lunchbox::RefPtr< ShmConnection > ShmConnectionPtr;
+
+/**
+ * A bi-directional connection between processes on the same host.
+ *
+ * The data is exchanged through two byte rings in a shared memory segment
+ * created by the connecting side using memfd_create(). The listener accepts
+ * connections on an abstract unix socket named after the filename of the
+ * description, which hands over the segment and the eventfds signalling new
+ * data. The connected socket stays open to detect a peer dying without closing
+ * the segment. Producers blocked on a full ring wait on a futex in the
+ * segment.
+ */
+class ShmConnection : public Connection
+{
+public:
+    /** Construct a new shared memory connection. */
+    ShmConnection();
+
+    bool connect() override;
+    bool listen() override;
+    void close() override { _close(); }
+
+    void acceptNB() override { /* nop */ }
+    ConnectionPtr acceptSync() override;
+
+    Notifier getNotifier() const override;
+    void abortSends() override;
+
+protected:
+    virtual ~ShmConnection();
+
+    void readNB( void*, const uint64_t ) override { /* nop */ }
+    int64_t readSync( void* buffer, const uint64_t bytes,
+                      const bool block ) override;
+    int64_t write( const void* buffer, const uint64_t bytes ) override;
+    int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
+
+private:
+    detail::ShmConnection* const _impl;
+
+    void _close();
+};
+}
+
+#endif //CO_SHMCONNECTION_H
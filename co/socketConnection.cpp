@@ -20,6 +20,7 @@
 
 #include "socketConnection.h"
 
+#include "buffer.h"
 #include "connectionDescription.h"
 #include "exception.h"
 #include "global.h"
@@ -48,18 +49,49 @@
 #  include <netinet/tcp.h>
 #  include <sys/errno.h>
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  ifndef AF_INET_SDP
 #    define AF_INET_SDP 27
 #  endif
+#  ifdef __linux__
+#    include <linux/errqueue.h>
+#    ifndef MSG_ZEROCOPY
+#      define MSG_ZEROCOPY 0x4000000
+#    endif
+#    if defined SO_ZEROCOPY && defined SO_EE_ORIGIN_ZEROCOPY
+#      define CO_USE_ZEROCOPY
+#    endif
+#  endif
 #endif
 
 namespace co
 {
+namespace
+{
+void _copyOptions( const ConnectionDescription& from,
+                   ConnectionDescription& to )
+{
+    to.sendBufferSize = from.sendBufferSize;
+    to.receiveBufferSize = from.receiveBufferSize;
+    to.noDelay = from.noDelay;
+    to.cork = from.cork;
+    to.busyPoll = from.busyPoll;
+    to.quickAck = from.quickAck;
+    to.tos = from.tos;
+}
+}
+
 SocketConnection::SocketConnection( const ConnectionType type )
 #ifdef _WIN32
         : _overlappedAcceptData( 0 )
         , _overlappedSocket( INVALID_SOCKET )
         , _overlappedDone( 0 )
+#else
+        : _zeroCopy( false )
+        , _zeroCopySent( 0 )
+        , _zeroCopyDone( 0 )
+        , _cork( false )
+        , _quickAck( false )
 #endif
 {
 #ifdef _WIN32
@@ -202,6 +234,11 @@ bool SocketConnection::connect()
         return false;
     }
 
+#ifndef _WIN32
+    _initZeroCopy();
+    _cork = description->cork;
+    _quickAck = description->quickAck;
+#endif
     _initAIORead();
     _setState( STATE_CONNECTED );
     LBDEBUG << "Connected " << description->toString() << std::endl;
@@ -218,6 +255,7 @@ void SocketConnection::_close()
     else if( isConnected( ))
         _exitAIORead();
 
+    _setState( STATE_CLOSING ); // stops the send queue using the socket
     LBASSERT( _readFD > 0 );
 
 #ifdef _WIN32
@@ -232,6 +270,10 @@ void SocketConnection::_close()
 
     _readFD  = INVALID_SOCKET;
     _writeFD = INVALID_SOCKET;
+#ifndef _WIN32
+    _zeroCopy = false;
+    _releaseZeroCopy( true );
+#endif
     _setState( STATE_CLOSED );
 }
 
@@ -284,8 +326,8 @@ void SocketConnection::_exitAIORead()
 #else
 void SocketConnection::_initAIOAccept(){ /* NOP */ }
 void SocketConnection::_exitAIOAccept(){ /* NOP */ }
-void SocketConnection::_initAIORead(){ /* NOP */ }
-void SocketConnection::_exitAIORead(){ /* NOP */ }
+void SocketConnection::_initAIORead() { _initUring(); }
+void SocketConnection::_exitAIORead() { _exitUring(); }
 #endif
 
 //----------------------------------------------------------------------
@@ -368,6 +410,7 @@ ConnectionPtr SocketConnection::acceptSync()
     ConstConnectionDescriptionPtr description = getDescription();
     SocketConnection* newConnection = new SocketConnection( description->type );
     ConnectionPtr connection( newConnection ); // to keep ref-counting correct
+    _copyOptions( *description, *newConnection->_getDescription( ));
 
     newConnection->_readFD  = _overlappedSocket;
     newConnection->_writeFD = _overlappedSocket;
@@ -421,6 +464,11 @@ ConnectionPtr SocketConnection::acceptSync()
 
     newConnection->_readFD      = fd;
     newConnection->_writeFD     = fd;
+    newConnection->_cork        = description->cork;
+    newConnection->_quickAck    = description->quickAck;
+    _copyOptions( *description, *newConnection->_getDescription( ));
+    newConnection->_initZeroCopy();
+    newConnection->_initAIORead();
     newConnection->_setState( STATE_CONNECTED );
     ConnectionDescriptionPtr newDescription = newConnection->_getDescription();
     newDescription->bandwidth = description->bandwidth;
@@ -431,6 +479,185 @@ ConnectionPtr SocketConnection::acceptSync()
     return newConnection;
 }
 
+//----------------------------------------------------------------------
+// zero-copy write
+//----------------------------------------------------------------------
+void SocketConnection::_initZeroCopy()
+{
+    _zeroCopy = false;
+    _zeroCopySent = 0;
+    _zeroCopyDone = 0;
+#ifdef CO_USE_ZEROCOPY
+    if( Global::getIAttribute( Global::IATTR_TCP_ZEROCOPY_SIZE ) <= 0 ||
+        getDescription()->type != CONNECTIONTYPE_TCPIP )
+    {
+        return;
+    }
+
+    const int on = 1;
+    if( ::setsockopt( _writeFD, SOL_SOCKET, SO_ZEROCOPY, &on,
+                      sizeof( on )) == 0 )
+    {
+        _zeroCopy = true;
+    }
+    else
+        LBINFO << "MSG_ZEROCOPY not supported: " << lunchbox::sysError
+               << std::endl;
+#endif
+}
+
+bool SocketConnection::handleError()
+{
+    // completions of zero-copy sends are signalled as errors on the socket
+    if( !_zeroCopy || !_reapZeroCopy( ))
+        return false;
+
+    int error = 0;
+    socklen_t length = sizeof( error );
+    return ::getsockopt( _readFD, SOL_SOCKET, SO_ERROR, &error,
+                         &length ) == 0 && error == 0;
+}
+
+bool SocketConnection::_reapZeroCopy()
+{
+#ifdef CO_USE_ZEROCOPY
+    while( true )
+    {
+        char control[ 128 ];
+        msghdr message;
+        ::memset( &message, 0, sizeof( message ));
+        message.msg_control = control;
+        message.msg_controllen = sizeof( control );
+
+        if( ::recvmsg( _writeFD, &message, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        for( cmsghdr* cmsg = CMSG_FIRSTHDR( &message ); cmsg;
+             cmsg = CMSG_NXTHDR( &message, cmsg ))
+        {
+            if( cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR )
+                continue;
+
+            const sock_extended_err* error =
+                reinterpret_cast< const sock_extended_err* >(CMSG_DATA( cmsg ));
+            if( error->ee_errno != 0 ||
+                error->ee_origin != SO_EE_ORIGIN_ZEROCOPY )
+            {
+                LBWARN << "Unexpected socket error: "
+                       << strerror( error->ee_errno ) << std::endl;
+                return false;
+            }
+            // each notification covers the inclusive range [ee_info, ee_data]
+            _zeroCopyDone += error->ee_data - error->ee_info + 1;
+        }
+        _releaseZeroCopy( false );
+    }
+#else
+    return false;
+#endif
+}
+
+void SocketConnection::_releaseZeroCopy( const bool all )
+{
+    const uint32_t done = _zeroCopyDone;
+    lunchbox::ScopedFastWrite mutex( _zeroCopyLock );
+    while( !_zeroCopyOwners.empty() &&
+           ( all || int32_t( _zeroCopyOwners.front().first - done ) < 0 ))
+    {
+        _zeroCopyOwners.pop_front();
+    }
+}
+
+int64_t SocketConnection::readSync( void* buffer, const uint64_t bytes,
+                                    const bool block )
+{
+    const int64_t read = FDConnection::readSync( buffer, bytes, block );
+#ifdef __linux__
+    // the kernel leaves quick ack mode on its own, re-enable it
+    if( _quickAck && read > 0 )
+        _setOption( _readFD, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK" );
+#endif
+    return read;
+}
+
+void SocketConnection::finish()
+{
+#ifdef __linux__
+    // uncorking pushes out the last partial frame, the socket stays corked
+    if( _cork && isConnected( ))
+    {
+        _setOption( _writeFD, IPPROTO_TCP, TCP_CORK, 0, "TCP_CORK" );
+        _setOption( _writeFD, IPPROTO_TCP, TCP_CORK, 1, "TCP_CORK" );
+    }
+#endif
+}
+
+int64_t SocketConnection::writev( const Chunk* chunks, const size_t nChunks )
+{
+    ConstBufferPtr owner = _zeroCopy ? getSendOwner() : ConstBufferPtr();
+    if( !owner )
+        return FDConnection::writev( chunks, nChunks );
+
+    // The owner keeps the big chunks valid while the kernel reads them after
+    // the write returned. The other chunks may be reused, copy them.
+    const uint64_t minSize =
+        Global::getIAttribute( Global::IATTR_TCP_ZEROCOPY_SIZE );
+    size_t nCopied = 0;
+    while( nCopied < nChunks && chunks[ nCopied ].size < minSize )
+        ++nCopied;
+
+    if( nCopied > 0 )
+        return FDConnection::writev( chunks, nCopied );
+    return _writeZeroCopy( chunks[0], owner );
+}
+
+int64_t SocketConnection::_writeZeroCopy( const Chunk& chunk,
+                                          ConstBufferPtr owner LB_UNUSED )
+{
+#ifdef CO_USE_ZEROCOPY
+    if( !isConnected() || _writeFD < 1 )
+        return -1;
+
+    struct iovec vector;
+    vector.iov_base = const_cast< void* >( chunk.data );
+    vector.iov_len = chunk.size;
+
+    msghdr message;
+    ::memset( &message, 0, sizeof( message ));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+
+    const ssize_t bytesWritten = ::sendmsg( _writeFD, &message, MSG_ZEROCOPY );
+    if( bytesWritten < 0 )
+    {
+        // page pinning limit reached or socket buffer full, copy instead
+        if( errno == ENOBUFS || errno == EAGAIN || errno == EWOULDBLOCK )
+            return FDConnection::writev( &chunk, 1 );
+        if( errno == EINTR )
+            return 0;
+
+        LBWARN << "Error during write: " << lunchbox::sysError << std::endl;
+        return -1;
+    }
+    // The kernel references the sent pages until the peer acknowledged the
+    // data. Keep the owner until the completion has been reaped, here or by
+    // the receiver thread in handleError().
+    {
+        lunchbox::ScopedFastWrite mutex( _zeroCopyLock );
+        _zeroCopyOwners.push_back( std::make_pair( _zeroCopySent++, owner ));
+    }
+    if( !_reapZeroCopy( ))
+        return -1;
+    return bytesWritten;
+#else
+    return FDConnection::writev( &chunk, 1 );
+#endif
+}
+
 #endif // !_WIN32
 
 
@@ -533,19 +760,33 @@ int64_t SocketConnection::readSync( void* buffer, const uint64_t bytes,
 }
 
 int64_t SocketConnection::write( const void* buffer, const uint64_t bytes )
+{
+    const Chunk chunk = { buffer, bytes };
+    return writev( &chunk, 1 );
+}
+
+int64_t SocketConnection::writev( const Chunk* chunks, const size_t nChunks )
 {
     if( !isConnected() || _writeFD == INVALID_SOCKET )
         return -1;
 
     DWORD  wrote;
-    WSABUF wsaBuffer =
-        {
-            LB_MIN( bytes, 65535 ),
-            const_cast<char*>( static_cast< const char* >( buffer ))
-        };
+    WSABUF wsaBuffers[ 64 ];
+    DWORD nBuffers = 0;
+    while( nBuffers < nChunks && nBuffers < 64 )
+    {
+        const Chunk& chunk = chunks[ nBuffers ];
+        WSABUF& wsaBuffer = wsaBuffers[ nBuffers++ ];
+        wsaBuffer.len = ULONG( LB_MIN( chunk.size, 65535 ));
+        wsaBuffer.buf = const_cast< char* >(
+                            static_cast< const char* >( chunk.data ));
+        if( chunk.size > 65535 ) // later chunks have to follow the remainder
+            break;
+    }
 
     ResetEvent( _overlappedWrite.hEvent );
-    if( WSASend(_writeFD, &wsaBuffer, 1, &wrote, 0, &_overlappedWrite, 0 ) == 0 )
+    if( WSASend( _writeFD, wsaBuffers, nBuffers, &wrote, 0, &_overlappedWrite,
+                 0 ) == 0 )
         // ok
         return wrote;
 
@@ -630,20 +871,55 @@ bool SocketConnection::_createSocket()
     return true;
 }
 
+void SocketConnection::_setOption( const Socket fd, const int level,
+                                   const int name, const int value,
+                                   const char* label )
+{
+    if( ::setsockopt( fd, level, name, reinterpret_cast< const char* >( &value ),
+                      sizeof( value )) != 0 )
+    {
+        LBWARN << "Could not set " << label << " to " << value << ": "
+               << lunchbox::sysError << std::endl;
+    }
+}
+
 void SocketConnection::_tuneSocket( const Socket fd )
 {
+    ConstConnectionDescriptionPtr description = getDescription();
     const int on         = 1;
-    setsockopt( fd, IPPROTO_TCP, TCP_NODELAY,
-                reinterpret_cast<const char*>( &on ), sizeof( on ));
+    if( description->noDelay )
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY,
+                    reinterpret_cast<const char*>( &on ), sizeof( on ));
     setsockopt( fd, SOL_SOCKET, SO_REUSEADDR,
                 reinterpret_cast<const char*>( &on ), sizeof( on ));
 
 #ifdef _WIN32
     const int size = 128768;
-    setsockopt( fd, SOL_SOCKET, SO_RCVBUF,
-                reinterpret_cast<const char*>( &size ), sizeof( size ));
-    setsockopt( fd, SOL_SOCKET, SO_SNDBUF,
-                reinterpret_cast<const char*>( &size ), sizeof( size ));
+    const int receiveSize = description->receiveBufferSize > 0 ?
+                                description->receiveBufferSize : size;
+    const int sendSize = description->sendBufferSize > 0 ?
+                             description->sendBufferSize : size;
+    _setOption( fd, SOL_SOCKET, SO_RCVBUF, receiveSize, "SO_RCVBUF" );
+    _setOption( fd, SOL_SOCKET, SO_SNDBUF, sendSize, "SO_SNDBUF" );
+#else
+    // set before listen() and connect() to size the TCP window scaling
+    if( description->receiveBufferSize > 0 )
+        _setOption( fd, SOL_SOCKET, SO_RCVBUF, description->receiveBufferSize,
+                    "SO_RCVBUF" );
+    if( description->sendBufferSize > 0 )
+        _setOption( fd, SOL_SOCKET, SO_SNDBUF, description->sendBufferSize,
+                    "SO_SNDBUF" );
+    if( description->tos >= 0 )
+        _setOption( fd, IPPROTO_IP, IP_TOS, description->tos, "IP_TOS" );
+#endif
+#ifdef __linux__
+    if( description->busyPoll > 0 )
+        _setOption( fd, SOL_SOCKET, SO_BUSY_POLL, description->busyPoll,
+                    "SO_BUSY_POLL" );
+    if( description->quickAck )
+        _setOption( fd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK" );
+    if( description->cork )
+        _setOption( fd, IPPROTO_TCP, TCP_CORK, 1, "TCP_CORK" );
 #endif
 }
 
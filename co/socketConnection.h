@@ -22,10 +22,14 @@
 
 #include <co/connectionType.h> // enum
 #include <lunchbox/api.h>
+#include <lunchbox/atomic.h> // member
 #include <lunchbox/buffer.h> // member
 #include <lunchbox/os.h>
+#include <lunchbox/spinLock.h> // member
 #include <lunchbox/thread.h> // for LB_TS_VAR
 
+#include <deque>
+
 
 #ifdef WIN32
 #  include <co/connection.h>
@@ -59,6 +63,10 @@ namespace co
         void acceptNB() override;
         ConnectionPtr acceptSync() override;
         void close() override { _close(); }
+#ifndef WIN32
+        bool handleError() override;
+        void finish() override;
+#endif
 
 
 #ifdef WIN32
@@ -76,9 +84,14 @@ namespace co
                                   const bool block ) override;
         int64_t write( const void* buffer,
                                const uint64_t bytes ) override;
+        int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
 
         typedef UINT_PTR Socket;
 #else
+        int64_t readSync( void* buffer, const uint64_t bytes,
+                          const bool block ) override;
+        int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
+
         //! @cond IGNORE
         typedef int    Socket;
         enum
@@ -96,6 +109,9 @@ namespace co
 
         bool _createSocket();
         void _tuneSocket( const Socket fd );
+        static void _setOption( const Socket fd, const int level,
+                                const int name, const int value,
+                                const char* label );
         uint16_t _getPort() const;
 
 #ifdef WIN32
@@ -113,6 +129,21 @@ namespace co
         DWORD      _overlappedDone;
 
         LB_TS_VAR( _recvThread );
+#else
+        bool _zeroCopy; //!< MSG_ZEROCOPY enabled on the socket
+        uint32_t _zeroCopySent; //!< MSG_ZEROCOPY sends, sender only
+        lunchbox::Atomic< uint32_t > _zeroCopyDone; //!< completed sends
+
+        /** Owners of the data of MSG_ZEROCOPY sends by send id */
+        std::deque< std::pair< uint32_t, ConstBufferPtr > > _zeroCopyOwners;
+        lunchbox::SpinLock _zeroCopyLock; //!< protects _zeroCopyOwners
+        bool _cork; //!< TCP_CORK set, partial frames pushed on finish()
+        bool _quickAck; //!< re-enable TCP_QUICKACK after reads
+
+        void _initZeroCopy();
+        bool _reapZeroCopy();
+        void _releaseZeroCopy( const bool all );
+        int64_t _writeZeroCopy( const Chunk& chunk, ConstBufferPtr owner );
 #endif
 
         void _close();
@@ -0,0 +1,602 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stripedConnection.h"
+
+#include "connectionDescription.h"
+#include "exception.h"
+#include "global.h"
+#include "socketConnection.h"
+
+#include <lunchbox/clock.h>
+#include <lunchbox/log.h>
+#include <lunchbox/os.h>
+#include <lunchbox/rng.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace co
+{
+namespace
+{
+static const uint32_t STRIPE_MAGIC = 0xC057121Eu;
+static const int32_t MAX_STREAMS = 64;
+static const int HELLO_TIMEOUT = 1000; // ms, sent right after connecting
+
+/** Sent on each stream after connecting. */
+struct Hello
+{
+    uint32_t magic;
+    uint32_t index; //!< of the stream
+    uint32_t count; //!< number of streams
+    uint32_t padding;
+    uint64_t id; //!< identifies the streams of one connection
+};
+
+/** Precedes the first piece of each send, on the first stream. */
+struct FrameHeader
+{
+    uint64_t size;
+    uint32_t sequence;
+    uint32_t pieceSize;
+};
+
+/** Precedes all further pieces of a send. */
+struct PieceTag
+{
+    uint32_t sequence;
+    uint32_t index;
+};
+
+/** The streams of a connection accepted so far. */
+struct PendingStreams
+{
+    Connections streams; //!< by index, 0 if not yet accepted
+    int64_t time; //!< when the first stream was accepted
+};
+
+typedef std::map< uint64_t, PendingStreams > PendingMap;
+typedef PendingMap::iterator PendingMapIter;
+
+void _closeStreams( Connections& streams )
+{
+    for( ConnectionsCIter i = streams.begin(); i != streams.end(); ++i )
+        if( *i )
+            (*i)->close();
+    streams.clear();
+}
+}
+
+namespace detail
+{
+class StripedConnection
+{
+public:
+    StripedConnection()
+        : writeSequence( 0 )
+        , readSequence( 0 )
+        , frameSequence( 0 )
+        , frameLeft( 0 )
+        , pieceLeft( 0 )
+        , pieceSize( 0 )
+        , piece( 0 )
+        , epollFD( ::epoll_create1( EPOLL_CLOEXEC ))
+    {
+        if( epollFD < 0 )
+            LBERROR << "Can't create notifier: " << lunchbox::sysError
+                    << std::endl;
+    }
+
+    ~StripedConnection()
+    {
+        if( epollFD >= 0 )
+            ::close( epollFD );
+    }
+
+    void setStreams( Connections& newStreams )
+    {
+        streams.swap( newStreams );
+        for( ConnectionsCIter i = streams.begin(); i != streams.end(); ++i )
+        {
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = (*i)->getNotifier();
+            if( ::epoll_ctl( epollFD, EPOLL_CTL_ADD, event.data.fd,
+                             &event ) != 0 )
+            {
+                LBWARN << "Can't add stream notifier: " << lunchbox::sysError
+                       << std::endl;
+            }
+        }
+    }
+
+    void closeStreams()
+    {
+        for( ConnectionsCIter i = streams.begin(); i != streams.end(); ++i )
+        {
+            struct epoll_event event; // non-null for kernels before 2.6.9
+            ::epoll_ctl( epollFD, EPOLL_CTL_DEL, (*i)->getNotifier(), &event );
+        }
+        _closeStreams( streams );
+    }
+
+    /** Drop the streams of connections not completed within the timeout. */
+    void expirePending()
+    {
+        const uint32_t timeout = Global::getTimeout();
+        if( timeout == LB_TIMEOUT_INDEFINITE )
+            return;
+
+        const int64_t now = clock.getTime64();
+        for( PendingMapIter i = pending.begin(); i != pending.end(); )
+        {
+            if( now - i->second.time <= int64_t( timeout ))
+            {
+                ++i;
+                continue;
+            }
+            LBWARN << "Timeout waiting for the streams of striped connection "
+                   << std::hex << i->first << std::dec << std::endl;
+            _closeStreams( i->second.streams );
+            pending.erase( i++ );
+        }
+    }
+
+    void resetRead()
+    {
+        readSequence = 0;
+        frameLeft = 0;
+        pieceLeft = 0;
+        piece = 0;
+    }
+
+    Connections streams; //!< the sockets, the first one carries the headers
+    ConnectionPtr listener;
+    PendingMap pending; //!< incompletely accepted connections, by id
+    lunchbox::Clock clock; //!< for the age of pending connections
+
+    uint32_t writeSequence; //!< of the next send
+    uint32_t readSequence; //!< of the next frame received
+    uint32_t frameSequence; //!< of the frame currently received
+    uint64_t frameLeft; //!< unread bytes of the current frame
+    uint64_t pieceLeft; //!< unread bytes of the current piece
+    uint32_t pieceSize; //!< of the current frame
+    uint32_t piece; //!< index of the current piece
+
+    /** The notifier for all streams, as a send may continue on any stream */
+    int epollFD;
+};
+}
+
+StripedConnection::StripedConnection()
+    : _impl( new detail::StripedConnection )
+{
+    ConnectionDescriptionPtr description = _getDescription();
+    description->type = CONNECTIONTYPE_TCPIP;
+    description->bandwidth = 102400;
+}
+
+StripedConnection::~StripedConnection()
+{
+    _close();
+    delete _impl;
+}
+
+ConnectionPtr StripedConnection::_createStream() const
+{
+    std::string data = getDescription()->toString();
+    ConnectionDescriptionPtr description = new ConnectionDescription( data );
+    description->streams = 1;
+
+    ConnectionPtr stream = new SocketConnection( CONNECTIONTYPE_TCPIP );
+    stream->_setDescription( description );
+    return stream;
+}
+
+bool StripedConnection::connect()
+{
+    LBASSERT( getDescription()->type == CONNECTIONTYPE_TCPIP );
+    if( !isClosed( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    const int32_t nStreams = getDescription()->streams;
+    const uint32_t count = LB_MIN( LB_MAX( nStreams, 1 ), MAX_STREAMS );
+    lunchbox::RNG rng;
+    const uint64_t id = rng.get< uint64_t >();
+
+    Connections streams;
+    for( uint32_t i = 0; i < count; ++i )
+    {
+        ConnectionPtr stream = _createStream();
+        const Hello hello = { STRIPE_MAGIC, i, count, 0, id };
+        if( !stream->connect() || !stream->send( &hello, sizeof( hello )))
+        {
+            LBDEBUG << "Could not connect stream " << i << " of "
+                    << getDescription()->toString() << std::endl;
+            _closeStreams( streams );
+            _setState( STATE_CLOSED );
+            return false;
+        }
+        streams.push_back( stream );
+    }
+
+    _impl->setStreams( streams );
+    _impl->writeSequence = 0;
+    _impl->resetRead();
+    _setState( STATE_CONNECTED );
+    return true;
+}
+
+bool StripedConnection::listen()
+{
+    LBASSERT( getDescription()->type == CONNECTIONTYPE_TCPIP );
+    if( !isClosed( ))
+        return false;
+
+    _setState( STATE_CONNECTING );
+
+    ConnectionPtr listener = _createStream();
+    if( !listener->listen( ))
+    {
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    _getDescription()->port = listener->getDescription()->port;
+    _impl->listener = listener;
+    _setState( STATE_LISTENING );
+    return true;
+}
+
+void StripedConnection::_close()
+{
+    if( isClosed( ))
+        return;
+
+    _setState( STATE_CLOSING );
+    if( _impl->listener )
+    {
+        _impl->listener->close();
+        _impl->listener = 0;
+    }
+    _impl->closeStreams();
+
+    for( PendingMapIter i = _impl->pending.begin();
+         i != _impl->pending.end(); ++i )
+    {
+        _closeStreams( i->second.streams );
+    }
+    _impl->pending.clear();
+    _impl->resetRead();
+    _setState( STATE_CLOSED );
+}
+
+void StripedConnection::acceptNB()
+{
+    if( _impl->listener )
+        _impl->listener->acceptNB();
+}
+
+ConnectionPtr StripedConnection::acceptSync()
+{
+    if( !isListening( ))
+        return 0;
+
+    _impl->expirePending();
+    ConnectionPtr stream = _impl->listener->acceptSync();
+    if( !stream )
+        return 0;
+
+    Hello hello;
+    if( !_readHandshake( stream, &hello, sizeof( hello )) || hello.magic != STRIPE_MAGIC ||
+        hello.count == 0 || hello.count > uint32_t( MAX_STREAMS ) ||
+        hello.index >= hello.count )
+    {
+        LBWARN << "Invalid handshake on striped connection from "
+               << stream->getDescription()->toString() << std::endl;
+        stream->close();
+        return 0;
+    }
+
+    PendingStreams& pending = _impl->pending[ hello.id ];
+    Connections& streams = pending.streams;
+    if( streams.empty( ))
+    {
+        streams.resize( hello.count );
+        pending.time = _impl->clock.getTime64();
+    }
+    if( streams.size() != hello.count || streams[ hello.index ] )
+    {
+        LBWARN << "Inconsistent stream " << hello.index << " of "
+               << hello.count << " for striped connection " << std::hex
+               << hello.id << std::dec << std::endl;
+        stream->close();
+        return 0;
+    }
+    streams[ hello.index ] = stream;
+
+    // the remaining streams are accepted on their own connect events
+    if( std::find( streams.begin(), streams.end(), ConnectionPtr( )) !=
+        streams.end( ))
+    {
+        return 0;
+    }
+
+    std::string data = getDescription()->toString();
+    ConnectionDescriptionPtr description = new ConnectionDescription( data );
+    ConstConnectionDescriptionPtr first = streams[0]->getDescription();
+    description->streams = hello.count;
+    description->port = first->port;
+    description->setHostname( first->getHostname( ));
+
+    StripedConnection* connection = new StripedConnection;
+    ConnectionPtr result( connection ); // to keep ref-counting correct
+    connection->_setDescription( description );
+    connection->_impl->setStreams( streams );
+    connection->_setState( STATE_CONNECTED );
+    _impl->pending.erase( hello.id );
+
+    LBDEBUG << "Accepted " << description->toString() << std::endl;
+    return result;
+}
+
+Connection::Notifier StripedConnection::getNotifier() const
+{
+    if( _impl->listener )
+        return _impl->listener->getNotifier();
+    if( _impl->streams.empty( ))
+        return Notifier( -1 );
+    return _impl->epollFD;
+}
+
+bool StripedConnection::handleError()
+{
+    return !_impl->streams.empty() && _impl->streams.front()->handleError();
+}
+
+void StripedConnection::abortSends()
+{
+    for( ConnectionsCIter i = _impl->streams.begin();
+         i != _impl->streams.end(); ++i )
+    {
+        (*i)->abortSends();
+    }
+}
+
+//----------------------------------------------------------------------
+// read
+//----------------------------------------------------------------------
+bool StripedConnection::_readAll( ConnectionPtr stream, void* data,
+                                  const uint64_t bytes )
+{
+    uint8_t* ptr = static_cast< uint8_t* >( data );
+    uint64_t left = bytes;
+    try
+    {
+        while( left > 0 )
+        {
+            const int64_t read = stream->readSync( ptr, left, true );
+            if( read < 0 )
+                return false;
+            ptr += read;
+            left -= read;
+        }
+    }
+    catch( const co::Exception& e )
+    {
+        LBWARN << e.what() << " reading " << bytes << " bytes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool StripedConnection::_readHandshake( ConnectionPtr stream, void* data,
+                                        const uint64_t bytes )
+{
+    // bounded, since acceptSync runs on the receiver thread
+    uint8_t* ptr = static_cast< uint8_t* >( data );
+    uint64_t left = bytes;
+    lunchbox::Clock clock;
+    try
+    {
+        while( left > 0 )
+        {
+            const int64_t wait = HELLO_TIMEOUT - clock.getTime64();
+            struct pollfd fds[1];
+            fds[0].fd = stream->getNotifier();
+            fds[0].events = POLLIN;
+            if( wait <= 0 || ::poll( fds, 1, int( wait )) <= 0 )
+                return false;
+
+            const int64_t read = stream->readSync( ptr, left, false );
+            if( read < 0 )
+                return false;
+            ptr += read;
+            left -= read;
+        }
+    }
+    catch( const co::Exception& e )
+    {
+        LBWARN << e.what() << " reading the stream handshake" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool StripedConnection::_nextPiece()
+{
+    detail::StripedConnection& impl = *_impl;
+    if( impl.frameLeft == 0 )
+    {
+        FrameHeader header;
+        if( !_readAll( impl.streams.front(), &header, sizeof( header )))
+            return false;
+
+        if( header.sequence != impl.readSequence || header.size == 0 ||
+            header.pieceSize == 0 )
+        {
+            LBERROR << "Got frame " << header.sequence << " of "
+                    << header.size << " bytes, expected frame "
+                    << impl.readSequence << std::endl;
+            return false;
+        }
+
+        ++impl.readSequence;
+        impl.frameSequence = header.sequence;
+        impl.frameLeft = header.size;
+        impl.pieceSize = header.pieceSize;
+        impl.piece = 0;
+    }
+    else
+    {
+        ++impl.piece;
+        PieceTag tag;
+        ConnectionPtr stream =
+            impl.streams[ impl.piece % impl.streams.size( )];
+        if( !_readAll( stream, &tag, sizeof( tag )))
+            return false;
+
+        if( tag.sequence != impl.frameSequence || tag.index != impl.piece )
+        {
+            LBERROR << "Got piece " << tag.index << " of frame "
+                    << tag.sequence << ", expected piece " << impl.piece
+                    << " of frame " << impl.frameSequence << std::endl;
+            return false;
+        }
+    }
+
+    impl.pieceLeft = LB_MIN( impl.frameLeft, uint64_t( impl.pieceSize ));
+    return true;
+}
+
+int64_t StripedConnection::readSync( void* buffer, const uint64_t bytes,
+                                     const bool block )
+{
+    detail::StripedConnection& impl = *_impl;
+    if( impl.streams.empty( ))
+        return -1;
+
+    if( impl.pieceLeft == 0 && !_nextPiece( ))
+    {
+        close();
+        return -1;
+    }
+
+    ConnectionPtr stream = impl.streams[ impl.piece % impl.streams.size( )];
+    const int64_t read = stream->readSync( buffer,
+                                           LB_MIN( bytes, impl.pieceLeft ),
+                                           block );
+    if( read < 0 )
+    {
+        close();
+        return -1;
+    }
+
+    impl.pieceLeft -= read;
+    impl.frameLeft -= read;
+    return read;
+}
+
+//----------------------------------------------------------------------
+// write
+//----------------------------------------------------------------------
+int64_t StripedConnection::write( const void* buffer, const uint64_t bytes )
+{
+    const Chunk chunk = { buffer, bytes };
+    return writev( &chunk, 1 );
+}
+
+int64_t StripedConnection::writev( const Chunk* chunks, const size_t nChunks )
+{
+    detail::StripedConnection& impl = *_impl;
+    const size_t nStreams = impl.streams.size();
+    if( !isConnected() || nStreams == 0 )
+        return -1;
+
+    uint64_t bytes = 0;
+    for( size_t i = 0; i < nChunks; ++i )
+        bytes += chunks[i].size;
+    if( bytes == 0 )
+        return 0;
+
+    const int32_t stripeSize =
+        Global::getIAttribute( Global::IATTR_TCP_STRIPE_SIZE );
+    const uint32_t pieceSize = stripeSize > 0 ?
+        uint32_t( stripeSize ) : std::numeric_limits< uint32_t >::max();
+    const uint32_t sequence = impl.writeSequence++;
+    const FrameHeader header = { bytes, sequence, pieceSize };
+
+    Chunk* piece = static_cast< Chunk* >(
+        alloca(( nChunks + 1 ) * sizeof( Chunk )));
+    size_t current = 0; // first chunk with unsent data
+    uint64_t offset = 0; // sent bytes of the current chunk
+    uint64_t left = bytes;
+
+    // Blocking sends in the order of the receiver, which reads each piece
+    // from its stream while the kernel transmits the previous ones.
+    for( uint32_t index = 0; left > 0; ++index )
+    {
+        const PieceTag tag = { sequence, index };
+        size_t n = 1;
+        if( index == 0 )
+        {
+            piece[0].data = &header;
+            piece[0].size = sizeof( header );
+        }
+        else
+        {
+            piece[0].data = &tag;
+            piece[0].size = sizeof( tag );
+        }
+
+        uint64_t size = LB_MIN( left, uint64_t( pieceSize ));
+        left -= size;
+        while( size > 0 )
+        {
+            const Chunk& chunk = chunks[ current ];
+            const uint64_t nBytes = LB_MIN( size, chunk.size - offset );
+            if( nBytes > 0 )
+            {
+                piece[n].data = static_cast< const uint8_t* >( chunk.data ) +
+                                offset;
+                piece[n++].size = nBytes;
+            }
+            offset += nBytes;
+            size -= nBytes;
+            if( offset == chunk.size )
+            {
+                ++current;
+                offset = 0;
+            }
+        }
+
+        // streams are only written under our send lock
+        if( !impl.streams[ index % nStreams ]->send( piece, n, true ))
+            return -1;
+    }
+    return bytes;
+}
+
+}
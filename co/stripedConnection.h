@@ -0,0 +1,84 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CO_STRIPEDCONNECTION_H
+#define CO_STRIPEDCONNECTION_H
+
+#include <co/connection.h> // base class
+
+namespace co
+{
+namespace detail { class StripedConnection; }
+
+/**
+ * A TCPIP connection striping its data over multiple sockets.
+ *
+ * Created for TCPIP descriptions with more than one stream. Each send is
+ * split into pieces of IATTR_TCP_STRIPE_SIZE, which are written round-robin
+ * to the streams, starting with the first. Every send is preceded by a header
+ * carrying its size and sequence number on the first stream, and every
+ * further piece by a tag with the sequence and piece number. The receiver
+ * reads the pieces in the same order, which reassembles the byte stream and
+ * keeps all streams flowing without unbounded buffering.
+ *
+ * The notifier signals data on any stream, since a partially read send
+ * continues on the stream of its next piece, which needs epoll and restricts
+ * striping to Linux. The listener groups accepted sockets using the identifier
+ * the connecting side sends on each stream. acceptSync() returns a connection
+ * once all its streams have been accepted, and 0 for the ones before.
+ */
+class StripedConnection : public Connection
+{
+public:
+    /** Construct a new striped connection. */
+    StripedConnection();
+
+    bool connect() override;
+    bool listen() override;
+    void close() override { _close(); }
+
+    void acceptNB() override;
+    ConnectionPtr acceptSync() override;
+
+    Notifier getNotifier() const override;
+    bool handleError() override;
+    void abortSends() override;
+
+protected:
+    virtual ~StripedConnection();
+
+    void readNB( void*, const uint64_t ) override { /* nop */ }
+    int64_t readSync( void* buffer, const uint64_t bytes,
+                      const bool block ) override;
+    int64_t write( const void* buffer, const uint64_t bytes ) override;
+    int64_t writev( const Chunk* chunks, const size_t nChunks ) override;
+
+private:
+    detail::StripedConnection* const _impl;
+
+    void _close();
+    ConnectionPtr _createStream() const;
+    bool _nextPiece();
+    static bool _readAll( ConnectionPtr stream, void* data,
+                          const uint64_t bytes );
+    static bool _readHandshake( ConnectionPtr stream, void* data,
+                                const uint64_t bytes );
+};
+}
+
+#endif //CO_STRIPEDCONNECTION_H
@@ -0,0 +1,236 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "unixConnection.h"
+
+#include "connectionDescription.h"
+
+#include <lunchbox/log.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace co
+{
+namespace
+{
+/** @return the address length, or 0 if the filename is not a valid path. */
+socklen_t _getAddress( const std::string& filename, sockaddr_un& address )
+{
+    ::memset( &address, 0, sizeof( address ));
+    address.sun_family = AF_UNIX;
+    if( filename.empty() || filename.length() >= sizeof( address.sun_path ))
+        return 0;
+
+    ::memcpy( address.sun_path, filename.c_str(), filename.length( ));
+#ifdef __linux__
+    if( filename[0] == '@' ) // abstract namespace, not null-terminated
+    {
+        address.sun_path[0] = '\0';
+        return socklen_t( offsetof( sockaddr_un, sun_path ) +
+                          filename.length( ));
+    }
+#endif
+    return socklen_t( sizeof( address ));
+}
+
+bool _isAbstract( const std::string& filename )
+{
+#ifdef __linux__
+    return !filename.empty() && filename[0] == '@';
+#else
+    return false;
+#endif
+}
+}
+
+UnixConnection::UnixConnection()
+{
+    ConnectionDescriptionPtr description = _getDescription();
+    description->type = CONNECTIONTYPE_UNIX;
+    description->bandwidth = 1024000;
+}
+
+UnixConnection::~UnixConnection()
+{
+    _close();
+}
+
+//----------------------------------------------------------------------
+// connect
+//----------------------------------------------------------------------
+bool UnixConnection::connect()
+{
+    ConstConnectionDescriptionPtr description = getDescription();
+    LBASSERT( description->type == CONNECTIONTYPE_UNIX );
+    if( !isClosed( ))
+        return false;
+
+    sockaddr_un address;
+    const socklen_t length = _getAddress( description->getFilename(),
+                                          address );
+    if( length == 0 )
+    {
+        LBWARN << "Invalid unix socket path '" << description->getFilename()
+               << "'" << std::endl;
+        return false;
+    }
+
+    _setState( STATE_CONNECTING );
+
+    const int fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+    {
+        LBERROR << "Could not create socket: " << lunchbox::sysError
+                << std::endl;
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    int result;
+    do
+        result = ::connect( fd, (sockaddr*)&address, length );
+    while( result != 0 && errno == EINTR );
+
+    if( result != 0 )
+    {
+        LBDEBUG << "Could not connect to '" << description->getFilename()
+                << "': " << lunchbox::sysError << std::endl;
+        ::close( fd );
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    _readFD = fd;
+    _writeFD = fd;
+    _setState( STATE_CONNECTED );
+    LBDEBUG << "Connected " << description->toString() << std::endl;
+    return true;
+}
+
+bool UnixConnection::listen()
+{
+    ConstConnectionDescriptionPtr description = getDescription();
+    LBASSERT( description->type == CONNECTIONTYPE_UNIX );
+    if( !isClosed( ))
+        return false;
+
+    const std::string& filename = description->getFilename();
+    sockaddr_un address;
+    const socklen_t length = _getAddress( filename, address );
+    if( length == 0 )
+    {
+        LBWARN << "Invalid unix socket path '" << filename << "'" << std::endl;
+        return false;
+    }
+
+    _setState( STATE_CONNECTING );
+
+    const int fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 )
+    {
+        LBERROR << "Could not create socket: " << lunchbox::sysError
+                << std::endl;
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    bool bound = ::bind( fd, (sockaddr*)&address, length ) == 0;
+    if( !bound && errno == EADDRINUSE && !_isAbstract( filename ))
+    {
+        // remove the socket file left by a dead listener, but not a live one
+        const int probe = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+        if( probe >= 0 &&
+            ::connect( probe, (sockaddr*)&address, length ) != 0 &&
+            errno == ECONNREFUSED )
+        {
+            ::unlink( filename.c_str( ));
+            bound = ::bind( fd, (sockaddr*)&address, length ) == 0;
+        }
+        if( probe >= 0 )
+            ::close( probe );
+    }
+
+    if( !bound || ::listen( fd, SOMAXCONN ) != 0 )
+    {
+        LBWARN << "Could not listen on unix socket '" << filename << "': "
+               << lunchbox::sysError << std::endl;
+        ::close( fd );
+        _setState( STATE_CLOSED );
+        return false;
+    }
+
+    _readFD = fd;
+    _writeFD = fd;
+    _setState( STATE_LISTENING );
+    LBDEBUG << "Listening on " << description->toString() << std::endl;
+    return true;
+}
+
+void UnixConnection::_close()
+{
+    if( isClosed( ))
+        return;
+
+    const std::string& filename = getDescription()->getFilename();
+    if( isListening() && !_isAbstract( filename ))
+        ::unlink( filename.c_str( ));
+
+    _setState( STATE_CLOSING ); // stops the send queue using the socket
+    if( _readFD > 0 && ::close( _readFD ) != 0 )
+        LBWARN << "Could not close unix socket: " << lunchbox::sysError
+               << std::endl;
+
+    _readFD = -1;
+    _writeFD = -1;
+    _setState( STATE_CLOSED );
+}
+
+ConnectionPtr UnixConnection::acceptSync()
+{
+    if( !isListening( ))
+        return 0;
+
+    int fd;
+    do
+        fd = ::accept( _readFD, 0, 0 );
+    while( fd < 0 && errno == EINTR );
+
+    if( fd < 0 )
+    {
+        LBWARN << "accept failed: " << lunchbox::sysError << std::endl;
+        return 0;
+    }
+
+    UnixConnection* newConnection = new UnixConnection;
+    newConnection->_readFD = fd;
+    newConnection->_writeFD = fd;
+
+    ConnectionDescriptionPtr description = newConnection->_getDescription();
+    description->setFilename( getDescription()->getFilename( ));
+    description->bandwidth = getDescription()->bandwidth;
+    newConnection->_setState( STATE_CONNECTED );
+
+    LBDEBUG << "Accepted " << description->toString() << std::endl;
+    return newConnection;
+}
+}
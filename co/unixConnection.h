@@ -0,0 +1,53 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This file is part of Collage <https://github.com/Eyescale/Collage>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CO_UNIXCONNECTION_H
+#define CO_UNIXCONNECTION_H
+
+#include "fdConnection.h" // base class
+
+namespace co
+{
+/**
+ * A stream connection over a unix domain socket.
+ *
+ * The socket path is the filename of the description. A filename starting
+ * with '@' names a socket in the abstract namespace on Linux, which leaves no
+ * file behind. Local traffic bypasses the TCP/IP stack.
+ */
+class UnixConnection : public FDConnection
+{
+public:
+    /** Construct a new unix domain socket connection. */
+    UnixConnection();
+
+    bool connect() override;
+    bool listen() override;
+    void acceptNB() override { /* nop */ }
+    ConnectionPtr acceptSync() override;
+    void close() override { _close(); }
+
+protected:
+    virtual ~UnixConnection();
+
+private:
+    void _close();
+};
+}
+
+#endif //CO_UNIXCONNECTION_H
@@ -0,0 +1,184 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests enqueue/dequeue cost and consumer wakeup latency of the CommandQueue,
+// compared to the lunchbox::MTQueue it used to be based on.
+// Usage: ./commandQueuePerf
+
+#include <lunchbox/test.h>
+
+#include <co/buffer.h>
+#include <co/bufferCache.h>
+#include <co/commandQueue.h>
+#include <co/iCommand.h>
+#include <co/init.h>
+#include <co/oCommand.h>
+
+#include <lunchbox/clock.h>
+#include <lunchbox/mtQueue.h>
+
+#include <iostream>
+
+#define N_PRODUCERS 3
+
+static const uint32_t _nOps = 100000;
+static const uint32_t _nLoops = 20000;
+static const uint32_t _stop = 0xffffffffu;
+
+typedef lunchbox::MTQueue< co::ICommand > MTQueue;
+
+static co::ICommand _pop( co::CommandQueue& queue ) { return queue.pop(); }
+static co::ICommand _pop( MTQueue& queue ) { return queue.pop(); }
+
+static co::BufferCache _buffers( 8 );
+
+static co::ICommand _newCommand()
+{
+    const uint64_t size = co::OCommand::getSize();
+    co::BufferPtr buffer = _buffers.alloc( co::COMMAND_ALLOCSIZE );
+    buffer->resize( size );
+    reinterpret_cast< uint64_t* >( buffer->getData( ))[ 0 ] = size;
+
+    co::ICommand command( 0, 0, buffer, false /*swap*/ );
+    command.setType( co::COMMANDTYPE_CUSTOM );
+    return command;
+}
+
+template< class Q > class Producer : public lunchbox::Thread
+{
+public:
+    Producer() : queue( 0 ) {}
+
+    Q* queue;
+    co::ICommand command;
+
+protected:
+    void run() override
+    {
+        for( uint32_t i = 0; i < _nOps; ++i )
+        {
+            command.setCommand( i );
+            queue->push( command );
+        }
+    }
+};
+
+template< class Q > class Echo : public lunchbox::Thread
+{
+public:
+    Echo( Q& request, Q& reply ) : _request( request ), _reply( reply ) {}
+
+protected:
+    void run() override
+    {
+        for( ;; )
+        {
+            const co::ICommand command = _pop( _request );
+            _reply.push( command );
+            if( command.getCommand() == _stop )
+                return;
+        }
+    }
+
+private:
+    Q& _request;
+    Q& _reply;
+};
+
+/** @return the time in ns per pushed and popped command. */
+template< class Q > float _testThroughput()
+{
+    Q queue;
+    Producer< Q > producers[ N_PRODUCERS ];
+    co::ConstBufferPtr buffers[ N_PRODUCERS ];
+    uint32_t next[ N_PRODUCERS ];
+
+    for( size_t i = 0; i < N_PRODUCERS; ++i )
+    {
+        producers[i].queue = &queue;
+        producers[i].command = _newCommand();
+        buffers[i] = producers[i].command.getBuffer();
+        next[i] = 0;
+    }
+
+    lunchbox::Clock clock;
+    for( size_t i = 0; i < N_PRODUCERS; ++i )
+        TEST( producers[i].start( ));
+
+    for( uint32_t i = 0; i < N_PRODUCERS * _nOps; ++i )
+    {
+        const co::ICommand command = _pop( queue );
+        size_t j = 0;
+        while( j < N_PRODUCERS && buffers[j] != command.getBuffer( ))
+            ++j;
+
+        TEST( j < N_PRODUCERS );
+        TESTINFO( command.getCommand() == next[j],
+                  command.getCommand() << " != " << next[j] );
+        ++next[j];
+    }
+    const float time = clock.getTimef();
+
+    for( size_t i = 0; i < N_PRODUCERS; ++i )
+        TEST( producers[i].join( ));
+    TEST( queue.isEmpty( ));
+    return time * 1000000.f / float( N_PRODUCERS * _nOps );
+}
+
+/** @return the time in us of a push to a waiting consumer. */
+template< class Q > float _testLatency()
+{
+    Q request;
+    Q reply;
+    Echo< Q > echo( request, reply );
+    TEST( echo.start( ));
+
+    co::ICommand command = _newCommand();
+    lunchbox::Clock clock;
+    for( uint32_t i = 0; i < _nLoops; ++i )
+    {
+        command.setCommand( i );
+        request.push( command );
+        TEST( _pop( reply ).getCommand() == i );
+    }
+    const float time = clock.getTimef();
+
+    command.setCommand( _stop );
+    request.push( command );
+    TEST( _pop( reply ).getCommand() == _stop );
+    TEST( echo.join( ));
+
+    // each loop wakes up the echo thread and this thread once
+    return time * 1000.f / float( 2 * _nLoops );
+}
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+
+    const float queueOp = _testThroughput< co::CommandQueue >();
+    const float queueWakeup = _testLatency< co::CommandQueue >();
+    const float mtQueueOp = _testThroughput< MTQueue >();
+    const float mtQueueWakeup = _testLatency< MTQueue >();
+
+    std::cout << "CommandQueue push/pop: " << queueOp << "ns, wakeup: "
+              << queueWakeup << "us" << std::endl
+              << "MTQueue push/pop:      " << mtQueueOp << "ns, wakeup: "
+              << mtQueueWakeup << "us" << std::endl;
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests that a compressed connection delivers compressible, incompressible
+// and small sends in order, signals data buffered after partial reads, does
+// not block non-blocking reads on partially received frames, and does not
+// block accepting a client which never sends its handshake.
+
+#include <lunchbox/test.h>
+#include <co/buffer.h>
+#include <co/connection.h>
+#include <co/connectionDescription.h>
+#include <co/connectionSet.h>
+#include <co/init.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/rng.h>
+#include <lunchbox/thread.h>
+#include <pression/plugins/compressorTypes.h>
+
+namespace
+{
+static const size_t _size = 1024 * 1024;
+static const size_t _readSize = 4096;
+static const uint32_t _timeout = 10000; // ms
+
+// the handshake and frame header of co/compressedConnection.cpp
+struct Hello
+{
+    uint32_t magic;
+    uint32_t compressor;
+};
+
+struct FrameHeader
+{
+    uint64_t size;
+    uint32_t compressor;
+    uint32_t nChunks;
+};
+
+class Writer : public lunchbox::Thread
+{
+public:
+    Writer( co::ConnectionPtr connection, const std::vector< uint8_t >& data )
+        : _connection( connection ), _data( data ) {}
+
+protected:
+    void run() override
+    {
+        for( size_t offset = 0; offset < _data.size(); )
+        {
+            const size_t size = LB_MIN( _data.size() - offset,
+                                        offset % 3 ? 100 : _size / 4 );
+            TEST( _connection->send( &_data[ offset ], size ));
+            offset += size;
+        }
+    }
+
+private:
+    co::ConnectionPtr _connection;
+    const std::vector< uint8_t >& _data;
+};
+
+/** A client not sending its handshake may not block the accepting thread. */
+void _testSilentClient( co::ConnectionDescriptionPtr desc,
+                        co::ConnectionPtr listener )
+{
+    std::string data = desc->toString();
+    co::ConnectionDescriptionPtr rawDesc = new co::ConnectionDescription( data );
+    rawDesc->compressor = EQ_COMPRESSOR_NONE;
+    co::ConnectionPtr client = co::Connection::create( rawDesc );
+    TEST( client->connect( ));
+
+    lunchbox::Clock clock;
+    TEST( !listener->acceptSync( ));
+    TESTINFO( clock.getTime64() < 5000, clock.getTime64( ));
+    listener->acceptNB();
+    client->close();
+}
+
+/**
+ * Send a frame in two writes from a plain stream: a non-blocking read on the
+ * first half has to return without data instead of waiting for the rest.
+ */
+void _testPartialFrame( co::ConnectionDescriptionPtr desc,
+                        co::ConnectionPtr listener )
+{
+    std::string data = desc->toString();
+    co::ConnectionDescriptionPtr rawDesc = new co::ConnectionDescription( data );
+    rawDesc->compressor = EQ_COMPRESSOR_NONE;
+    co::ConnectionPtr client = co::Connection::create( rawDesc );
+    TEST( client->connect( ));
+
+    Hello hello = { 0xC0C0DEC5u, EQ_COMPRESSOR_NONE };
+    TEST( client->send( &hello, sizeof( hello )));
+    co::ConnectionPtr server = listener->acceptSync();
+    listener->acceptNB();
+    TEST( server );
+
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    client->recvNB( &buffer, sizeof( hello ));
+    TEST( client->recvSync( syncBuffer ));
+
+    const uint64_t payload = 0xC0FFEE;
+    const FrameHeader header = { sizeof( payload ), EQ_COMPRESSOR_NONE, 0 };
+    const uint8_t* bytes = reinterpret_cast< const uint8_t* >( &header );
+    TEST( client->send( bytes, sizeof( header ) / 2 ));
+
+    co::ConnectionSet set;
+    set.addConnection( server );
+    TEST( set.select( _timeout ) == co::ConnectionSet::EVENT_DATA );
+
+    buffer.setSize( 0 );
+    server->recvNB( &buffer, sizeof( payload ));
+    lunchbox::Clock clock;
+    TEST( server->recvSync( syncBuffer, false ));
+    TEST( !syncBuffer ); // nothing read, the receive is still pending
+    TESTINFO( clock.getTime64() < 1000, clock.getTime64( ));
+
+    TEST( client->send( bytes + sizeof( header ) / 2,
+                        sizeof( header ) - sizeof( header ) / 2 ));
+    TEST( client->send( &payload, sizeof( payload )));
+    while( !syncBuffer )
+    {
+        TEST( set.select( _timeout ) == co::ConnectionSet::EVENT_DATA );
+        TEST( server->recvSync( syncBuffer, false ));
+    }
+    TEST( buffer.getSize() == sizeof( payload ));
+    TEST( *reinterpret_cast< const uint64_t* >( buffer.getData( )) ==
+          payload );
+
+    set.removeConnection( server );
+    client->close();
+    server->close();
+}
+}
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+
+    // compressible first half, random second half
+    lunchbox::RNG rng;
+    std::vector< uint8_t > data( 2 * _size );
+    for( size_t i = 0; i < _size; ++i )
+        data[i] = uint8_t( i / 512 );
+    for( size_t i = _size; i < data.size(); ++i )
+        data[i] = rng.get< uint8_t >();
+
+    co::ConnectionDescriptionPtr desc = new co::ConnectionDescription;
+    desc->type = co::CONNECTIONTYPE_TCPIP;
+    desc->setHostname( "127.0.0.1" );
+    desc->compressor = EQ_COMPRESSOR_AUTO;
+
+    co::ConnectionPtr listener = co::Connection::create( desc );
+    TEST( listener );
+    TEST( listener->listen( ));
+    listener->acceptNB();
+
+    co::ConnectionPtr client = co::Connection::create( desc );
+    TEST( client->connect( ));
+    co::ConnectionPtr server = listener->acceptSync();
+    TEST( server );
+    TEST( server->getDescription()->compressor == EQ_COMPRESSOR_AUTO );
+
+    Writer writer( client, data );
+    TEST( writer.start( ));
+
+    // small reads leave decompressed data, which has to wake up the set
+    co::ConnectionSet set;
+    set.addConnection( server );
+
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    while( buffer.getSize() < data.size( ))
+    {
+        TEST( set.select( _timeout ) == co::ConnectionSet::EVENT_DATA );
+        TEST( set.getConnection() == server );
+
+        const size_t size = LB_MIN( _readSize,
+                                    data.size() - buffer.getSize( ));
+        server->recvNB( &buffer, size );
+        TEST( server->recvSync( syncBuffer ));
+    }
+    TEST( writer.join( ));
+    TEST( ::memcmp( buffer.getData(), data.data(), data.size( )) == 0 );
+
+    set.removeConnection( server );
+    client->close();
+    server->close();
+
+    _testPartialFrame( desc, listener );
+    _testSilentClient( desc, listener );
+    listener->close();
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
@@ -41,6 +41,8 @@ static co::ConnectionType types[] =
     co::CONNECTIONTYPE_NAMEDPIPE,
     co::CONNECTIONTYPE_RSP,
     co::CONNECTIONTYPE_RDMA,
+    co::CONNECTIONTYPE_SHM,
+    co::CONNECTIONTYPE_UNIX,
 //    co::CONNECTIONTYPE_UDT,
     co::CONNECTIONTYPE_NONE // must be last
 };
@@ -0,0 +1,153 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests the serialization of the socket options in ConnectionDescription,
+// that connections accepted by a listener inherit them and that they are set
+// on the sockets.
+
+#include <lunchbox/test.h>
+#include <co/buffer.h>
+#include <co/connection.h>
+#include <co/connectionDescription.h>
+#include <co/global.h>
+#include <co/init.h>
+
+#ifdef __linux__
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <sys/socket.h>
+
+namespace
+{
+int _getOption( const co::ConnectionPtr& connection, const int level,
+                const int name )
+{
+    int value = -1;
+    socklen_t length = sizeof( value );
+    TEST( ::getsockopt( connection->getNotifier(), level, name, &value,
+                        &length ) == 0 );
+    return value;
+}
+
+void _testOptions( const co::ConnectionPtr& connection,
+                   const co::ConnectionDescription& desc )
+{
+    // the kernel doubles the buffer sizes for its bookkeeping
+    TEST( _getOption( connection, SOL_SOCKET, SO_SNDBUF ) >=
+          desc.sendBufferSize );
+    TEST( _getOption( connection, SOL_SOCKET, SO_RCVBUF ) >=
+          desc.receiveBufferSize );
+    TEST( _getOption( connection, IPPROTO_TCP, TCP_NODELAY ) == 0 );
+    TEST( _getOption( connection, IPPROTO_TCP, TCP_CORK ) == 1 );
+    TEST( _getOption( connection, IPPROTO_IP, IP_TOS ) == desc.tos );
+}
+}
+#endif
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+    // the notifier has to be the socket to read its options
+    co::Global::setIAttribute( co::Global::IATTR_TCP_URING, 0 );
+
+    co::ConnectionDescriptionPtr desc = new co::ConnectionDescription;
+    desc->type = co::CONNECTIONTYPE_TCPIP;
+    desc->setHostname( "127.0.0.1" );
+    desc->sendBufferSize = 65536; // below the default net.core.wmem_max
+    desc->receiveBufferSize = 131072;
+    desc->noDelay = false;
+    desc->cork = true;
+    desc->busyPoll = 50;
+    desc->quickAck = true;
+    desc->tos = 0x10;
+
+    co::ConnectionDescriptions descriptions;
+    descriptions.push_back( desc );
+    descriptions.push_back( new co::ConnectionDescription );
+
+    std::string data = co::serialize( descriptions );
+    co::ConnectionDescriptions result;
+    TEST( co::deserialize( data, result ));
+    TEST( data.empty( ));
+    TESTINFO( result.size() == 2, result.size( ));
+    TESTINFO( *result[0] == *desc, *result[0] << " != " << *desc );
+    TEST( *result[1] == *descriptions[1] );
+    TEST( result[1]->noDelay );
+    TEST( !result[1]->cork );
+    TEST( result[1]->tos == -1 );
+
+    // format of older peers, without the socket options
+    data = "2#TCPIP#100#foo##4242#default#UNIX#0###0#/tmp/co#";
+    result.clear();
+    TEST( co::deserialize( data, result ));
+    TEST( data.empty( ));
+    TESTINFO( result.size() == 2, result.size( ));
+    TEST( result[0]->type == co::CONNECTIONTYPE_TCPIP );
+    TEST( result[0]->bandwidth == 100 );
+    TEST( result[0]->getHostname() == "foo" );
+    TEST( result[0]->port == 4242 );
+    TEST( result[0]->noDelay );
+    TEST( result[0]->streams == 1 );
+    TEST( result[0]->compressor == 0 );
+    TEST( result[1]->type == co::CONNECTIONTYPE_UNIX );
+    TEST( result[1]->getFilename() == "/tmp/co" );
+
+    co::ConnectionPtr listener = co::Connection::create( desc );
+    TEST( listener );
+    TEST( listener->listen( ));
+    listener->acceptNB();
+
+    co::ConnectionPtr client = co::Connection::create( desc );
+    TEST( client->connect( ));
+    co::ConnectionPtr server = listener->acceptSync();
+    TEST( server );
+
+    co::ConstConnectionDescriptionPtr accepted = server->getDescription();
+    TEST( accepted->sendBufferSize == desc->sendBufferSize );
+    TEST( accepted->receiveBufferSize == desc->receiveBufferSize );
+    TEST( accepted->noDelay == desc->noDelay );
+    TEST( accepted->cork == desc->cork );
+    TEST( accepted->busyPoll == desc->busyPoll );
+    TEST( accepted->quickAck == desc->quickAck );
+    TEST( accepted->tos == desc->tos );
+
+#ifdef __linux__
+    _testOptions( client, *desc );
+    _testOptions( server, *desc );
+#endif
+
+    // corked sends and re-armed quick acks still deliver all data, flush()
+    // pushes out the corked partial frame
+    const uint64_t message = 0xC0FFEE;
+    TEST( client->send( &message, sizeof( message )));
+    TEST( client->flush( ));
+#ifdef __linux__
+    TEST( _getOption( client, IPPROTO_TCP, TCP_CORK ) == 1 );
+#endif
+
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    server->recvNB( &buffer, sizeof( message ));
+    TEST( server->recvSync( syncBuffer ));
+    TEST( *reinterpret_cast< const uint64_t* >( buffer.getData( )) == message );
+
+    server->close();
+    client->close();
+    listener->close();
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
@@ -36,6 +36,7 @@
 // Tests the functionality of the DataOStream and DataIStream
 
 #define CONTAINER_SIZE LB_64KB
+#define LARGE_ARRAY_SIZE LB_1MB // elements, sent without copy
 
 static const std::string _message( "So long, and thanks for all the fish" );
 static const std::string _lorem( "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Ut eget felis sed leo tincidunt dictum eu eu felis. Aenean aliquam augue nec elit tristique tempus. Pellentesque dignissim adipiscing tellus, ut porttitor nisl lacinia vel. Donec malesuada lobortis velit, nec lobortis metus consequat ac. Ut dictum rutrum dui. Pellentesque quis risus at lectus bibendum laoreet. Suspendisse tristique urna quis urna faucibus et auctor risus ultricies. Morbi vitae mi vitae nisi adipiscing ultricies ac in nulla. Nam mattis venenatis nulla, non posuere felis tempus eget. Cras dapibus ultrices arcu vel dapibus. Nam hendrerit lacinia consectetur. Donec ullamcorper nibh nisl, id aliquam nisl. Nunc at tortor a lacus tincidunt gravida vitae nec risus. Suspendisse potenti. Fusce tristique dapibus ipsum, sit amet posuere turpis fermentum nec. Nam nec ante dolor." );
@@ -136,6 +137,11 @@ protected:
             blob[ i ] = char( i );
         stream << co::Array< void >( blob, 128 );
 
+        std::vector< uint32_t > large( LARGE_ARRAY_SIZE );
+        for( size_t i = 0; i < LARGE_ARRAY_SIZE; ++i )
+            large[ i ] = uint32_t( i );
+        stream << co::Array< const uint32_t >( &large.front(), large.size( ));
+
         std::string strings[2] = { _message, _lorem };
         stream << co::Array< std::string >( strings, 2 );
 
@@ -232,6 +238,11 @@ int main( int argc, char **argv )
     for( size_t i=0; i < 128; ++i )
         TEST( blob[ i ] == char( i ));
 
+    std::vector< uint32_t > large( LARGE_ARRAY_SIZE );
+    stream >> co::Array< uint32_t >( &large.front(), large.size( ));
+    for( size_t i = 0; i < LARGE_ARRAY_SIZE; ++i )
+        TEST( large[ i ] == uint32_t( i ));
+
     std::string strings[2];
     stream >> co::Array< std::string >( strings, 2 );
     TEST( strings[0] == _message );
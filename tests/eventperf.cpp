@@ -0,0 +1,119 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests ConnectionSet wakeup latency using an EventConnection compared to
+// signalling through a PipeConnection, as EventConnection used to do.
+// Usage: ./eventperf
+
+#include <lunchbox/test.h>
+#include <co/buffer.h>
+#include <co/connectionSet.h>
+#include <co/init.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/monitor.h>
+
+#include <iostream>
+
+#include <co/eventConnection.h> // private header
+#include <co/pipeConnection.h> // private header
+
+static const uint32_t _nLoops = 20000;
+static lunchbox::Monitor< uint32_t > _received;
+
+class Waiter : public lunchbox::Thread
+{
+public:
+    Waiter( co::ConnectionSet& set, co::ConnectionPtr pipe )
+        : _set( set ), _pipe( pipe ) {}
+
+protected:
+    void run() override
+    {
+        co::Buffer buffer;
+        co::BufferPtr syncBuffer;
+
+        buffer.setSize( 0 );
+        _pipe->recvNB( &buffer, 1 );
+
+        for( uint32_t i = 0; i < 2 * _nLoops; ++i )
+        {
+            switch( _set.select( ))
+            {
+            case co::ConnectionSet::EVENT_INTERRUPT:
+                break;
+
+            case co::ConnectionSet::EVENT_DATA:
+                TEST( _pipe->recvSync( syncBuffer ));
+                buffer.setSize( 0 );
+                _pipe->recvNB( &buffer, 1 );
+                break;
+
+            default:
+                TESTINFO( false, "Unexpected connection set event" );
+            }
+            ++_received;
+        }
+    }
+
+private:
+    co::ConnectionSet& _set;
+    co::ConnectionPtr _pipe;
+};
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+
+    co::PipeConnectionPtr pipe = new co::PipeConnection;
+    TEST( pipe->connect( ));
+    co::ConnectionPtr sender = pipe->acceptSync();
+
+    co::ConnectionSet set;
+    set.addConnection( pipe.get( ));
+
+    Waiter waiter( set, pipe.get( ));
+    TEST( waiter.start( ));
+
+    lunchbox::Clock clock;
+    const char c = 42;
+    for( uint32_t i = 1; i <= _nLoops; ++i )
+    {
+        TEST( sender->send( &c, 1 ));
+        _received.waitGE( i );
+    }
+    const float pipeTime = clock.getTimef();
+
+    clock.reset();
+    for( uint32_t i = _nLoops + 1; i <= 2 * _nLoops; ++i )
+    {
+        set.interrupt();
+        _received.waitGE( i );
+    }
+    const float eventTime = clock.getTimef();
+
+    std::cout << "PipeConnection wakeup:  "
+              << pipeTime * 1000.f / float( _nLoops ) << "us" << std::endl
+              << "EventConnection wakeup: "
+              << eventTime * 1000.f / float( _nLoops ) << "us" << std::endl;
+
+    TEST( waiter.join( ));
+    set.removeConnection( pipe.get( ));
+    pipe->close();
+    sender->close();
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
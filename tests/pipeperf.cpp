@@ -15,22 +15,26 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-// Tests PipeConnection throughput
+// Tests PipeConnection throughput, using read/write and vmsplice for large
+// page-aligned buffers.
 // Usage: ./pipeperf
 
 #define CO_TEST_RUNTIME 600 // seconds, needed for NighlyMemoryCheck
 #include <lunchbox/test.h>
 #include <co/buffer.h>
 #include <co/connectionSet.h>
+#include <co/global.h>
 #include <co/init.h>
 #include <lunchbox/clock.h>
 #include <lunchbox/monitor.h>
 
 #include <iostream>
+#include <vector>
 
 #include <co/pipeConnection.h> // private header
 
 #define MAXPACKETSIZE LB_64MB
+#define PAGESIZE 4096
 
 static lunchbox::Monitor< unsigned > _nextStage;
 
@@ -46,7 +50,11 @@ public:
 protected:
     virtual void run()
         {
-            void* buffer = calloc( 1, MAXPACKETSIZE );
+            // page-aligned to qualify for vmsplice
+            uint8_t* data =
+                static_cast< uint8_t* >( calloc( 1, MAXPACKETSIZE + PAGESIZE ));
+            void* buffer = data + PAGESIZE -
+                           ( reinterpret_cast< uintptr_t >( data ) % PAGESIZE );
 
             unsigned stage = 2;
             for( uint64_t packetSize = MAXPACKETSIZE; packetSize > 0;
@@ -65,16 +73,18 @@ protected:
                 _nextStage.waitGE( stage );
                 stage += 2;
             }
-            free( buffer );
+            free( data );
         }
 
 private:
     co::ConnectionPtr _connection;
 };
 
-int main( int argc, char **argv )
+/** @return the throughput in MB/s for each packet size. */
+static std::vector< float > _test()
 {
-    co::init( argc, argv );
+    std::vector< float > results;
+    _nextStage = 0;
     co::PipeConnectionPtr connection = new co::PipeConnection;
 
     TEST( connection->connect( ));
@@ -105,6 +115,7 @@ int main( int argc, char **argv )
             TEST( syncBuffer == &buffer );
         }
         const float time = clock.getTimef();
+        results.push_back( nPackets * mBytesSec / time );
         if( mBytes > 0.2f )
             std::cerr << nPackets * mBytesSec / time << "MB/s, "
                       << nPackets / time << "p/ms (" << mBytes << "MB)"
@@ -121,6 +132,32 @@ int main( int argc, char **argv )
 
     TEST( sender.join( ));
     connection->close();
+    return results;
+}
+
+int main( int argc, char **argv )
+{
+    co::init( argc, argv );
+
+    const int32_t spliceSize =
+        co::Global::getIAttribute( co::Global::IATTR_PIPE_SPLICE_SIZE );
+    co::Global::setIAttribute( co::Global::IATTR_PIPE_SPLICE_SIZE, 0 );
+    std::cerr << "read/write:" << std::endl;
+    const std::vector< float > copied = _test();
+
+    co::Global::setIAttribute( co::Global::IATTR_PIPE_SPLICE_SIZE,
+                               spliceSize );
+    std::cerr << "vmsplice:" << std::endl;
+    const std::vector< float > spliced = _test();
+
+    TEST( copied.size() == spliced.size( ));
+    uint64_t packetSize = MAXPACKETSIZE;
+    for( size_t i = 0; i < copied.size() && packetSize >= LB_1MB;
+         ++i, packetSize >>= 1 )
+    {
+        std::cerr << "vmsplice gain " << ( spliced[i] / copied[i] - 1.f ) * 100.f
+                  << "% (" << ( packetSize >> 20 ) << "MB)" << std::endl;
+    }
 
     co::exit();
     return EXIT_SUCCESS;
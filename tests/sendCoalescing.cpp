@@ -0,0 +1,114 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests that coalesced sends are held back until flushed, and that bigger and
+// locked sends keep the order of all sent data.
+
+#include <lunchbox/test.h>
+#include <co/buffer.h>
+#include <co/connectionSet.h>
+#include <co/init.h>
+
+#include <co/pipeConnection.h> // private header
+
+namespace
+{
+static const size_t _coalesceSize = 1024;
+
+bool _hasData( co::ConnectionSet& set )
+{
+    return set.select( 10 ) == co::ConnectionSet::EVENT_DATA;
+}
+
+void _receive( co::ConnectionPtr connection, std::vector< uint8_t >& data,
+               const size_t size )
+{
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    connection->recvNB( &buffer, size );
+    TEST( connection->recvSync( syncBuffer ));
+    TEST( buffer.getSize() == size );
+    data.insert( data.end(), buffer.getData(), buffer.getData() + size );
+}
+}
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+
+    co::PipeConnectionPtr reader = new co::PipeConnection;
+    TEST( reader->connect( ));
+    co::ConnectionPtr writer = reader->acceptSync();
+    writer->setSendCoalescing( _coalesceSize, 0 );
+
+    co::ConnectionSet set;
+    set.addConnection( reader.get( ));
+
+    std::vector< uint8_t > sent;
+    std::vector< uint8_t > big( 4 * _coalesceSize );
+    for( size_t i = 0; i < big.size(); ++i )
+        big[i] = uint8_t( i );
+
+    // small sends are buffered until flushed
+    for( uint8_t i = 0; i < 16; ++i )
+    {
+        TEST( writer->send( &i, 1 ));
+        sent.push_back( i );
+    }
+    TEST( !_hasData( set ));
+    TEST( writer->flush( ));
+    TEST( _hasData( set ));
+
+    std::vector< uint8_t > received;
+    _receive( reader.get(), received, sent.size( ));
+    TEST( received == sent );
+
+    // bigger and locked sends drain the buffer first
+    const uint8_t small = 42;
+    TEST( writer->send( &small, 1 ));
+    TEST( writer->send( big.data(), big.size( )));
+    TEST( writer->send( &small, 1 ));
+    writer->lockSend();
+    TEST( writer->send( &small, 1, true ));
+    writer->unlockSend();
+
+    sent.clear();
+    sent.push_back( small );
+    sent.insert( sent.end(), big.begin(), big.end( ));
+    sent.push_back( small );
+    sent.push_back( small );
+
+    received.clear();
+    _receive( reader.get(), received, sent.size( ));
+    TEST( received == sent );
+
+    // a full buffer is written without flush
+    sent.assign( _coalesceSize, small );
+    for( size_t i = 0; i < _coalesceSize; ++i )
+        TEST( writer->send( &small, 1 ));
+    TEST( _hasData( set ));
+
+    received.clear();
+    _receive( reader.get(), received, sent.size( ));
+    TEST( received == sent );
+
+    set.removeConnection( reader.get( ));
+    writer->close();
+    reader->close();
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests the asynchronous send queue: sends smaller and bigger than the budget
+// arrive in order, the queued data stays within the budget while the reader
+// lags behind, and closing a connection whose receiver stopped reading does
+// not wait for the timeout of the blocked send thread.
+
+#include <lunchbox/test.h>
+#include <co/buffer.h>
+#include <co/connectionDescription.h>
+#include <co/global.h>
+#include <co/init.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/rng.h>
+#include <lunchbox/sleep.h>
+#include <lunchbox/thread.h>
+
+#include <co/pipeConnection.h> // private header
+
+namespace
+{
+static const size_t _budget = 16384;
+static const size_t _nMessages = 1000;
+
+class Reader : public lunchbox::Thread
+{
+public:
+    Reader( co::ConnectionPtr connection, const size_t size )
+        : _connection( connection ), _size( size ) {}
+
+    co::Buffer buffer;
+
+protected:
+    void run() override
+    {
+        co::BufferPtr syncBuffer;
+        _connection->recvNB( &buffer, _size );
+        TEST( _connection->recvSync( syncBuffer ));
+    }
+
+private:
+    co::ConnectionPtr _connection;
+    const size_t _size;
+};
+
+/** Sends until the connection is closed, blocking on the full queue. */
+class Sender : public lunchbox::Thread
+{
+public:
+    explicit Sender( co::ConnectionPtr connection )
+        : _connection( connection ) {}
+
+protected:
+    void run() override
+    {
+        const std::vector< uint8_t > data( _budget / 4 );
+        while( _connection->send( data.data(), data.size( )))
+            ;
+    }
+
+private:
+    co::ConnectionPtr _connection;
+};
+
+void _testOrder()
+{
+    co::PipeConnectionPtr reader = new co::PipeConnection;
+    TEST( reader->connect( ));
+    co::ConnectionPtr writer = reader->acceptSync();
+    writer->setSendQueue( _budget );
+    TEST( writer->getSendQueueSize() == 0 );
+
+    lunchbox::RNG rng;
+    std::vector< size_t > sizes;
+    size_t total = 0;
+    for( size_t i = 0; i < _nMessages; ++i )
+    {
+        // mostly queued sends, some bigger than the budget
+        const size_t size = ( i % 10 == 0 ) ? 1 + rng.get< uint16_t >() * 2 :
+                                              1 + rng.get< uint16_t >() % 1024;
+        sizes.push_back( size );
+        total += size;
+    }
+
+    std::vector< uint8_t > data( total );
+    for( size_t i = 0; i < total; ++i )
+        data[i] = rng.get< uint8_t >();
+
+    Reader thread( reader.get(), total );
+    TEST( thread.start( ));
+
+    size_t offset = 0;
+    for( size_t i = 0; i < sizes.size(); ++i )
+    {
+        TEST( writer->send( &data[ offset ], sizes[i] ));
+        TEST( writer->getSendQueueSize() <= _budget );
+        offset += sizes[i];
+    }
+    TEST( writer->flush( ));
+    TEST( writer->getSendQueueSize() == 0 );
+
+    TEST( thread.join( ));
+    TEST( thread.buffer.getSize() == total );
+    TEST( ::memcmp( thread.buffer.getData(), data.data(), total ) == 0 );
+
+    writer->setSendQueue( 0 );
+    writer->close();
+    reader->close();
+}
+
+void _testClose()
+{
+    co::ConnectionDescriptionPtr desc = new co::ConnectionDescription;
+    desc->type = co::CONNECTIONTYPE_TCPIP;
+    desc->setHostname( "127.0.0.1" );
+
+    co::ConnectionPtr listener = co::Connection::create( desc );
+    TEST( listener->listen( ));
+    listener->acceptNB();
+
+    co::ConnectionPtr client = co::Connection::create( desc );
+    TEST( client->connect( ));
+    co::ConnectionPtr server = listener->acceptSync();
+    TEST( server );
+    client->setSendQueue( _budget );
+
+    // the server never reads: the socket buffers and then the queue fill up
+    Sender sender( client );
+    TEST( sender.start( ));
+    lunchbox::sleep( 500 /*ms*/ );
+    TEST( client->getSendQueueSize() > 0 );
+    TEST( client->getSendQueueSize() <= _budget );
+
+    lunchbox::Clock clock;
+    client->close();
+    TESTINFO( clock.getTime64() < 5000, clock.getTime64( ));
+    TEST( sender.join( ));
+    TEST( client->getSendQueueSize() == 0 );
+
+    server->close();
+    listener->close();
+}
+}
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+    // a blocked write would only give up after this
+    co::Global::setIAttribute( co::Global::IATTR_TIMEOUT_DEFAULT, 60000 );
+
+    _testOrder();
+    _testClose();
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/* Copyright (c) 2016, Collage contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 2.1 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Tests that a TCPIP connection striped over multiple streams is accepted
+// through a ConnectionSet, wakes up the set for pieces on any stream, delivers
+// small and large sends in order, and reports its throughput.
+// Usage: ./stripedConnection
+
+#include <lunchbox/test.h>
+#include <co/buffer.h>
+#include <co/connection.h>
+#include <co/connectionDescription.h>
+#include <co/connectionSet.h>
+#include <co/global.h>
+#include <co/init.h>
+#include <lunchbox/clock.h>
+#include <lunchbox/rng.h>
+#include <lunchbox/thread.h>
+
+#include <iostream>
+
+namespace
+{
+#ifdef __linux__
+static const size_t _nStreams = 4;
+#else // falls back to a single socket
+static const size_t _nStreams = 1;
+#endif
+static const size_t _stripeSize = 4096;
+static const size_t _nMessages = 100;
+static const size_t _maxSize = 256 * 1024;
+static const size_t _nLoops = 256;
+static const uint32_t _timeout = 10000; // ms
+
+class Writer : public lunchbox::Thread
+{
+public:
+    Writer( co::ConnectionPtr connection, const std::vector< uint8_t >& data,
+            const std::vector< size_t >& sizes )
+        : _connection( connection ), _data( data ), _sizes( sizes ) {}
+
+protected:
+    void run() override
+    {
+        size_t offset = 0;
+        for( size_t i = 0; i < _sizes.size(); ++i )
+        {
+            // split into two chunks to exercise pieces spanning chunks
+            const size_t size = _sizes[i];
+            const co::Connection::Chunk chunks[2] = {
+                { &_data[ offset ], size / 2 },
+                { &_data[ offset + size / 2 ], size - size / 2 }};
+            TEST( _connection->send( chunks, 2 ));
+            offset += size;
+        }
+
+        for( size_t i = 0; i < _nLoops; ++i )
+            TEST( _connection->send( _data.data(), _maxSize ));
+    }
+
+private:
+    co::ConnectionPtr _connection;
+    const std::vector< uint8_t >& _data;
+    const std::vector< size_t >& _sizes;
+};
+
+/** Each stream is a connect event, the last one yields the connection. */
+co::ConnectionPtr _accept( co::ConnectionSet& set,
+                           co::ConnectionPtr listener )
+{
+    for( size_t i = 0; i < _nStreams; ++i )
+    {
+        TEST( set.select( _timeout ) == co::ConnectionSet::EVENT_CONNECT );
+        TEST( set.getConnection() == listener );
+        co::ConnectionPtr connection = listener->acceptSync();
+        listener->acceptNB();
+        if( connection )
+        {
+            TEST( i == _nStreams - 1 );
+            return connection;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Read one send spanning all streams in half pieces. Once the first piece is
+ * read, its data is only on the other streams, which have to wake up the set.
+ */
+void _testWakeup( co::ConnectionSet& set, co::ConnectionPtr client,
+                  co::ConnectionPtr server )
+{
+    std::vector< uint8_t > data( _nStreams * _stripeSize );
+    for( size_t i = 0; i < data.size(); ++i )
+        data[i] = uint8_t( i / 7 );
+    TEST( client->send( data.data(), data.size( )));
+
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    while( buffer.getSize() < data.size( ))
+    {
+        TEST( set.select( _timeout ) == co::ConnectionSet::EVENT_DATA );
+        TEST( set.getConnection() == server );
+        server->recvNB( &buffer, _stripeSize / 2 );
+        TEST( server->recvSync( syncBuffer ));
+    }
+    TEST( ::memcmp( buffer.getData(), data.data(), data.size( )) == 0 );
+}
+
+float _receive( co::ConnectionPtr connection, const size_t bytes )
+{
+    lunchbox::Clock clock;
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    buffer.reserve( _maxSize );
+    for( size_t received = 0; received < bytes; received += _maxSize )
+    {
+        buffer.setSize( 0 );
+        connection->recvNB( &buffer, _maxSize );
+        TEST( connection->recvSync( syncBuffer ));
+    }
+    return clock.getTimef();
+}
+}
+
+int main( int argc, char **argv )
+{
+    TEST( co::init( argc, argv ));
+    co::Global::setIAttribute( co::Global::IATTR_TCP_STRIPE_SIZE,
+                               int32_t( _stripeSize ));
+
+    lunchbox::RNG rng;
+    std::vector< size_t > sizes;
+    size_t total = 0;
+    for( size_t i = 0; i < _nMessages; ++i )
+    {
+        const size_t size = ( i % 3 == 0 ) ? 1 + rng.get< uint8_t >() :
+                                             1 + rng.get< uint32_t >() % _maxSize;
+        sizes.push_back( size );
+        total += size;
+    }
+
+    std::vector< uint8_t > data( LB_MAX( total, _maxSize ));
+    for( size_t i = 0; i < data.size(); ++i )
+        data[i] = rng.get< uint8_t >();
+
+    co::ConnectionDescriptionPtr desc = new co::ConnectionDescription;
+    desc->type = co::CONNECTIONTYPE_TCPIP;
+    desc->setHostname( "127.0.0.1" );
+    desc->streams = 4;
+
+    co::ConnectionPtr listener = co::Connection::create( desc );
+    TEST( listener );
+    TEST( listener->listen( ));
+    listener->acceptNB();
+
+    co::ConnectionSet set;
+    set.addConnection( listener );
+
+    co::ConnectionPtr client = co::Connection::create( desc );
+    TEST( client->connect( ));
+    co::ConnectionPtr server = _accept( set, listener );
+    TEST( server );
+    TEST( server->getDescription()->streams == int32_t( _nStreams ) ||
+          _nStreams == 1 );
+
+    set.removeConnection( listener );
+    set.addConnection( server );
+    _testWakeup( set, client, server );
+    set.removeConnection( server );
+
+    Writer writer( client, data, sizes );
+    TEST( writer.start( ));
+
+    co::Buffer buffer;
+    co::BufferPtr syncBuffer;
+    server->recvNB( &buffer, total );
+    TEST( server->recvSync( syncBuffer ));
+    TEST( buffer.getSize() == total );
+    TEST( ::memcmp( buffer.getData(), data.data(), total ) == 0 );
+
+    const float time = _receive( server, _nLoops * _maxSize );
+    TEST( writer.join( ));
+    std::cout << _nStreams << " streams: "
+              << float( _nLoops * _maxSize ) / 1024.f / 1024.f / time * 1000.f
+              << " MB/s" << std::endl;
+
+    client->close();
+    server->close();
+    listener->close();
+
+    TEST( co::exit( ));
+    return EXIT_SUCCESS;
+}
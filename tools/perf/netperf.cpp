@@ -25,10 +25,14 @@
 #include <lunchbox/lock.h>
 #include <lunchbox/monitor.h>
 #include <lunchbox/sleep.h>
+#include <lunchbox/thread.h>
 #pragma warning( disable: 4275 )
 #  include <boost/program_options.hpp>
 #pragma warning( default: 4275 )
 #include <iostream>
+#ifndef _WIN32
+#  include <sys/resource.h>
+#endif
 
 #ifndef MIN
 #  define MIN LB_MIN
@@ -43,6 +47,31 @@ co::ConnectionSet   _connectionSet;
 lunchbox::a_int32_t _nClients;
 lunchbox::Lock      _mutexPrint;
 uint32_t _delay = 0;
+
+/** @return the user and system CPU time used by this process, in seconds. */
+float _getCPUTime()
+{
+#ifdef _WIN32
+    return 0.f;
+#else
+    struct rusage usage;
+    if( ::getrusage( RUSAGE_SELF, &usage ) != 0 )
+        return 0.f;
+    return float( usage.ru_utime.tv_sec + usage.ru_stime.tv_sec ) +
+           float( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) / 1e6f;
+#endif
+}
+
+/** Wait until no zero-copy send references the given buffer. */
+void _waitSent( co::ConnectionPtr connection, const co::Buffer& buffer )
+{
+    while( buffer.getRefCount() > 0 && connection->isConnected( ))
+    {
+        connection->handleError(); // reaps the completions
+        lunchbox::Thread::yield();
+    }
+}
+
 enum
 {
     SEQUENCE,
@@ -313,6 +342,7 @@ int main( int argc, char **argv )
     size_t packetSize = 1048576;
     size_t nPackets   = 0xffffffffu;
     uint32_t waitTime = 0;
+    int32_t zeroCopySize = 0;
 
     try // command line parsing
     {
@@ -328,9 +358,9 @@ int main( int argc, char **argv )
             ( "help,h",       po::bool_switch(&showHelp)->default_value(false),
               "show help message" )
             ( "client,c",     po::value<std::string>(&clientString),
-              "run as client, format IP[:port][:protocol]" )
+              "run as client, format IP[:port][:protocol] or path:UNIX" )
             ( "server,s",     po::value<std::string>(&serverString),
-              "run as server, format IP[:port][:protocol]" )
+              "run as server, format IP[:port][:protocol] or path:UNIX" )
             ( "threaded,t",  po::bool_switch(&useThreads)->default_value(false),
               "Run each receive in a separate thread (server only)" )
             ( "packetSize,p", po::value<std::size_t>(&packetSize),
@@ -340,7 +370,11 @@ int main( int argc, char **argv )
             ( "wait,w",       po::value<uint32_t>(&waitTime),
               "wait time (ms) between sends (client only)" )
             ( "delay,d",      po::value<uint32_t>(&_delay),
-              "wait time (ms) between receives (server only" );
+              "wait time (ms) between receives (server only" )
+            ( "zerocopy,z",   po::value<int32_t>(&zeroCopySize)->
+                                  implicit_value( 65536 ),
+              "use MSG_ZEROCOPY for TCP sends of at least the given size "
+              "(client only)" );
 
         // parse program options
         po::variables_map variableMap;
@@ -372,6 +406,9 @@ int main( int argc, char **argv )
         return EXIT_FAILURE;
     }
 
+    co::Global::setIAttribute( co::Global::IATTR_TCP_ZEROCOPY_SIZE,
+                               zeroCopySize );
+
     // run
     co::ConnectionPtr connection = co::Connection::create( description );
     if( !connection )
@@ -392,20 +429,34 @@ int main( int argc, char **argv )
         else if( !connection->connect( ))
             ::exit( EXIT_FAILURE );
 
-        lunchbox::Buffer< uint8_t > buffer;
-        buffer.resize( packetSize );
-        for( size_t i = 0; i<packetSize; ++i )
-            buffer[i] = static_cast< uint8_t >( i );
+        // Zero-copy sends read the data after send() returned. Each buffer
+        // is the owner of its sends and is reused once they completed.
+        static const size_t nBuffers = 16;
+        co::Buffer buffers[ nBuffers ];
+        for( size_t i = 0; i < nBuffers; ++i )
+        {
+            buffers[i].resize( packetSize );
+            for( size_t j = 0; j<packetSize; ++j )
+                buffers[i][j] = static_cast< uint8_t >( j );
+        }
 
-        const float mBytesSec = buffer.getSize() / 1024.0f / 1024.0f * 1000.0f;
+        const float mBytesSec = packetSize / 1024.0f / 1024.0f * 1000.0f;
         lunchbox::Clock clock;
         size_t lastOutput = nPackets;
+        const size_t nTotal = nPackets;
+        const float startCPU = _getCPUTime();
 
         clock.reset();
         while( nPackets-- )
         {
+            co::Buffer& buffer = buffers[ nPackets % nBuffers ];
+            _waitSent( connection, buffer );
+
             buffer[SEQUENCE] = uint8_t( nPackets );
-            LBCHECK( connection->send( buffer.getData(), buffer.getSize() ));
+            const co::Connection::Chunk chunk = { buffer.getData(),
+                                                  buffer.getSize() };
+            LBCHECK( connection->send( &chunk, 1,
+                                       co::ConstBufferPtr( &buffer )));
             const float time = clock.getTimef();
             if( time > 1000.f )
             {
@@ -430,6 +481,19 @@ int main( int argc, char **argv )
                       << "MB/s (" << nSamples / time * 1000.f  << "pps)"
                       << std::endl;
         }
+
+        const float gBytes = float( nTotal - nPackets - 1 ) *
+                             float( packetSize ) / 1024.f / 1024.f / 1024.f;
+        if( gBytes > 0.f )
+        {
+            const lunchbox::ScopedMutex<> mutex( _mutexPrint );
+            std::cerr << "Send CPU: " << ( _getCPUTime() - startCPU ) / gBytes
+                      << "s/GB" << ( zeroCopySize > 0 ? " (zero-copy)" : "" )
+                      << std::endl;
+        }
+        for( size_t i = 0; i < nBuffers; ++i )
+            _waitSent( connection, buffers[i] );
+
         if ( selector )
         {
             connection->close();
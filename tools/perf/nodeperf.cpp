@@ -19,6 +19,7 @@
 // Usage: see 'coNodeperf -h'
 
 #include <co/co.h>
+#include <lunchbox/atomic.h>
 #include <lunchbox/clock.h>
 #include <lunchbox/spinLock.h>
 #include <lunchbox/scopedMutex.h>
@@ -43,6 +44,7 @@ typedef lunchbox::Buffer< uint64_t > Buffer;
 
 ConnectedNodes nodes_;
 lunchbox::Lock print_;
+lunchbox::a_int32_t received_;
 static co::uint128_t _objectID( 0x25625429A197D730ull, 0x79F60861189007D5ull );
 template< class C >
 bool commandHandler( C command, Buffer& buffer, const uint64_t seed );
@@ -113,10 +115,118 @@ private:
 
     bool _cmdCustom( co::ICommand& command )
     {
-        return commandHandler( command, buffer_, getNodeID().low( ));
+        if( !commandHandler( command, buffer_, getNodeID().low( )))
+            return false;
+        ++received_;
+        return true;
     }
 };
 
+co::ConnectionDescriptionPtr _newLocalDescription()
+{
+    co::ConnectionDescriptionPtr desc = new co::ConnectionDescription;
+    desc->type = co::CONNECTIONTYPE_TCPIP;
+    desc->setHostname( "localhost" );
+    return desc;
+}
+
+/** Sends a fixed number of packets from its own local node. */
+class Sender : public lunchbox::Thread
+{
+public:
+    Sender( co::ConnectionDescriptionPtr remote, const size_t packetSize,
+            const uint32_t nPackets )
+        : _node( new PerfNode )
+        , _peer( new PerfNodeProxy )
+        , _packetSize( packetSize )
+        , _nPackets( nPackets )
+    {
+        _node->addConnectionDescription( _newLocalDescription( ));
+        LBCHECK( _node->listen( ));
+        _peer->addConnectionDescription( remote );
+    }
+
+    ~Sender() { _node->close(); }
+
+    bool connect() { return _node->connect( _peer ); }
+
+    void run() override
+    {
+        Buffer buffer;
+        const size_t bufferElems = _packetSize / sizeof( uint64_t );
+        buffer.resize( bufferElems );
+        for( size_t i = 0; i < bufferElems; ++i )
+            buffer[i] = i;
+
+        uint32_t nPackets = _nPackets;
+        while( nPackets-- )
+        {
+            const size_t j = (_peer->getNodeID().low() + nPackets) %
+                             bufferElems;
+            buffer[ j ] = nPackets;
+            _peer->send( co::CMD_NODE_CUSTOM ) << nPackets << buffer;
+            buffer[ j ] = 0xDEADBEEFu;
+        }
+    }
+
+private:
+    co::LocalNodePtr _node;
+    co::NodePtr _peer;
+    const size_t _packetSize;
+    const uint32_t _nPackets;
+};
+
+/**
+ * Measures the receive throughput of one node fed by nSenders in-process
+ * nodes, using 0, 1, 2, 4, ... maxReceivers additional receiver threads.
+ */
+void _benchmarkReceivers( const uint32_t maxReceivers, const uint32_t nSenders,
+                          const size_t packetSize, const uint32_t nPackets )
+{
+    const float mBytes = packetSize / 1024.0f / 1024.0f * nPackets * nSenders;
+
+    for( uint32_t nReceivers = 0; nReceivers <= maxReceivers;
+         nReceivers = nReceivers ? nReceivers << 1 : 1 )
+    {
+        co::Global::setIAttribute( co::Global::IATTR_RECEIVER_THREADS, 0 );
+        std::vector< Sender* > senders;
+        co::ConnectionDescriptionPtr desc = _newLocalDescription();
+        for( uint32_t i = 0; i < nSenders; ++i )
+            senders.push_back( new Sender( desc, packetSize, nPackets ));
+
+        co::Global::setIAttribute( co::Global::IATTR_RECEIVER_THREADS,
+                                   nReceivers );
+        co::LocalNodePtr receiver = new PerfNode;
+        receiver->addConnectionDescription( desc );
+        LBCHECK( receiver->listen( ));
+
+        BOOST_FOREACH( Sender* sender, senders )
+            LBCHECK( sender->connect( ));
+
+        received_ = 0;
+        lunchbox::Clock clock;
+        BOOST_FOREACH( Sender* sender, senders )
+            sender->start();
+        while( received_ < int32_t( nPackets * nSenders ))
+            lunchbox::Thread::yield();
+        const float time = clock.getTimef();
+
+        BOOST_FOREACH( Sender* sender, senders )
+        {
+            sender->join();
+            delete sender;
+        }
+        receiver->close();
+
+        const lunchbox::ScopedMutex<> mutex( print_ );
+        std::cerr << nReceivers << " receiver threads, " << nSenders
+                  << " senders: " << mBytes / time * 1000.f << "MB/s ("
+                  << nPackets * nSenders / time * 1000.f << "pps)"
+                  << std::endl;
+    }
+    co::Global::setIAttribute( co::Global::IATTR_RECEIVER_THREADS, 0 );
+}
+
 template< class C >
 bool commandHandler( C command, Buffer& buffer, const uint64_t seed )
 {
@@ -159,6 +269,9 @@ int main( int argc, char **argv )
     uint32_t waitTime = 0;
     bool useZeroconf = true;
     bool useObjects = false;
+    uint32_t maxReceivers = 0;
+    uint32_t nSenders = 4;
+    bool benchmarkReceivers = false;
 
     try // command line parsing
     {
@@ -185,7 +298,11 @@ int main( int argc, char **argv )
             ( "numPackets,n", po::value<uint32_t>(&nPackets),
               "number of packets to send" )
             ( "wait,w",       po::value<uint32_t>(&waitTime),
-              "wait time (ms) between sends" );
+              "wait time (ms) between sends" )
+            ( "receivers,r",  po::value<uint32_t>(&maxReceivers),
+              "benchmark receive scaling in-process using 0 to N receiver threads" )
+            ( "senders,s",    po::value<uint32_t>(&nSenders),
+              "number of in-process senders for --receivers" );
 
         // parse program options
         po::variables_map variableMap;
@@ -210,6 +327,13 @@ int main( int argc, char **argv )
 
         if( disableZeroconf )
             useZeroconf = false;
+
+        if( variableMap.count("receivers") == 1 )
+        {
+            benchmarkReceivers = true;
+            if( variableMap.count("numPackets") == 0 )
+                nPackets = 1000;
+        }
     }
     catch( std::exception& exception )
     {
@@ -219,6 +343,13 @@ int main( int argc, char **argv )
         return EXIT_FAILURE;
     }
 
+    if( benchmarkReceivers )
+    {
+        _benchmarkReceivers( maxReceivers, nSenders, packetSize, nPackets );
+        LBCHECK( co::exit( ));
+        return EXIT_SUCCESS;
+    }
+
     // Set up local node
     co::LocalNodePtr localNode = new PerfNode;
     if( !localNode->initLocal( argc, argv ))